@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "async_atlas.h"
+
+#include <algorithm>
+#include <future>
+
+bool AsyncAtlas::init( GLFWwindow *share, const std::vector<const Font*> &fonts, int width, int height, float row_height, float sdf_size,
+                       SdfMode mode, PackerType packer_type ) {
+    glfwWindowHint( GLFW_VISIBLE, GL_FALSE );
+    window = glfwCreateWindow( 1, 1, "sdf_atlas worker", nullptr, share );
+    if ( !window ) return false;
+
+    std::promise<bool> started;
+    std::future<bool> result = started.get_future();
+
+    worker = std::thread( [&, this]() {
+        glfwMakeContextCurrent( window );
+        sdf_gl.init();
+        bool ok = runtime.init( sdf_gl, fonts, width, height, row_height, sdf_size, mode, packer_type );
+        glFinish();
+        started.set_value( ok );
+        if ( ok ) run();
+        glfwMakeContextCurrent( nullptr );
+    } );
+
+    if ( !result.get() ) {
+        worker.join();
+        glfwDestroyWindow( window );
+        window = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t AsyncAtlas::submit( const std::vector<uint32_t> &codepoints, int priority, Callback callback, int deadline_ms ) {
+    std::shared_ptr<Request> req = std::make_shared<Request>();
+    req->priority = priority;
+    req->codepoints = codepoints;
+    req->callback = callback;
+    if ( deadline_ms > 0 ) {
+        req->has_deadline = true;
+        req->deadline = Clock::now() + std::chrono::milliseconds( deadline_ms );
+    }
+
+    std::lock_guard<std::mutex> lock( mutex );
+    req->id = next_id++;
+    pending.push_back( req );
+    wake.notify_one();
+    return req->id;
+}
+
+bool AsyncAtlas::cancel( uint64_t id ) {
+    std::lock_guard<std::mutex> lock( mutex );
+    auto it = std::find_if( pending.begin(), pending.end(), [id]( const std::shared_ptr<Request> &req ) {
+        return req->id == id;
+    } );
+    if ( it == pending.end() ) return false;
+    pending.erase( it );
+    if ( pending.empty() && !busy ) idle.notify_all();
+    return true;
+}
+
+void AsyncAtlas::wait_idle() {
+    std::unique_lock<std::mutex> lock( mutex );
+    idle.wait( lock, [this] { return pending.empty() && !busy; } );
+}
+
+void AsyncAtlas::shutdown() {
+    if ( !worker.joinable() ) return;
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stopping = true;
+        pending.clear();
+        wake.notify_one();
+        if ( !busy ) idle.notify_all();
+    }
+
+    worker.join();
+    glfwDestroyWindow( window );
+    window = nullptr;
+}
+
+void AsyncAtlas::run() {
+    // Higher priority, then the earlier deadline, then the earlier submit
+
+    auto before = []( const Request &a, const Request &b ) {
+        if ( a.priority != b.priority ) return a.priority > b.priority;
+        if ( a.has_deadline != b.has_deadline ) return a.has_deadline;
+        if ( a.has_deadline && a.deadline != b.deadline ) return a.deadline < b.deadline;
+        return a.id < b.id;
+    };
+
+    while ( true ) {
+        std::shared_ptr<Request> req;
+        std::vector<uint32_t> chunk;
+        bool last_chunk = false;
+
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            wake.wait( lock, [this] { return stopping || !pending.empty(); } );
+            if ( stopping ) break;
+
+            auto it = std::min_element( pending.begin(), pending.end(), [&]( const std::shared_ptr<Request> &a, const std::shared_ptr<Request> &b ) {
+                return before( *a, *b );
+            } );
+            req = *it;
+
+            size_t end = std::min( req->next + chunk_size, req->codepoints.size() );
+            chunk.assign( req->codepoints.begin() + req->next, req->codepoints.begin() + end );
+            req->next = end;
+            last_chunk = end == req->codepoints.size();
+
+            if ( last_chunk ) pending.erase( it );
+            busy = true;
+        }
+
+        Result result;
+        result.request = req->id;
+        result.done = last_chunk;
+        result.all_fit = runtime.add_codepoints( chunk, result.dirty );
+
+        for ( uint32_t cp : chunk ) {
+            const GlyphRect *gr = runtime.find( cp );
+            if ( gr ) result.rects.push_back( *gr );
+        }
+
+        for ( const DirtyRect &dr : result.dirty ) {
+            result.pixels.emplace_back( dr.w * dr.h );
+            runtime.read_rect( dr, result.pixels.back().data() );
+        }
+
+        // The texture is complete for the application context
+
+        glFinish();
+
+        result.late = req->has_deadline && Clock::now() > req->deadline;
+
+        if ( req->callback ) req->callback( result );
+
+        std::lock_guard<std::mutex> lock( mutex );
+        busy = false;
+        if ( pending.empty() ) idle.notify_all();
+    }
+
+    runtime.destroy();
+}
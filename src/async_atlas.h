@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include "runtime_atlas.h"
+
+// RuntimeAtlas generated on a worker thread with its own GL context, shared with the
+// application context, so the atlas texture is used directly.
+//
+// Requests are served by priority, then by the earliest deadline, then in submit order.
+// A request is rendered in chunks of chunk_size glyphs, a higher priority request
+// submitted meanwhile, e.g. for the visible text, is served from the next chunk.
+// Each chunk is reported to the request callback on the worker thread with the finished
+// glyph rects and the re-rendered texture rects with their pixels for the incremental upload.
+
+struct AsyncAtlas {
+    typedef std::chrono::steady_clock Clock;
+
+    struct Result {
+        uint64_t request = 0;
+        std::vector<GlyphRect> rects;                   // Finished glyphs of the chunk, including the ones added before
+        std::vector<DirtyRect> dirty;                   // Re-rendered texture rects
+        std::vector<std::vector<uint8_t>> pixels;       // Dirty rect pixels, rows bottom to top
+        bool done = false;                              // Last chunk of the request
+        bool late = false;                              // Chunk finished after the request deadline
+        bool all_fit = true;                            // False if some glyphs didn't fit into the atlas
+    };
+
+    typedef std::function<void( const Result& )> Callback;
+
+    struct Request {
+        uint64_t   id = 0;
+        int        priority = 0;
+        bool       has_deadline = false;
+        Clock::time_point deadline;
+        std::vector<uint32_t> codepoints;
+        size_t     next = 0;                // First codepoint not rendered yet
+        Callback   callback;
+    };
+
+    RuntimeAtlas runtime;                   // Used by the worker only
+    SdfGl        sdf_gl;
+    GLFWwindow  *window = nullptr;          // Hidden window owning the worker context
+
+    size_t       chunk_size = 16;
+
+    std::thread  worker;
+    std::mutex   mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::vector<std::shared_ptr<Request>> pending;
+    uint64_t     next_id = 1;
+    bool         busy = false;
+    bool         stopping = false;
+
+    ~AsyncAtlas() {
+        shutdown();
+    }
+
+    // Creates the worker context shared with 'share' and starts the worker. Call on the main thread, as GLFW requires.
+    // Returns false if the context or the runtime atlas can't be created.
+    bool init( GLFWwindow *share, const std::vector<const Font*> &fonts, int width, int height, float row_height, float sdf_size,
+               SdfMode mode = SdfMode::Stencil, PackerType packer_type = PackerType::Skyline );
+
+    // Queues the codepoints, higher priority first. deadline_ms > 0 orders the requests of the same priority
+    // and marks the chunks finished later as late. Returns the request id.
+    uint64_t submit( const std::vector<uint32_t> &codepoints, int priority, Callback callback, int deadline_ms = 0 );
+
+    // Drops the pending part of a request, e.g. for the text scrolled away. The chunk being rendered still completes.
+    // Returns false if the request is already finished.
+    bool cancel( uint64_t id );
+
+    // Blocks until all the requests are finished or dropped by shutdown()
+    void wait_idle();
+
+    // Stops the worker, pending requests are dropped and wait_idle() returns.
+    // Called by the destructor, on the main thread as GLFW requires.
+    void shutdown();
+
+    GLuint texture() const {
+        return runtime.target.texture;
+    }
+
+    void run();
+};
@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "atlas_server.h"
+#include "json_reader.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void ServerRequest::finish( const std::string &error ) {
+    std::lock_guard<std::mutex> lock( mutex );
+    this->error = error;
+    done = true;
+    done_cv.notify_all();
+}
+
+// Frames: 4 byte little endian length, then the payload
+
+static bool read_all( int fd, void *data, size_t size ) {
+    uint8_t *pos = (uint8_t*) data;
+    while ( size ) {
+        ssize_t n = recv( fd, pos, size, 0 );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return false;
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_all( int fd, const void *data, size_t size ) {
+    const uint8_t *pos = (const uint8_t*) data;
+    while ( size ) {
+        ssize_t n = send( fd, pos, size, MSG_NOSIGNAL );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) return false;
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_frame( int fd, std::string &payload, size_t max_size ) {
+    uint8_t len[ 4 ];
+    if ( !read_all( fd, len, 4 ) ) return false;
+
+    size_t size = len[ 0 ] | ( len[ 1 ] << 8 ) | ( len[ 2 ] << 16 ) | ( (size_t) len[ 3 ] << 24 );
+    if ( size > max_size ) return false;
+
+    payload.resize( size );
+    return size == 0 || read_all( fd, &payload[ 0 ], size );
+}
+
+static bool write_frame( int fd, const void *data, size_t size ) {
+    uint8_t len[ 4 ] = { (uint8_t) size, (uint8_t) ( size >> 8 ), (uint8_t) ( size >> 16 ), (uint8_t) ( size >> 24 ) };
+    return write_all( fd, len, 4 ) && write_all( fd, data, size );
+}
+
+static std::string json_string( const std::string &text ) {
+    std::string res = "\"";
+    for ( char c : text ) {
+        if ( c == '"' || c == '\\' ) {
+            res += '\\';
+            res += c;
+        } else if ( (uint8_t) c < 0x20 ) {
+            char esc[ 8 ];
+            snprintf( esc, 8, "\\u%04x", c );
+            res += esc;
+        } else {
+            res += c;
+        }
+    }
+    return res + "\"";
+}
+
+bool AtlasServer::init( SdfGenerator &generator, const std::string &socket_path, std::string &error ) {
+    this->generator = &generator;
+    this->socket_path = socket_path;
+
+    sockaddr_un addr;
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    if ( socket_path.size() >= sizeof( addr.sun_path ) ) {
+        error = "Socket path is too long '" + socket_path + "'";
+        return false;
+    }
+    strcpy( addr.sun_path, socket_path.c_str() );
+
+    listen_fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( listen_fd < 0 ) {
+        error = "Error creating socket";
+        return false;
+    }
+
+    unlink( socket_path.c_str() );
+
+    if ( bind( listen_fd, (sockaddr*) &addr, sizeof( addr ) ) != 0 || listen( listen_fd, 64 ) != 0 ) {
+        error = "Error listening on '" + socket_path + "': " + strerror( errno );
+        close( listen_fd );
+        listen_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void AtlasServer::accept_loop() {
+    while ( !stopping ) {
+        pollfd pfd = { listen_fd, POLLIN, 0 };
+        if ( poll( &pfd, 1, 100 ) <= 0 ) continue;
+
+        int fd = accept( listen_fd, nullptr, nullptr );
+        if ( fd < 0 ) continue;
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            connections.insert( fd );
+        }
+
+        std::thread( &AtlasServer::serve_connection, this, fd ).detach();
+    }
+}
+
+void AtlasServer::serve_connection( int fd ) {
+    std::string text;
+
+    while ( !stopping && read_frame( fd, text, max_request_size ) ) {
+        std::shared_ptr<ServerRequest> request = std::make_shared<ServerRequest>();
+        std::string error;
+
+        if ( parse_request( text, *request, error ) ) {
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                if ( stopping ) {
+                    request->done = true;
+                    request->error = "Server is shutting down";
+                } else {
+                    pending.push_back( request );
+                    pending_cv.notify_one();
+                }
+            }
+
+            std::unique_lock<std::mutex> lock( request->mutex );
+            request->done_cv.wait( lock, [&] { return request->done; } );
+            error = request->error;
+        }
+
+        bool ok;
+
+        if ( error.empty() ) {
+            std::stringstream ss;
+            ss << "{ \"ok\": true, \"pages\": " << request->pages.size() << ", \"width\": " << request->options.width;
+            ss << ", \"height\": " << request->height << ", \"row_height\": " << request->options.row_height;
+            ss << ", \"border_size\": " << request->options.border_size << ", \"glyphs\": " << request->glyph_count;
+            ss << ", \"format\": \"" << ( request->options.raw_pixels ? "raw" : "png" ) << "\" }";
+            std::string header = ss.str();
+
+            ok = write_frame( fd, header.data(), header.size() );
+            ok = ok && write_frame( fd, request->atlas_json.data(), request->atlas_json.size() );
+            for ( const std::vector<uint8_t> &page : request->pages ) {
+                ok = ok && write_frame( fd, page.data(), page.size() );
+            }
+            served++;
+        } else {
+            std::string header = "{ \"ok\": false, \"error\": " + json_string( error ) + " }";
+            ok = write_frame( fd, header.data(), header.size() );
+            failed++;
+        }
+
+        if ( !ok ) break;
+    }
+
+    // Untracked before the close, a descriptor reused by accept() must not be erased
+    std::lock_guard<std::mutex> lock( mutex );
+    connections.erase( fd );
+    close( fd );
+    connections_cv.notify_all();
+}
+
+// Request keys use the batch manifest names
+
+bool AtlasServer::parse_request( const std::string &text, ServerRequest &request, std::string &error ) {
+    JsonValue json;
+    if ( !parse_json( text, json, error ) ) return false;
+    if ( json.type != JsonValue::Object ) {
+        error = "Request is not a JSON object";
+        return false;
+    }
+
+    AtlasOptions &options = request.options;
+    options.use_tile_cache = generator->tile_cache != nullptr;
+
+    auto number = [&]( const JsonValue &value, int min_value, int &res ) {
+        if ( value.type != JsonValue::Number || value.number < min_value || value.number > generator->max_tex_size ) return false;
+        res = (int) value.number;
+        return true;
+    };
+
+    for ( const auto &kv : json.object ) {
+        const std::string &key = kv.first;
+        const JsonValue &value = kv.second;
+        bool valid = true;
+
+        if ( key == "font" ) {
+            if ( value.type == JsonValue::String ) {
+                request.font_filenames.push_back( value.str );
+            } else if ( value.type == JsonValue::Array ) {
+                for ( const JsonValue &item : value.array ) {
+                    if ( item.type != JsonValue::String ) valid = false;
+                    request.font_filenames.push_back( item.str );
+                }
+            } else {
+                valid = false;
+            }
+        } else if ( key == "width" ) {
+            valid = number( value, 1, options.width );
+        } else if ( key == "height" ) {
+            valid = number( value, 1, options.tex_height );
+        } else if ( key == "row_height" ) {
+            valid = number( value, 5, options.row_height );
+        } else if ( key == "border_size" ) {
+            valid = number( value, 1, options.border_size );
+            request.border_set = true;
+        } else if ( key == "ranges" ) {
+            valid = value.type == JsonValue::String && parse_unicode_ranges( value.str, options.unicode_ranges );
+        } else if ( key == "text" ) {
+            std::unordered_map<uint32_t, size_t> freq;
+            valid = value.type == JsonValue::String;
+            count_utf8( value.str, freq );
+            options.corpus_codepoints = frequency_order( freq );
+        } else if ( key == "mode" ) {
+            if ( value.str == "stencil" ) {
+                options.sdf_mode = SdfMode::Stencil;
+            } else if ( value.str == "quad" ) {
+                options.sdf_mode = SdfMode::GlyphQuad;
+            } else if ( value.str == "compute" && generator->sdf_gl.compute_supported ) {
+                options.sdf_mode = SdfMode::Compute;
+            } else {
+                valid = false;
+            }
+        } else if ( key == "packer" ) {
+            if ( value.str == "shelf" ) {
+                options.packer_type = PackerType::Shelf;
+            } else if ( value.str == "skyline" ) {
+                options.packer_type = PackerType::Skyline;
+            } else if ( value.str == "maxrects" ) {
+                options.packer_type = PackerType::MaxRects;
+            } else {
+                valid = false;
+            }
+        } else if ( key == "page_policy" ) {
+            if ( value.str == "fill" ) {
+                options.page_policy = PagePolicy::Fill;
+            } else if ( value.str == "block" ) {
+                options.page_policy = PagePolicy::Block;
+            } else {
+                valid = false;
+            }
+        } else if ( key == "format" ) {
+            if ( value.str == "png" || value.str == "raw" ) {
+                options.raw_pixels = value.str == "raw";
+            } else {
+                valid = false;
+            }
+        } else if ( key == "fit" ) {
+            char *pos = nullptr;
+            request.fit = value.type == JsonValue::String;
+            request.fit_width = strtol( value.str.c_str(), &pos, 10 );
+            valid = request.fit && ( *pos == 'x' || *pos == 'X' );
+            if ( valid ) request.fit_height = strtol( pos + 1, &pos, 10 );
+            valid = valid && *pos == 0 && request.fit_width > 0 && request.fit_height > 0 &&
+                    request.fit_width <= generator->max_tex_size && request.fit_height <= generator->max_tex_size;
+        } else {
+            error = "Unknown request key '" + key + "'";
+            return false;
+        }
+
+        if ( !valid ) {
+            error = "Bad value of request key '" + key + "'";
+            return false;
+        }
+    }
+
+    if ( request.font_filenames.empty() ) {
+        error = "Request has no 'font'";
+        return false;
+    }
+
+    return true;
+}
+
+// Collects the pages and the atlas JSON of the requests, the atlas name is the request index
+
+struct RequestSink : AtlasSink {
+    const std::vector<std::shared_ptr<ServerRequest>> &requests;
+
+    explicit RequestSink( const std::vector<std::shared_ptr<ServerRequest>> &requests ) : requests( requests ) {}
+
+    bool page( const AtlasOptions &options, const SdfAtlas &atlas, int page, std::vector<uint8_t> &png ) override {
+        ServerRequest &request = *requests[ std::stoul( options.name ) ];
+        request.pages.resize( atlas.page_count );
+        request.pages[ page ].swap( png );
+        return true;
+    }
+
+    bool atlas( const AtlasOptions &options, const SdfAtlas &atlas, int height ) override {
+        ServerRequest &request = *requests[ std::stoul( options.name ) ];
+        request.atlas_json = atlas.json( height );
+        request.height = height;
+        request.glyph_count = atlas.glyph_count;
+        request.finish( "" );
+        return true;
+    }
+};
+
+void AtlasServer::generate( const std::vector<std::shared_ptr<ServerRequest>> &requests ) {
+    std::vector<AtlasOptions> atlases;
+    std::vector<std::shared_ptr<ServerRequest>> planned;
+
+    // Fonts are loaded here, so trim_fonts() can't unload a font in use
+
+    for ( const std::shared_ptr<ServerRequest> &request : requests ) {
+        AtlasOptions &options = request->options;
+        options.fonts.clear();
+
+        bool ok = true;
+        for ( const std::string &filename : request->font_filenames ) {
+            const Font *font = generator->load_font( filename );
+            if ( !font ) {
+                ok = false;
+                break;
+            }
+            options.fonts.push_back( font );
+        }
+
+        if ( ok && request->fit ) {
+            ok = generator->fit( options, request->fit_width, request->fit_height, request->border_set );
+        }
+
+        if ( !ok ) {
+            request->finish( generator->error );
+            generator->error.clear();
+            continue;
+        }
+
+        options.name = std::to_string( planned.size() );
+        atlases.push_back( options );
+        planned.push_back( request );
+    }
+
+    if ( planned.empty() ) return;
+
+    RequestSink sink( planned );
+
+    if ( !generator->generate( atlases, sink ) ) {
+        std::string error = generator->error;
+
+        for ( const std::shared_ptr<ServerRequest> &request : planned ) {
+            if ( request->done ) continue;
+            if ( planned.size() == 1 ) {
+                request->finish( error );
+            } else {
+                request->pages.clear();
+                generate( { request } );
+            }
+        }
+    }
+}
+
+void AtlasServer::run() {
+    std::thread accept_thread( &AtlasServer::accept_loop, this );
+
+    while ( !stopping ) {
+        std::vector<std::shared_ptr<ServerRequest>> requests;
+
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            pending_cv.wait_for( lock, std::chrono::milliseconds( 100 ), [this] { return !pending.empty(); } );
+            requests.assign( pending.begin(), pending.end() );
+            pending.clear();
+        }
+
+        if ( requests.empty() ) continue;
+
+        generate( requests );
+        generator->trim_fonts();
+    }
+
+    accept_thread.join();
+    close( listen_fd );
+    unlink( socket_path.c_str() );
+
+    // Unblocking the connections waiting for the next request
+
+    std::unique_lock<std::mutex> lock( mutex );
+    for ( const std::shared_ptr<ServerRequest> &request : pending ) {
+        request->finish( "Server is shutting down" );
+    }
+    pending.clear();
+    for ( int fd : connections ) {
+        shutdown( fd, SHUT_RDWR );
+    }
+    connections_cv.wait( lock, [this] { return connections.empty(); } );
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "sdf_generator.h"
+
+// Atlas server on a Unix domain socket. The process keeps the GL context, shader programs,
+// framebuffer and the loaded fonts between the requests, so a small atlas costs only its
+// own generation.
+//
+// Protocol: every message is a frame of a 4 byte little endian length and the payload.
+// A connection sends any number of requests, each a JSON object frame with the batch job keys
+// font ( string or array ), width, height, ranges, border_size, row_height, mode, packer,
+// page_policy, fit, plus 'text' ( UTF-8 text to take the codepoints from, like '-c' ) and
+// 'format' ( "png" or "raw" ). The response is a JSON header frame
+// { "ok": true, "pages": N, "width": W, "height": H, "row_height": R, "border_size": B,
+//   "glyphs": G, "format": F } followed by the atlas JSON frame and N page frames,
+// or { "ok": false, "error": "message" } alone.
+//
+// Connections are read and written on their own threads. The requests waiting when the
+// generator is free go through one generate() call, so the tessellation and encoding of
+// one request overlap with the rendering of the next.
+
+struct ServerRequest {
+    AtlasOptions options;
+    std::vector<std::string> font_filenames;
+    bool         fit = false;
+    int          fit_width = 0;
+    int          fit_height = 0;
+    bool         border_set = false;
+
+    // Result, set by the generator thread
+    std::mutex   mutex;
+    std::condition_variable done_cv;
+    bool         done = false;
+    std::string  error;
+    std::string  atlas_json;
+    int          height = 0;
+    int          glyph_count = 0;
+    std::vector<std::vector<uint8_t>> pages;
+
+    void finish( const std::string &error );
+};
+
+struct AtlasServer {
+    SdfGenerator *generator = nullptr;
+    std::string  socket_path;
+    int          listen_fd = -1;
+    size_t       max_request_size = 1 << 20;  // A job object with its 'text', not a corpus dump
+
+    std::atomic<bool>   stopping;
+    std::atomic<size_t> served;
+    std::atomic<size_t> failed;
+
+    std::mutex   mutex;
+    std::condition_variable pending_cv;
+    std::deque<std::shared_ptr<ServerRequest>> pending;
+    std::set<int> connections;
+    std::condition_variable connections_cv;
+
+    AtlasServer() : stopping( false ), served( 0 ), failed( 0 ) {}
+
+    // Binds and listens on the socket path, replacing a stale socket file
+    bool init( SdfGenerator &generator, const std::string &socket_path, std::string &error );
+
+    // Accepts the connections and serves the requests until stop(),
+    // the generation runs on the calling thread owning the GL context
+    void run();
+
+    // Can be called from a signal handler
+    void stop() {
+        stopping = true;
+    }
+
+    void accept_loop();
+    void serve_connection( int fd );
+
+    // Parses the request JSON into the options, no fonts are loaded
+    bool parse_request( const std::string &text, ServerRequest &request, std::string &error );
+
+    // Generates the requests in one pipeline, the ones left unfinished by a failure are retried alone
+    void generate( const std::vector<std::shared_ptr<ServerRequest>> &requests );
+};
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "sdf_gl.h"
+#include "slot_atlas.h"
+#include "sdf_generator.h"
+#include "glyph_painter.h"
+#include "ttf_writer.h"
+
+// Atlas checks on a font made of boxes: narrow glyphs 'a'..'z', 'A'..'Z' and
+// a wide glyph '_' as wide as the font, so only the widest size class fits it.
+// Skipped without a GL context.
+
+static int failures = 0;
+
+static void check( bool condition, const std::string &what ) {
+    if ( !condition ) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static TtfGlyph box_glyph( int16_t width ) {
+    TtfGlyph g;
+    g.contours.push_back( {
+        { 0, 0, true }, { 0, 700, true }, { width, 700, true }, { width, 0, true }
+    } );
+    g.advance = width + 50;
+    return g;
+}
+
+static bool box_font( Font &font, std::vector<uint8_t> &ttf ) {
+    TtfFont tf;
+    tf.glyphs.push_back( TtfGlyph() );
+
+    for ( uint32_t cp = 'A'; cp <= 'Z'; ++cp ) {
+        tf.cmap.push_back( { cp, (uint16_t) tf.glyphs.size() } );
+        tf.glyphs.push_back( box_glyph( 100 ) );
+    }
+
+    tf.cmap.push_back( { '_', (uint16_t) tf.glyphs.size() } );
+    tf.glyphs.push_back( box_glyph( 1000 ) );
+
+    for ( uint32_t cp = 'a'; cp <= 'z'; ++cp ) {
+        tf.cmap.push_back( { cp, (uint16_t) tf.glyphs.size() } );
+        tf.glyphs.push_back( box_glyph( 100 ) );
+    }
+
+    std::string error;
+    return tf.write( ttf, error ) && font.load_ttf_mem( ttf.data() );
+}
+
+// Narrow glyphs take all the rows, then the wide glyph re-slices the least recently used row
+
+static void test_reslice( SdfGl &sdf_gl, const Font &font ) {
+    SlotAtlas sa;
+    std::vector<const Font*> fonts { &font };
+
+    // Two rows of the narrow class slots
+
+    bool ok = sa.init( sdf_gl, fonts, 256, 80, 32, 4, 2 );
+    check( ok && sa.slot_height * 2 == 80, "two row atlas init" );
+    if ( !ok ) return;
+
+    int narrow_slots = 256 / sa.class_widths[ 1 ] * 2;
+
+    std::vector<uint32_t> narrow;
+    for ( uint32_t cp = 'a'; cp <= 'z' && (int) narrow.size() < narrow_slots; ++cp ) narrow.push_back( cp );
+    for ( uint32_t cp = 'A'; cp <= 'Z' && (int) narrow.size() < narrow_slots; ++cp ) narrow.push_back( cp );
+    check( (int) narrow.size() == narrow_slots, "enough narrow glyphs to fill the atlas" );
+
+    std::vector<DirtyRect> dirty;
+    std::vector<uint32_t>  evicted;
+
+    check( sa.request( narrow, dirty, evicted ), "narrow glyphs resident" );
+    check( evicted.empty(), "nothing evicted while filling" );
+    check( sa.next_row == 2, "narrow glyphs take both rows" );
+
+    // The second row is used later, so the first one is the least recently used
+
+    std::vector<uint32_t> second_row( narrow.begin() + narrow_slots / 2, narrow.end() );
+    sa.request( second_row, dirty, evicted );
+
+    dirty.clear();
+    check( sa.request( { '_' }, dirty, evicted ), "wide glyph resident after the narrow ones" );
+
+    const GlyphRect *wide = sa.find( '_' );
+    check( wide != nullptr, "wide glyph found" );
+    if ( !wide ) return;
+
+    check( (int) wide->y0 == 0, "wide glyph in the least recently used row" );
+    check( (int) evicted.size() == narrow_slots / 2, "first row glyphs evicted" );
+
+    for ( uint32_t cp : evicted ) check( sa.find( cp ) == nullptr, "evicted glyph not resident" );
+    for ( uint32_t cp : second_row ) check( sa.find( cp ) != nullptr, "second row glyph still resident" );
+
+    check( dirty.size() == 1 && dirty[0].w == sa.class_widths[0], "wide slot rendered" );
+
+    if ( dirty.size() == 1 ) {
+        std::vector<uint8_t> pixels( dirty[0].w * dirty[0].h );
+        sa.read_rect( dirty[0], pixels.data() );
+        int max_value = 0;
+        for ( uint8_t p : pixels ) max_value = std::max<int>( max_value, p );
+        check( max_value > 128, "wide glyph drawn into the slot" );
+    }
+
+    // Narrow glyphs come back into the free slots of the re-sliced row or the second row
+
+    evicted.clear();
+    check( sa.request( { 'a' }, dirty, evicted ), "evicted narrow glyph resident again" );
+    check( sa.find( '_' ) != nullptr, "wide glyph stays resident" );
+
+    // A row used in the same request is not re-sliced
+
+    SlotAtlas busy;
+    busy.init( sdf_gl, fonts, 256, 80, 32, 4, 2 );
+    std::vector<uint32_t> all = narrow;
+    all.push_back( '_' );
+    evicted.clear();
+    check( !busy.request( all, dirty, evicted ), "no slot for the wide glyph while all rows are in use" );
+    check( evicted.empty() && busy.find( '_' ) == nullptr, "rows in use not evicted" );
+
+    busy.destroy();
+    sa.destroy();
+}
+
+struct MemorySink : AtlasSink {
+    int pages = 0;
+    int height = 0;
+
+    bool page( const AtlasOptions&, const SdfAtlas&, int, std::vector<uint8_t>& ) override {
+        pages++;
+        return true;
+    }
+
+    bool atlas( const AtlasOptions&, const SdfAtlas&, int height ) override {
+        this->height = height;
+        return true;
+    }
+};
+
+// Ranges without glyphs give an empty page one row high, in every mode and packer
+
+static void test_empty_atlas( const Font &font ) {
+    SdfGenerator generator;
+    check( generator.init(), "generator init" );
+
+    for ( SdfMode mode : { SdfMode::Stencil, SdfMode::GlyphQuad } ) {
+        for ( PackerType packer : { PackerType::Shelf, PackerType::Skyline, PackerType::MaxRects } ) {
+            AtlasOptions options;
+            options.fonts = { &font };
+            options.width = 256;
+            options.row_height = 32;
+            options.border_size = 4;
+            options.sdf_mode = mode;
+            options.packer_type = packer;
+            options.unicode_ranges = { { 0x0, 0x1f }, { 0x7f, 0x9f } };
+
+            MemorySink sink;
+            bool ok = generator.generate( { options }, sink );
+            check( ok, "empty atlas generated: " + generator.error );
+            check( sink.pages == 1 && sink.height == 32 + 4 * 2, "empty atlas is one row high" );
+        }
+    }
+
+    generator.destroy();
+}
+
+// Tessellation cache keeps the recently used glyphs when full
+
+static void test_tessellation_cache( const Font &font ) {
+    TessellationCache cache;
+    cache.max_glyphs = 2;
+
+    int a = font.glyph_idx( 'a' ), b = font.glyph_idx( 'b' ), c = font.glyph_idx( 'c' );
+
+    cache.get( &font, a, false );
+    cache.get( &font, b, false );
+    cache.get( &font, a, false );
+    cache.get( &font, c, false );
+    check( cache.hits == 1 && cache.misses == 3 && cache.glyphs.size() == 2, "full cache keeps its size" );
+
+    cache.get( &font, a, false );
+    check( cache.hits == 2, "recently used glyph kept" );
+
+    cache.get( &font, b, false );
+    check( cache.misses == 4, "least recently used glyph dropped" );
+}
+
+int main() {
+    Font font;
+    std::vector<uint8_t> ttf;
+    if ( !box_font( font, ttf ) ) {
+        std::cout << "Error generating the test font" << std::endl;
+        return 1;
+    }
+
+    test_tessellation_cache( font );
+
+    GLFWwindow *window = nullptr;
+    if ( glfwInit() ) {
+        glfwWindowHint( GLFW_VISIBLE, GL_FALSE );
+        window = glfwCreateWindow( 1, 1, "atlas_test", nullptr, nullptr );
+    }
+
+    if ( !window ) {
+        std::cout << "GL atlas tests skipped, no GL context" << std::endl;
+        return failures ? 1 : 0;
+    }
+
+    glfwMakeContextCurrent( window );
+
+    if ( glewInit() != GLEW_OK ) {
+        std::cout << "GLEW init error" << std::endl;
+        return 1;
+    }
+
+    SdfGl sdf_gl;
+    sdf_gl.init();
+
+    test_reslice( sdf_gl, font );
+    test_empty_atlas( font );
+
+    glfwDestroyWindow( window );
+    glfwTerminate();
+
+    std::cout << ( failures ? "Atlas tests failed" : "Atlas tests passed" ) << std::endl;
+    return failures ? 1 : 0;
+}
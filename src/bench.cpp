@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "args_parser.h"
+#include "sdf_generator.h"
+#include "ttf_writer.h"
+
+// Benchmarks of the pipeline stages, on a generated font unless one is given.
+// Results are printed as a table and written as JSON for tracking the regressions.
+
+std::string help = R"(Benchmarks of the atlas generation stages.
+Usage: sdf_bench [options]
+Options:
+    -h              this help
+    -f 'filename'   TTF font file instead of the generated font
+    -g 'count'      generated font simple glyph count, default 2000, plus 10% composites
+    -b 'filter'     runs only the benchmarks with names containing the filter
+    -t 'seconds'    minimum time per benchmark, default 0.25
+    -o 'filename'   JSON results file
+)";
+
+ArgsParser   args;
+std::string  font_filename;
+std::string  json_filename;
+std::string  filter;
+int          glyph_count = 2000;
+double       min_time = 0.25;
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchResult {
+    std::string name;
+    size_t      iterations = 0;
+    double      min_ms = 0.0;
+    double      median_ms = 0.0;
+    double      mean_ms = 0.0;
+    double      items = 0.0;        // Items processed per iteration: glyphs, bytes, pixels
+    std::string unit;
+};
+
+std::vector<BenchResult> results;
+
+// Runs 'run' until min_time passes and at least 3 times, 'setup' before each run isn't timed
+
+template <class Setup, class Run>
+void bench( const std::string &name, double items, const char *unit, Setup setup, Run run ) {
+    if ( name.find( filter ) == std::string::npos ) return;
+
+    std::vector<double> times;
+    double total = 0.0;
+
+    while ( times.size() < 3 || total < min_time ) {
+        setup();
+        Clock::time_point t0 = Clock::now();
+        run();
+        double t = std::chrono::duration<double>( Clock::now() - t0 ).count();
+        times.push_back( t );
+        total += t;
+    }
+
+    std::sort( times.begin(), times.end() );
+
+    BenchResult br;
+    br.name = name;
+    br.iterations = times.size();
+    br.min_ms = times.front() * 1000.0;
+    br.median_ms = times[ times.size() / 2 ] * 1000.0;
+    br.mean_ms = total / times.size() * 1000.0;
+    br.items = items;
+    br.unit = unit;
+    results.push_back( br );
+
+    std::cout << std::left << std::setw( 32 ) << name << std::right
+              << std::setw( 8 ) << br.iterations
+              << std::setw( 12 ) << std::fixed << std::setprecision( 3 ) << br.min_ms
+              << std::setw( 12 ) << br.median_ms
+              << std::setw( 14 ) << std::setprecision( 0 ) << items / ( br.median_ms * 0.001 ) << " " << unit << "/s" << std::endl;
+}
+
+template <class Run>
+void bench( const std::string &name, double items, const char *unit, Run run ) {
+    bench( name, items, unit, [](){}, run );
+}
+
+bool write_json( const std::string &filename, const std::string &font_name ) {
+    std::ofstream json( filename );
+    if ( !json ) return false;
+
+    json << "{\n";
+    json << "    \"font\": \"" << font_name << "\",\n";
+    json << "    \"min_time\": " << min_time << ",\n";
+    json << "    \"results\": [\n";
+
+    for ( size_t ir = 0; ir < results.size(); ++ir ) {
+        const BenchResult &br = results[ ir ];
+        json << std::setprecision( 6 ) << std::defaultfloat;
+        json << "        { \"name\": \"" << br.name << "\", \"iterations\": " << br.iterations
+             << ", \"min_ms\": " << br.min_ms << ", \"median_ms\": " << br.median_ms << ", \"mean_ms\": " << br.mean_ms
+             << ", \"items\": " << br.items << ", \"unit\": \"" << br.unit << "\", \"items_per_s\": "
+             << br.items / ( br.median_ms * 0.001 ) << " }" << ( ir + 1 < results.size() ? "," : "" ) << "\n";
+    }
+
+    json << "    ]\n}\n";
+    return (bool) json;
+}
+
+// Font parsing stages
+
+void bench_font( const std::vector<uint8_t> &ttf, const Font &font ) {
+    double glyphs = font.glyphs.size();
+
+    bench( "font/load_ttf_mem", glyphs, "glyphs", [&]() {
+        Font f;
+        f.load_ttf_mem( ttf.data() );
+    } );
+
+    bench( "font/fill_cmap", font.glyph_map.size(), "codepoints", [&]() {
+        Font f;
+        fill_cmap( f, ttf.data() );
+    } );
+
+    // Simple glyphs only, composites are made of them
+
+    std::vector<const uint8_t*> locations;
+    for ( size_t ig = 0; ig < font.glyphs.size(); ++ig ) {
+        const uint8_t *loc = glyph_location( ttf.data(), ig );
+        if ( loc && !font.glyphs[ ig ].is_composite ) locations.push_back( loc );
+    }
+
+    std::vector<GlyphCommand> commands;
+    float scale = 1.0f / font.em_ascent;
+
+    bench( "font/glyph_shape_simple", locations.size(), "glyphs", [&]() {
+        commands.clear();
+    }, [&]() {
+        Glyph g;
+        for ( const uint8_t *loc : locations ) glyph_shape_simple( g, commands, loc, scale );
+    } );
+}
+
+// Allocation and packing
+
+void bench_atlas( const std::vector<const Font*> &fonts, double glyphs ) {
+    SdfAtlas atlas;
+
+    bench( "atlas/allocate", glyphs, "glyphs", [&]() {
+        atlas.init( fonts, 2048, 48, 8 );
+        atlas.allocate_all_glyphs();
+    } );
+
+    const char *packer_names[] = { "shelf", "skyline", "maxrects" };
+    PackerType  packers[] = { PackerType::Shelf, PackerType::Skyline, PackerType::MaxRects };
+
+    for ( int ip = 0; ip < 3; ++ip ) {
+        SdfAtlas allocated;
+        allocated.init( fonts, 2048, 48, 8, packers[ ip ] );
+        allocated.allocate_all_glyphs();
+
+        bench( std::string( "atlas/pack_" ) + packer_names[ ip ], glyphs, "glyphs", [&]() {
+            atlas = allocated;
+        }, [&]() {
+            atlas.pack( 2048 );
+        } );
+    }
+}
+
+// Tessellation and vertex emitting
+
+void bench_tessellation( const SdfAtlas &atlas ) {
+    double glyphs = std::count_if( atlas.glyph_rects.begin(), atlas.glyph_rects.end(), []( const GlyphRect &gr ) {
+        return gr.source == -1 && gr.page == 0;
+    } );
+
+    GlyphPainter gp;
+
+    bench( "tessellate/stencil", glyphs, "glyphs", [&]() {
+        gp.clear();
+    }, [&]() {
+        atlas.draw_glyphs( gp, 0 );
+    } );
+
+    gp.mode = SdfMode::GlyphQuad;
+
+    bench( "tessellate/segments", glyphs, "glyphs", [&]() {
+        gp.clear();
+    }, [&]() {
+        atlas.draw_glyphs( gp, 0 );
+    } );
+
+    TessellationCache cache;
+    gp.cache = &cache;
+    gp.mode = SdfMode::Stencil;
+    atlas.draw_glyphs( gp, 0 );
+
+    bench( "tessellate/stencil_cached", glyphs, "glyphs", [&]() {
+        gp.clear();
+    }, [&]() {
+        atlas.draw_glyphs( gp, 0 );
+    } );
+
+    int threads = std::max( 2u, std::thread::hardware_concurrency() );
+
+    bench( "tessellate/stencil_cached_mt", glyphs, "glyphs", [&]() {
+        gp.clear();
+    }, [&]() {
+        atlas.draw_glyphs( gp, 0, nullptr, threads );
+    } );
+}
+
+// Distance rendering of a page by the GL modes, including the readback
+
+void bench_gl( SdfGenerator &gen, const SdfAtlas &atlas, int width, int height ) {
+    const char *mode_names[] = { "stencil", "quad", "compute" };
+    SdfMode     modes[] = { SdfMode::Stencil, SdfMode::GlyphQuad, SdfMode::Compute };
+
+    std::vector<uint8_t> pixels( width * height );
+
+    for ( int im = 0; im < 3; ++im ) {
+        if ( modes[ im ] == SdfMode::Compute && !gen.sdf_gl.compute_supported ) {
+            std::cout << "gl/compute skipped, requires OpenGL 4.3" << std::endl;
+            continue;
+        }
+
+        GlyphPainter gp;
+        gp.mode = modes[ im ];
+        gp.cache = &gen.tessellation_cache;
+        atlas.draw_glyphs( gp, 0 );
+
+        bench( std::string( "gl/" ) + mode_names[ im ], (double) width * height, "pixels", [&]() {
+            gen.render( modes[ im ], atlas, gp, 0, width, height, pixels.data() );
+        } );
+    }
+}
+
+// Output stages
+
+void bench_output( const SdfAtlas &atlas, int width, int height ) {
+    std::vector<uint8_t> page( width * height ), pixels, png;
+    for ( size_t ip = 0; ip < page.size(); ++ip ) {
+        int x = ip % width, y = ip / width;
+        page[ ip ] = 128 + 127 * sinf( x * 0.05f ) * cosf( y * 0.07f );
+    }
+
+    bench( "output/encode_png", page.size(), "pixels", [&]() {
+        pixels = page;
+    }, [&]() {
+        SdfGenerator::encode_png( pixels.data(), width, height, png );
+    } );
+
+    bench( "output/json", atlas.glyph_rects.size(), "glyphs", [&]() {
+        std::string json = atlas.json( height );
+    } );
+}
+
+// Whole generation of a multi page atlas, the sink drops the pages
+
+struct NullSink : AtlasSink {
+    size_t bytes = 0;
+
+    bool page( const AtlasOptions&, const SdfAtlas&, int, std::vector<uint8_t> &png ) override {
+        bytes += png.size();
+        return true;
+    }
+
+    bool atlas( const AtlasOptions&, const SdfAtlas&, int ) override {
+        return true;
+    }
+};
+
+void bench_end_to_end( SdfGenerator &gen, const std::vector<const Font*> &fonts, double glyphs ) {
+    const char *mode_names[] = { "stencil", "quad" };
+    SdfMode     modes[] = { SdfMode::Stencil, SdfMode::GlyphQuad };
+
+    UnicodeRange range { 0xffffffff, 0 };
+    for ( const std::pair<const uint32_t, int> &cg : fonts[0]->glyph_map ) {
+        range.start = std::min( range.start, cg.first );
+        range.end = std::max( range.end, cg.first );
+    }
+
+    for ( int im = 0; im < 2; ++im ) {
+        AtlasOptions options;
+        options.fonts = fonts;
+        options.unicode_ranges.push_back( range );
+        options.width = 1024;
+        options.tex_height = 1024;
+        options.row_height = 32;
+        options.border_size = 6;
+        options.sdf_mode = modes[ im ];
+
+        NullSink sink;
+        bench( std::string( "e2e/generate_" ) + mode_names[ im ], glyphs, "glyphs", [&]() {
+            if ( !gen.generate( { options }, sink ) ) std::cerr << gen.error << std::endl;
+        } );
+    }
+}
+
+void read_font( ArgsParser *ap ) {
+    font_filename = ap->word();
+}
+
+void read_glyph_count( ArgsParser *ap ) {
+    glyph_count = strtol( ap->word().c_str(), nullptr, 0 );
+    if ( glyph_count <= 0 || glyph_count > 59000 ) {
+        std::cerr << "Glyph count should be from 1 to 59000." << std::endl;
+        exit( 1 );
+    }
+}
+
+void read_filter( ArgsParser *ap ) {
+    filter = ap->word();
+}
+
+void read_min_time( ArgsParser *ap ) {
+    min_time = strtod( ap->word().c_str(), nullptr );
+    if ( min_time < 0.0 ) {
+        std::cerr << "Error reading minimum time." << std::endl;
+        exit( 1 );
+    }
+}
+
+void read_json( ArgsParser *ap ) {
+    json_filename = ap->word();
+}
+
+void show_help( ArgsParser* ) {
+    std::cout << help;
+    exit( 0 );
+}
+
+int main( int argc, char* argv[] ) {
+    args.commands["-h"] = show_help;
+    args.commands["-f"] = read_font;
+    args.commands["-g"] = read_glyph_count;
+    args.commands["-b"] = read_filter;
+    args.commands["-t"] = read_min_time;
+    args.commands["-o"] = read_json;
+    args.run( argc, argv );
+
+    // Input font, generated in memory by default
+
+    std::vector<uint8_t> ttf;
+    std::string font_name;
+
+    if ( font_filename.empty() ) {
+        SynthFontOptions synth;
+        synth.glyph_count = glyph_count;
+        synth.composite_count = glyph_count / 10;
+        synth.composite_depth = 2;
+        synth.kern_pairs = std::min( glyph_count * 4, 0xffff );
+
+        TtfFont tf;
+        std::string error;
+        if ( !synth_font( synth, tf, error ) || !tf.write( ttf, error ) ) {
+            std::cerr << "Can't generate the font: " << error << std::endl;
+            exit( 1 );
+        }
+        font_name = "generated, " + std::to_string( glyph_count ) + " simple, " + std::to_string( synth.composite_count ) +
+                    " composite glyphs, " + std::to_string( synth.kern_pairs ) + " kerning pairs";
+    } else {
+        std::ifstream in( font_filename, std::ios::binary );
+        ttf.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+        font_name = font_filename;
+    }
+
+    Font font;
+    if ( !font.load_ttf_mem( ttf.data() ) ) {
+        std::cerr << "Error loading the font" << std::endl;
+        exit( 1 );
+    }
+
+    std::vector<const Font*> fonts { &font };
+
+    SdfAtlas atlas;
+    atlas.init( fonts, 1024, 48, 8 );
+    atlas.allocate_all_glyphs();
+    atlas.pack( 1024 );
+    double glyphs = atlas.glyph_rects.size();
+
+    std::cout << "Font: " << font_name << ", " << atlas.glyph_rects.size() << " glyph rects, " << atlas.page_count << " pages" << std::endl;
+    std::cout << std::left << std::setw( 32 ) << "benchmark" << std::right << std::setw( 8 ) << "runs"
+              << std::setw( 12 ) << "min ms" << std::setw( 12 ) << "median ms" << std::setw( 14 ) << "throughput" << std::endl;
+
+    bench_font( ttf, font );
+    bench_atlas( fonts, font.glyphs.size() );
+    bench_tessellation( atlas );
+    bench_output( atlas, 1024, 1024 );
+
+    // GL stages, skipped without a GL context
+
+    GLFWwindow *window = nullptr;
+    if ( glfwInit() ) {
+        glfwWindowHint( GLFW_VISIBLE, GL_FALSE );
+        window = glfwCreateWindow( 1, 1, "sdf_bench", nullptr, nullptr );
+    }
+
+    if ( window ) {
+        glfwMakeContextCurrent( window );
+        SdfGenerator gen;
+
+        if ( glewInit() == GLEW_OK && gen.init() ) {
+            bench_gl( gen, atlas, 1024, 1024 );
+            bench_end_to_end( gen, fonts, glyphs );
+        } else {
+            std::cout << "GL benchmarks skipped, error creating the shader programs" << std::endl;
+        }
+
+        gen.destroy();
+        glfwDestroyWindow( window );
+        glfwTerminate();
+    } else {
+        std::cout << "GL benchmarks skipped, no GL context" << std::endl;
+    }
+
+    if ( !json_filename.empty() && !write_json( json_filename, font_name ) ) {
+        std::cerr << "Error writing '" << json_filename << "'" << std::endl;
+        exit( 1 );
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Queue between the pipeline stages. push() blocks while the queue is full,
+// so the memory held by the queued items is bounded by the capacity.
+// pop() blocks while the queue is empty and returns false once it's closed and drained.
+
+template <typename T>
+struct BoundedQueue {
+    size_t capacity = 2;
+
+    std::deque<T>           items;
+    std::mutex              mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    bool                    closed = false;
+
+    explicit BoundedQueue( size_t capacity ) : capacity( capacity ) {}
+
+    void push( T &&item ) {
+        std::unique_lock<std::mutex> lock( mutex );
+        not_full.wait( lock, [this] { return items.size() < capacity; } );
+        items.push_back( std::move( item ) );
+        not_empty.notify_one();
+    }
+
+    bool pop( T &item ) {
+        std::unique_lock<std::mutex> lock( mutex );
+        not_empty.wait( lock, [this] { return !items.empty() || closed; } );
+        if ( items.empty() ) return false;
+        item = std::move( items.front() );
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    // No more items, pop() returns false after the queued ones
+    void close() {
+        std::lock_guard<std::mutex> lock( mutex );
+        closed = true;
+        not_empty.notify_all();
+    }
+};
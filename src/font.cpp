@@ -21,7 +21,9 @@
  */
 
 #include "font.h"
+#include "hash.h"
 #include <cassert>
+#include <chrono>
 #include <cwctype>
 #include <iostream>
 
@@ -54,7 +56,7 @@ inline bool is_font( const uint8_t *ttf ) {
 }
 
 
-static const uint8_t* find_table( const uint8_t *ttf, const char *tag ) {
+const uint8_t* find_table( const uint8_t *ttf, const char *tag ) {
     uint32_t num_tables = ttf_u16( ttf + 4 );
     const uint8_t *table = ttf + 12;
 
@@ -73,7 +75,7 @@ static const uint8_t* find_table( const uint8_t *ttf, const char *tag ) {
 
 // Reading mappings from codepoint to glyph index
 
-static bool fill_cmap( Font& font, const uint8_t *ttf ) {
+bool fill_cmap( Font& font, const uint8_t *ttf ) {
     const uint8_t *cmap = find_table( ttf, "cmap" );
     if ( !cmap ) return false;
 
@@ -216,10 +218,21 @@ inline int glyph_loc_offset( int glyph_idx, bool is_loc32, const uint8_t *loca )
 }
 
 
+const uint8_t* glyph_location( const uint8_t *ttf, int glyph_idx ) {
+    const uint8_t *head = find_table( ttf, "head" );
+    const uint8_t *loca = find_table( ttf, "loca" );
+    const uint8_t *glyf = find_table( ttf, "glyf" );
+    if ( !head || !loca || !glyf ) return nullptr;
+
+    int glyph_offset = glyph_loc_offset( glyph_idx, ttf_u16( head + 50 ) == 1, loca );
+    return glyph_offset < 0 ? nullptr : glyf + glyph_offset;
+}
+
+
 
 // Display list for simple (non composite) glyph
 
-static void glyph_shape_simple( Glyph& glyph, std::vector<GlyphCommand>& commands, const uint8_t *glyph_loc, float scale ) {
+void glyph_shape_simple( Glyph& glyph, std::vector<GlyphCommand>& commands, const uint8_t *glyph_loc, float scale ) {
     int num_contours = ttf_i16( glyph_loc );
 
     if ( num_contours < 0 ) return;
@@ -589,6 +602,7 @@ static bool fill_kern( Font& font, const uint8_t *ttf, float scale ) {
     return true;
 }
 
+
 bool Font::load_ttf_file( const char *filename ) {
     FILE *f = fopen( filename, "rb" );
     if ( !f ) return false;
@@ -602,6 +616,7 @@ bool Font::load_ttf_file( const char *filename ) {
     fclose( f );
 
     bool res = load_ttf_mem( ttf );
+    data_hash = hash_bytes( hash_seed, ttf, fsize );
     free( ttf );
     return res;
 }
@@ -648,9 +663,14 @@ bool Font::load_ttf_mem( const uint8_t *ttf ) {
     descent  = em_descent * scale;
     line_gap = em_line_gap * scale;
 
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point cmap_start = Clock::now();
+
     // Filling glyph idx mappings
     if ( !fill_cmap( *this, ttf ) ) return false;
 
+    cmap_time = std::chrono::duration<double>( Clock::now() - cmap_start ).count();
+
     glyphs = std::vector<Glyph>( num_glyphs, Glyph{} );
 
     // These glyphs have both advance with and left side bearing in "hmtx" table
@@ -670,6 +690,8 @@ bool Font::load_ttf_mem( const uint8_t *ttf ) {
     glyph_min = F2 { 2e38f };
     glyph_max = F2 { -2e38f };
 
+    Clock::time_point outline_start = Clock::now();
+
     // Reading simple glyph display listd and components for composite glyphs
     for ( size_t iglyph = 0; iglyph < num_glyphs; ++iglyph ) {
         glyph_shape( *this, iglyph, is_loc32, loca, glyf, scale );
@@ -682,6 +704,8 @@ bool Font::load_ttf_mem( const uint8_t *ttf ) {
         glyph_commands_composite( *this, iglyph );
     }
 
+    outline_time = std::chrono::duration<double>( Clock::now() - outline_start ).count();
+
     // Reading glyph types
     for ( std::pair<uint32_t, int> cgpair : glyph_map ) {
         uint32_t codepoint = cgpair.first;
@@ -701,7 +725,7 @@ bool Font::load_ttf_mem( const uint8_t *ttf ) {
             std::vector<uint32_t> v { cgpair.first };
             cp_map.insert( { cgpair.second, std::move( v ) } );
         } else {
-            it->second.push_back( cgpair.second );
+            it->second.push_back( cgpair.first );
         }        
     }    
 
@@ -712,3 +736,40 @@ bool Font::load_ttf_mem( const uint8_t *ttf ) {
         
     return true;    
 }
+
+
+uint64_t Font::outline_hash( int glyph_idx ) const {
+    const Glyph &g = glyphs[ glyph_idx ];
+    F2 shift = F2( g.left_side_bearing, 0.0f );
+
+    uint64_t h = hash_seed;
+    for ( int ic = g.command_start; ic < g.command_start + g.command_count; ++ic ) {
+        const GlyphCommand &gc = glyph_commands[ ic ];
+        F2 pts[ 2 ] = { gc.p0 - shift, gc.p1 - shift };
+        int type = gc.type;
+        h = hash_bytes( h, &type, sizeof( type ) );
+        h = hash_bytes( h, pts, sizeof( pts ) );
+    }
+
+    return h;
+}
+
+bool Font::same_outline( int glyph_idx1, int glyph_idx2 ) const {
+    const Glyph &g1 = glyphs[ glyph_idx1 ];
+    const Glyph &g2 = glyphs[ glyph_idx2 ];
+    if ( g1.command_count != g2.command_count ) return false;
+
+    F2 shift1 = F2( g1.left_side_bearing, 0.0f );
+    F2 shift2 = F2( g2.left_side_bearing, 0.0f );
+
+    for ( int ic = 0; ic < g1.command_count; ++ic ) {
+        const GlyphCommand &gc1 = glyph_commands[ g1.command_start + ic ];
+        const GlyphCommand &gc2 = glyph_commands[ g2.command_start + ic ];
+        if ( gc1.type != gc2.type ) return false;
+        F2 d0 = ( gc1.p0 - shift1 ) - ( gc2.p0 - shift2 );
+        F2 d1 = ( gc1.p1 - shift1 ) - ( gc2.p1 - shift2 );
+        if ( d0.x != 0.0f || d0.y != 0.0f || d1.x != 0.0f || d1.y != 0.0f ) return false;
+    }
+
+    return true;
+}
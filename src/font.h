@@ -94,6 +94,13 @@ struct Font {
     // Glyph maximum bounding box
     F2    glyph_min, glyph_max;
 
+    // Hash of the font file contents, 0 if loaded from memory
+    uint64_t data_hash = 0;
+
+    // Parsing times of the last load in seconds: cmap, simple and composite glyph outlines
+    double cmap_time = 0.0;
+    double outline_time = 0.0;
+
     bool load_ttf_file( const char *filename );
 
     bool load_ttf_mem( const uint8_t *ttf );
@@ -104,5 +111,27 @@ struct Font {
         return iter == glyph_map.end() ? -1 : iter->second;
     }
 
-    int kern_advance( uint32_t cp1, uint32_t cp2 );
+    int kern_advance( uint32_t cp1, uint32_t cp2 ) const;
+
+    // Hash of the glyph commands with x shifted by the left side bearing,
+    // glyphs with the same outline are rendered the same
+    uint64_t outline_hash( int glyph_idx ) const;
+
+    // Compares glyph commands with x shifted by the left side bearings
+    bool same_outline( int glyph_idx1, int glyph_idx2 ) const;
 };
+
+
+// Parsing stages of Font::load_ttf_mem(), exposed for the benchmarks
+
+// Table data by tag, nullptr if there is no such table
+const uint8_t* find_table( const uint8_t *ttf, const char *tag );
+
+// Reads the codepoint to glyph index mappings into font.glyph_map
+bool fill_cmap( Font& font, const uint8_t *ttf );
+
+// Glyph data in the 'glyf' table, nullptr for the empty glyphs
+const uint8_t* glyph_location( const uint8_t *ttf, int glyph_idx );
+
+// Appends the display list of a simple glyph, scale is 1 / ascent in font units
+void glyph_shape_simple( Glyph& glyph, std::vector<GlyphCommand>& commands, const uint8_t *glyph_loc, float scale );
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+#include "args_parser.h"
+#include "font.h"
+#include "ttf_writer.h"
+
+// Writes the generated TrueType fonts, the reproducible input of the parser and renderer benchmarks
+
+std::string help = R"(Synthetic TrueType font generator.
+Usage: sdf_fontgen -o 'filename' [options]
+Options:
+    -h              this help
+    -o 'filename'   output TTF file
+    -g 'count'      simple glyphs, default 1000
+    -c 'count'      contours per glyph, default 3
+    -p 'count'      points per contour, default 16
+    -cc 'count'     composite glyphs, default 0
+    -cd 'depth'     composite nesting depth, default 1
+    -cn 'count'     components per composite glyph, default 2
+    -cf 'format'    cmap format: 0, 4, 6, 10, 12 or 13, default 4
+    -cp 'codepoint' first codepoint, default 0x4E00
+    -sh             shuffled glyph order in cmap
+    -k 'count'      kerning pairs, default 0
+    -hm 'count'     glyphs with own advance in 'hmtx', default all
+    -ll             long 'loca' offsets
+    -s 'seed'       random seed, default 1
+    -v              reads the written font back and prints what was parsed
+)";
+
+ArgsParser       args;
+SynthFontOptions options;
+std::string      ttf_filename;
+bool             verify = false;
+
+int read_int( ArgsParser *ap, const char *name, int min, int max ) {
+    std::string word = ap->word();
+    char *end = nullptr;
+    long value = strtol( word.c_str(), &end, 0 );
+    if ( word.empty() || *end || value < min || value > max ) {
+        std::cerr << "Error reading " << name << ", should be from " << min << " to " << max << "." << std::endl;
+        exit( 1 );
+    }
+    return value;
+}
+
+void read_output( ArgsParser *ap ) {
+    ttf_filename = ap->word();
+}
+
+void read_glyph_count( ArgsParser *ap ) {
+    options.glyph_count = read_int( ap, "glyph count", 1, 65534 );
+}
+
+void read_contours( ArgsParser *ap ) {
+    options.contours = read_int( ap, "contour count", 1, 0x7fff );
+}
+
+void read_points( ArgsParser *ap ) {
+    options.points = read_int( ap, "point count", 3, 0xffff );
+}
+
+void read_composite_count( ArgsParser *ap ) {
+    options.composite_count = read_int( ap, "composite count", 0, 65534 );
+}
+
+void read_composite_depth( ArgsParser *ap ) {
+    options.composite_depth = read_int( ap, "composite depth", 1, 64 );
+}
+
+void read_components( ArgsParser *ap ) {
+    options.components = read_int( ap, "component count", 1, 256 );
+}
+
+void read_cmap_format( ArgsParser *ap ) {
+    options.cmap_format = read_int( ap, "cmap format", 0, 13 );
+}
+
+void read_first_codepoint( ArgsParser *ap ) {
+    options.first_codepoint = read_int( ap, "first codepoint", 0, 0x10ffff );
+}
+
+void read_shuffle( ArgsParser* ) {
+    options.shuffle_cmap = true;
+}
+
+void read_kern_pairs( ArgsParser *ap ) {
+    options.kern_pairs = read_int( ap, "kerning pair count", 0, 0xffff );
+}
+
+void read_hmetrics( ArgsParser *ap ) {
+    options.hmetrics = read_int( ap, "metrics count", 1, 0xffff );
+}
+
+void read_long_loca( ArgsParser* ) {
+    options.long_loca = true;
+}
+
+void read_seed( ArgsParser *ap ) {
+    options.seed = strtoul( ap->word().c_str(), nullptr, 0 );
+}
+
+void read_verify( ArgsParser* ) {
+    verify = true;
+}
+
+void show_help( ArgsParser* ) {
+    std::cout << help;
+    exit( 0 );
+}
+
+int main( int argc, char* argv[] ) {
+    args.commands["-h"] = show_help;
+    args.commands["-o"] = read_output;
+    args.commands["-g"] = read_glyph_count;
+    args.commands["-c"] = read_contours;
+    args.commands["-p"] = read_points;
+    args.commands["-cc"] = read_composite_count;
+    args.commands["-cd"] = read_composite_depth;
+    args.commands["-cn"] = read_components;
+    args.commands["-cf"] = read_cmap_format;
+    args.commands["-cp"] = read_first_codepoint;
+    args.commands["-sh"] = read_shuffle;
+    args.commands["-k"] = read_kern_pairs;
+    args.commands["-hm"] = read_hmetrics;
+    args.commands["-ll"] = read_long_loca;
+    args.commands["-s"] = read_seed;
+    args.commands["-v"] = read_verify;
+    args.run( argc, argv );
+
+    if ( ttf_filename.empty() ) {
+        std::cerr << "Output file is not specified." << std::endl;
+        exit( 1 );
+    }
+
+    TtfFont font;
+    std::vector<uint8_t> ttf;
+    std::string error;
+
+    if ( !synth_font( options, font, error ) || !font.write( ttf, error ) ) {
+        std::cerr << "Can't generate the font: " << error << std::endl;
+        exit( 1 );
+    }
+
+    std::ofstream out( ttf_filename, std::ios::binary );
+    out.write( (const char*) ttf.data(), ttf.size() );
+    if ( !out ) {
+        std::cerr << "Error writing " << ttf_filename << std::endl;
+        exit( 1 );
+    }
+
+    std::cout << ttf_filename << ": " << font.glyphs.size() << " glyphs, " << font.cmap.size() << " codepoints, "
+              << font.kern_pairs.size() << " kerning pairs, " << ttf.size() << " bytes" << std::endl;
+
+    if ( verify ) {
+        Font parsed;
+        if ( !parsed.load_ttf_mem( ttf.data() ) ) {
+            std::cerr << "Generated font doesn't load." << std::endl;
+            exit( 1 );
+        }
+
+        size_t composites = 0;
+        for ( const Glyph &g : parsed.glyphs ) composites += g.is_composite;
+
+        std::cout << "Parsed: " << parsed.glyphs.size() << " glyphs, " << composites << " composite, "
+                  << parsed.glyph_map.size() << " codepoints, " << parsed.kern_map.size() << " kerning pairs, "
+                  << parsed.glyph_commands.size() << " commands" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "generation_stats.h"
+
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+static const char *stage_names[] = {
+    "font_load", "cmap", "outlines", "allocation", "packing", "tessellation",
+    "render", "readback", "flip", "png_encode", "page_output", "json"
+};
+
+const char* GenerationStats::stage_name( Stage stage ) {
+    return stage_names[ (int) stage ];
+}
+
+void GenerationStats::add_time( Stage stage, double seconds ) {
+    std::lock_guard<std::mutex> lock( mutex );
+    stage_time[ (int) stage ] += seconds;
+    stage_calls[ (int) stage ]++;
+}
+
+void GenerationStats::clear() {
+    std::lock_guard<std::mutex> lock( mutex );
+
+    for ( int is = 0; is < stage_count; ++is ) {
+        stage_time[ is ] = 0.0;
+        stage_calls[ is ] = 0;
+    }
+    wall_time = 0.0;
+    atlases = pages = batches = glyphs = unique_glyphs = drawn_glyphs = cached_tiles = 0;
+    lines = curves[0] = curves[1] = curves[2] = 0;
+    fill_vertices = line_rects = segments = quad_vertices = 0;
+    fill_fragments = line_fragments = quad_fragments = 0.0;
+    glyph_area = page_area = 0.0;
+    peak_fill_arena = peak_line_arena = peak_segment_arena = peak_quad_arena = arenas = 0;
+    peak_page_pixels = peak_png = peak_tessellation_cache = font_outlines = 0;
+}
+
+// Name and value rows shared by the table and the JSON
+
+struct StatsRow {
+    const char *name;
+    double      value;
+};
+
+static void counter_rows( const GenerationStats &s, std::vector<StatsRow> &counters, std::vector<StatsRow> &memory ) {
+    counters = {
+        { "atlases", (double) s.atlases },
+        { "pages", (double) s.pages },
+        { "batches", (double) s.batches },
+        { "glyphs", (double) s.glyphs },
+        { "unique_glyphs", (double) s.unique_glyphs },
+        { "drawn_glyphs", (double) s.drawn_glyphs },
+        { "cached_tiles", (double) s.cached_tiles },
+        { "lines", (double) s.lines },
+        { "curves_parabola", (double) s.curves[0] },
+        { "curves_line", (double) s.curves[1] },
+        { "curves_two_lines", (double) s.curves[2] },
+        { "fill_vertices", (double) s.fill_vertices },
+        { "line_vertices", (double) s.line_rects * 6 },
+        { "segments", (double) s.segments },
+        { "quad_vertices", (double) s.quad_vertices },
+        { "fill_fragments", round( s.fill_fragments ) },
+        { "line_fragments", round( s.line_fragments ) },
+        { "quad_fragments", round( s.quad_fragments ) },
+        { "occupancy", s.occupancy() }
+    };
+
+    memory = {
+        { "fill_arena", (double) s.peak_fill_arena },
+        { "line_arena", (double) s.peak_line_arena },
+        { "segment_arena", (double) s.peak_segment_arena },
+        { "quad_arena", (double) s.peak_quad_arena },
+        { "arenas", (double) s.arenas },
+        { "page_pixels", (double) s.peak_page_pixels },
+        { "png", (double) s.peak_png },
+        { "tessellation_cache", (double) s.peak_tessellation_cache },
+        { "font_outlines", (double) s.font_outlines }
+    };
+}
+
+std::string GenerationStats::table() const {
+    std::vector<StatsRow> counters, memory;
+    counter_rows( *this, counters, memory );
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision( 2 );
+    ss << std::left << std::setw( 20 ) << "stage" << std::right << std::setw( 8 ) << "calls"
+       << std::setw( 12 ) << "total ms" << std::setw( 12 ) << "mean ms" << std::setw( 8 ) << "wall %" << std::endl;
+
+    for ( int is = 0; is < stage_count; ++is ) {
+        if ( stage_calls[ is ] == 0 ) continue;
+        double ms = stage_time[ is ] * 1000.0;
+        ss << std::left << std::setw( 20 ) << stage_names[ is ] << std::right << std::setw( 8 ) << stage_calls[ is ]
+           << std::setw( 12 ) << ms << std::setw( 12 ) << ms / stage_calls[ is ]
+           << std::setw( 8 ) << ( wall_time > 0.0 ? 100.0 * stage_time[ is ] / wall_time : 0.0 ) << std::endl;
+    }
+    ss << std::left << std::setw( 28 ) << "generation wall time" << std::right << std::setw( 12 ) << wall_time * 1000.0 << std::endl;
+
+    ss << std::endl << std::left << std::setw( 28 ) << "counter" << std::right << std::setw( 16 ) << "value" << std::endl;
+    for ( const StatsRow &row : counters ) {
+        ss << std::left << std::setw( 28 ) << row.name << std::right << std::setw( 16 );
+        if ( row.value == (double) (size_t) row.value ) ss << (size_t) row.value;
+        else                                             ss << std::setprecision( 4 ) << row.value << std::setprecision( 2 );
+        ss << std::endl;
+    }
+
+    ss << std::endl << std::left << std::setw( 28 ) << "memory" << std::right << std::setw( 16 ) << "peak bytes" << std::endl;
+    for ( const StatsRow &row : memory ) {
+        ss << std::left << std::setw( 28 ) << row.name << std::right << std::setw( 16 ) << (size_t) row.value << std::endl;
+    }
+
+    return ss.str();
+}
+
+std::string GenerationStats::json() const {
+    std::vector<StatsRow> counters, memory;
+    counter_rows( *this, counters, memory );
+
+    std::stringstream ss;
+    ss << std::setprecision( 10 );
+    ss << "{" << std::endl;
+    ss << "    \"wall_ms\": " << wall_time * 1000.0 << "," << std::endl;
+
+    ss << "    \"stages\": {" << std::endl;
+    bool first = true;
+    for ( int is = 0; is < stage_count; ++is ) {
+        if ( !first ) ss << "," << std::endl;
+        ss << "        \"" << stage_names[ is ] << "\": { \"calls\": " << stage_calls[ is ] << ", \"ms\": " << stage_time[ is ] * 1000.0 << " }";
+        first = false;
+    }
+    ss << std::endl << "    }," << std::endl;
+
+    auto rows = [&]( const char *name, const std::vector<StatsRow> &list, bool last ) {
+        ss << "    \"" << name << "\": {" << std::endl;
+        for ( size_t ir = 0; ir < list.size(); ++ir ) {
+            ss << "        \"" << list[ ir ].name << "\": " << list[ ir ].value << ( ir + 1 < list.size() ? "," : "" ) << std::endl;
+        }
+        ss << "    }" << ( last ? "" : "," ) << std::endl;
+    };
+
+    rows( "counters", counters, false );
+    rows( "memory", memory, true );
+    ss << "}" << std::endl;
+
+    return ss.str();
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Stage times and counters of the atlas generation, collected by SdfGenerator when its
+// 'stats' is set. The pipeline stages run concurrently, so a stage time is the time
+// spent in that stage and the stage times can add up to more than the wall time.
+// GL calls are asynchronous: 'render' is the command submission, the GPU work is
+// waited for in 'readback'.
+
+enum class Stage {
+    FontLoad,       // File reading and the rest of the font tables
+    Cmap,
+    Outlines,       // Simple and composite glyph outline decoding
+    Allocation,
+    Packing,
+    Tessellation,
+    Render,
+    Readback,
+    Flip,
+    PngEncode,
+    PageOutput,     // AtlasSink::page()
+    Json,           // AtlasSink::atlas(), the atlas JSON
+    Count
+};
+
+struct GenerationStats {
+    static const int stage_count = (int) Stage::Count;
+
+    std::mutex mutex;                   // Held by the pipeline threads while updating
+
+    double   stage_time[ stage_count ] = {};     // Seconds
+    size_t   stage_calls[ stage_count ] = {};
+    double   wall_time = 0.0;                    // generate() calls, seconds
+
+    size_t   atlases = 0;
+    size_t   pages = 0;
+    size_t   batches = 0;
+    size_t   glyphs = 0;                // Allocated glyph rects
+    size_t   unique_glyphs = 0;         // Rects with own pixels, the rest are aliases
+    size_t   drawn_glyphs = 0;          // Tessellated and rendered, the cached tiles are not drawn
+    size_t   cached_tiles = 0;
+
+    size_t   lines = 0;                 // Straight outline segments of the drawn glyphs
+    size_t   curves[3] = {};            // Outline curves by QbezType: parabola, line, two lines
+
+    size_t   fill_vertices = 0;
+    size_t   line_rects = 0;            // 6 vertices each
+    size_t   segments = 0;
+    size_t   quad_vertices = 0;
+
+    double   fill_fragments = 0.0;      // Covered pixel estimates: fill triangles, line rects, glyph quads
+    double   line_fragments = 0.0;
+    double   quad_fragments = 0.0;
+
+    double   glyph_area = 0.0;          // Occupancy: unique rects area over the page area
+    double   page_area = 0.0;
+
+    // Peak bytes of one container
+    size_t   peak_fill_arena = 0;
+    size_t   peak_line_arena = 0;
+    size_t   peak_segment_arena = 0;
+    size_t   peak_quad_arena = 0;
+    size_t   arenas = 0;                // Arenas in use at once
+    size_t   peak_page_pixels = 0;
+    size_t   peak_png = 0;
+    size_t   peak_tessellation_cache = 0;
+    size_t   font_outlines = 0;         // Loaded fonts glyphs and commands
+
+    static const char* stage_name( Stage stage );
+
+    void add_time( Stage stage, double seconds );
+
+    float occupancy() const {
+        return page_area > 0.0 ? glyph_area / page_area : 0.0f;
+    }
+
+    void clear();
+
+    // Human readable table
+    std::string table() const;
+
+    std::string json() const;
+};
+
+// Adds the time of its scope to the stage, does nothing without the stats
+
+struct StageTimer {
+    GenerationStats *stats;
+    Stage            stage;
+    std::chrono::steady_clock::time_point start;
+
+    StageTimer( GenerationStats *stats, Stage stage ) : stats( stats ), stage( stage ) {
+        if ( stats ) start = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer() {
+        if ( stats ) stats->add_time( stage, std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() );
+    }
+};
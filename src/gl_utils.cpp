@@ -61,6 +61,10 @@ GLuint compileShader(const char *name, const char *source, ShaderType type) {
                     fprintf(stderr, "Error compiling fragment shader '%s':\n%s\n", name, infoLog);
                     assert( false );
                     break;
+                case ComputeShader :
+                    fprintf(stderr, "Error compiling compute shader '%s':\n%s\n", name, infoLog);
+                    assert( false );
+                    break;
                 default:
                     fprintf(stderr, "Error compiling shader '%s':\n%s\n", name, infoLog);
                     assert( false );
@@ -126,6 +130,22 @@ GLuint createProgram(const char* name, const char* vertex_shader, const char* fr
 }
 
 
+GLuint createComputeProgram(const char* name, const char* compute_shader) {
+    GLuint cs_id = compileShader(name, compute_shader, ComputeShader);
+    if (!cs_id) return 0;
+
+    GLuint id =  glCreateProgram();
+    if (!id) return 0;
+
+    glAttachShader(id, cs_id);
+
+    bool linked = linkProgram(id);
+    if (!linked) return 0;
+    
+    return id;
+}
+
+
 void deleteProgram( GLuint program ) {
     GLuint shaders[16];
     GLsizei count = 0;
@@ -172,7 +192,17 @@ void initVertexAttribs(VertexAttrib *attribs, size_t attrib_count, GLvoid *offse
 void bindAttribs( VertexAttrib *attribs, size_t attrib_count, size_t offset ) {
     for (size_t i = 0; i < attrib_count; ++i) {
         VertexAttrib *va = attribs + i;
-        glVertexAttribPointer(va->location, va->size, va->type.gl_type, va->normalize, va->stride, (void*)((size_t)va->offset + offset));
+        if (va->integer) {
+            glVertexAttribIPointer(va->location, va->size, va->type.gl_type, va->stride, (void*)((size_t)va->offset + offset));
+        } else {
+            glVertexAttribPointer(va->location, va->size, va->type.gl_type, va->normalize, va->stride, (void*)((size_t)va->offset + offset));
+        }
         glEnableVertexAttribArray(va->location);
     }
 }
+
+void unbindAttribs( VertexAttrib *attribs, size_t attrib_count ) {
+    for (size_t i = 0; i < attrib_count; ++i) {
+        glDisableVertexAttribArray(attribs[i].location);
+    }
+}
@@ -25,7 +25,7 @@
 #include <GL/glew.h>
 
 enum ShaderType {
-	VertexShader = GL_VERTEX_SHADER, FragmentShader = GL_FRAGMENT_SHADER
+	VertexShader = GL_VERTEX_SHADER, FragmentShader = GL_FRAGMENT_SHADER, ComputeShader = GL_COMPUTE_SHADER
 };
 
 struct VertexAttribType {
@@ -52,15 +52,17 @@ struct VertexAttrib {
     bool normalize;
     GLuint stride;
     GLvoid *offset;
+    bool integer;       // Passed to the shader as int / uint, not converted to float
 
     VertexAttrib(GLuint location, 
                  const char *name,
                  GLuint size = 4,
                  VertexAttribType type = vatypes::gl_float, 
                  bool normalize = false,
-                 GLvoid *offset = nullptr) :
+                 GLvoid *offset = nullptr,
+                 bool integer = false) :
         location(location), name(name), size(size), type(type),
-        normalize(normalize), offset(offset) {} 
+        normalize(normalize), offset(offset), integer(integer) {} 
 };
 
 struct Uniform {
@@ -89,6 +91,8 @@ bool linkProgram( GLuint program_id );
 
 GLuint createProgram( const char* name, const char* vertex_shader, const char* fragment_shader, VertexAttrib *attribs = nullptr, size_t attrib_count = 0, ProgramAction before_link = 0 );
 
+GLuint createComputeProgram( const char* name, const char* compute_shader );
+
 void deleteProgram( GLuint program );
 
 void initUniforms( GLuint program_id, Uniform *uniform, size_t count = 1 );
@@ -104,6 +108,8 @@ void initVertexAttribs( VertexAttrib *attribs, size_t attrib_count, GLvoid *offs
 
 void bindAttribs( VertexAttrib *attribs, size_t attrib_count, size_t offset = 0 );
 
+void unbindAttribs( VertexAttrib *attribs, size_t attrib_count );
+
 struct Uniform1i : Uniform {
     Uniform1i(const char* name) : Uniform(name) {};
 
@@ -112,6 +118,14 @@ struct Uniform1i : Uniform {
     }
 };
 
+struct Uniform2i : Uniform {
+    Uniform2i(const char* name) : Uniform(name) {};
+
+    void set(int v0, int v1) const {
+        glUniform2i(location, v0, v1);
+    }
+};
+
 struct Uniform1f : Uniform {
     using Uniform::Uniform;
 
@@ -24,17 +24,21 @@
 
 #include "parabola.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstdio>
 #include <cassert>
+#include <functional>
+#include <thread>
 
 #include <iostream>
 
-static void fill_triangle( F2 p0, F2 p1, F2 p2, std::vector<SdfVertex>* vertices ) {
-    SdfVertex v0, v1, v2;
-    v0 = { p0, F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f };
-    v1 = { p1, F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f };
-    v2 = { p2, F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f };
+static void fill_triangle( F2 p0, F2 p1, F2 p2, std::vector<SdfFillVertex>* vertices ) {
+    SdfFillVertex v0, v1, v2;
+    v0 = { p0, { 0, 1 }, { 0, 0 } };
+    v1 = { p1, { 0, 1 }, { 0, 0 } };
+    v2 = { p2, { 0, 1 }, { 0, 0 } };
 
     vertices->push_back( v0 );
     vertices->push_back( v1 );
@@ -53,13 +57,13 @@ void FillPainter::line_to( F2 p1 ) {
 }
 
 void FillPainter::qbez_to( F2 p1, F2 p2 ) {
-    SdfVertex v0, v1, v2, v3, v4, v5;
+    SdfFillVertex v0, v1, v2;
 
     fill_triangle( fan_pos, prev_pos, p2, &vertices );
     
-    v0 = { prev_pos,  F2( -1.0f,  1.0f ), F2( 0.0f ), 0.0f, 0.0f };
-    v1 = { p1,        F2(  0.0f, -1.0f ), F2( 0.0f ), 0.0f, 0.0f };
-    v2 = { p2,        F2(  1.0f,  1.0f ), F2( 0.0f ), 0.0f, 0.0f };
+    v0 = { prev_pos,  { -1,  1 }, { 0, 0 } };
+    v1 = { p1,        {  0, -1 }, { 0, 0 } };
+    v2 = { p2,        {  1,  1 }, { 0, 0 } };
 
     vertices.push_back( v0 );
     vertices.push_back( v1 );
@@ -73,101 +77,241 @@ void FillPainter::close() {
     line_to( fan_pos );
 }
 
-void LinePainter::move_to( F2 p0 ) {
-    prev_pos = p0;
-    start_pos = p0;
+void FillPainter::emit( const SdfFillVertex *src, size_t count, F2 pos, float scale ) {
+    size_t first = vertices.size();
+    vertices.resize( first + count );
+    write( src, count, pos, scale, &vertices[ first ] );
 }
 
-static void set_par_vertex( SdfVertex *v, const Parabola &par ) {
-    F2 par_pos = par.world_to_par( v->pos );
-    v->par = par_pos;
-    v->limits = F2( par.xstart, par.xend );
-    v->scale = par.scale;
+void FillPainter::write( const SdfFillVertex *src, size_t count, F2 pos, float scale, SdfFillVertex *dst ) {
+    for ( size_t iv = 0; iv < count; ++iv ) {
+        dst[ iv ] = src[ iv ];
+        dst[ iv ].pos = src[ iv ].pos * scale + pos;
+    }
 }
 
-static void line_rect( const Parabola &par, F2 vmin, F2 vmax, float line_width, std::vector<SdfVertex> *vertices ) {
-    SdfVertex v0, v1, v2, v3;
-    v0.pos = F2( vmin.x, vmin.y );
-    v1.pos = F2( vmax.x, vmin.y );
-    v2.pos = F2( vmax.x, vmax.y );
-    v3.pos = F2( vmin.x, vmax.y );
+void LinePainter::move_to( F2 p0 ) {
+    prev_pos = p0;
+    start_pos = p0;
+}
 
-    v0.line_width = line_width;
-    v1.line_width = line_width;
-    v2.line_width = line_width;
-    v3.line_width = line_width;
+// Rect along the dir axis enclosing the points. Corners are kept with their offsets
+// per unit of the line width, in the world and in the parabola space.
+static void line_bounds( const Parabola &par, F2 dir, const F2 *pts, int count, std::vector<LineBounds> *bounds ) {
+    F2 ndir = perp_left( dir );
+    F2 vmin = F2( 2e38f );
+    F2 vmax = F2( -2e38f );
+
+    for ( int ip = 0; ip < count; ++ip ) {
+        F2 lpos = F2( dot( pts[ip], dir ), dot( pts[ip], ndir ) );
+        vmin = min( vmin, lpos );
+        vmax = max( vmax, lpos );
+    }
 
-    set_par_vertex( &v0, par );
-    set_par_vertex( &v1, par );
-    set_par_vertex( &v2, par );
-    set_par_vertex( &v3, par );
+    LineBounds lb;
+    lb.pos[0] = dir * vmin.x + ndir * vmin.y;
+    lb.pos[1] = dir * vmax.x + ndir * vmin.y;
+    lb.pos[2] = dir * vmax.x + ndir * vmax.y;
+    lb.pos[3] = dir * vmin.x + ndir * vmax.y;
+    lb.grow[0] = F2( 0.0f ) - dir - ndir;
+    lb.grow[1] = dir - ndir;
+    lb.grow[2] = dir + ndir;
+    lb.grow[3] = ndir - dir;
+
+    float is = 1.0f / par.scale;
+    for ( int ic = 0; ic < 4; ++ic ) {
+        lb.par[ic] = par.world_to_par( lb.pos[ic] );
+        lb.par_grow[ic] = F2( dot( lb.grow[ic], par.mat[0] ), dot( lb.grow[ic], par.mat[1] ) ) * is;
+    }
 
-    vertices->push_back( v0 );
-    vertices->push_back( v1 );
-    vertices->push_back( v2 );
+    lb.limits = F2( par.xstart, par.xend );
+    lb.scale = par.scale;
 
-    vertices->push_back( v0 );
-    vertices->push_back( v2 );
-    vertices->push_back( v3 );
+    bounds->push_back( lb );
 }
 
-void LinePainter::line_to( F2 p1, float line_width ) {
-    F2 vmin = min( prev_pos, p1 );
-    F2 vmax = max( prev_pos, p1 );
+static F2 line_dir( F2 p0, F2 p1 ) {
+    if ( sqr_length( p1 - p0 ) < 1e-14 ) return F2( 1.0f, 0.0f );
+    return normalize( p1 - p0 );
+}
 
-    vmin -= F2( line_width );
-    vmax += F2( line_width );
+static void line_segment( F2 p0, F2 p1, std::vector<LineBounds> *bounds ) {
+    if ( sqr_length( p1 - p0 ) < 1e-7 ) return;
+    F2 pts[2] = { p0, p1 };
+    Parabola par = Parabola::from_line( p0, p1 );
+    line_bounds( par, line_dir( p0, p1 ), pts, 2, bounds );
+}
 
-    Parabola par = Parabola::from_line( prev_pos, p1 );
-    line_rect( par, vmin, vmax, line_width, &vertices );
-    
+void LinePainter::line_to( F2 p1 ) {
+    line_count++;
+    line_segment( prev_pos, p1, &bounds );
     prev_pos = p1;
 }
 
-void LinePainter::qbez_to( F2 p1, F2 p2, float line_width ) {
+void LinePainter::qbez_to( F2 p1, F2 p2 ) {
     F2 p0 = prev_pos;
     
-    F2 mid01 = F2( 0.5 ) * ( p0 + p1 );
-    F2 mid12 = F2( 0.5 ) * ( p1 + p2 );
+    F2 v10 = p0 - p1;
+    F2 v12 = p2 - p1;
+    F2 np10 = normalize( v10 );
+    F2 np12 = normalize( v12 );
+    
+    QbezType qtype = qbez_type( np10, np12 );
+    curve_count[ (int) qtype ]++;
+    
+    switch ( qtype ) {
+    case QbezType::Parabola: {
+        // Curve lies within the hull of p0, mid01, mid12, p2, 
+        // mid01 - mid12 is parallel to the chord
+        F2 pts[4] = { p0, F2( 0.5 ) * ( p0 + p1 ), F2( 0.5 ) * ( p1 + p2 ), p2 };
+        Parabola par = Parabola::from_qbez( p0, p1, p2 );
+        line_bounds( par, line_dir( p0, p2 ), pts, 4, &bounds );
+        break;
+    }
+    case QbezType::Line:
+        line_segment( p0, p2, &bounds );
+        break;
+    case QbezType::TwoLines: {
+        // Curve goes toward p1, turns back at qtop and ends at p2
+        float l10 = length( v10 );
+        float l12 = length( v12 );
+        float qt = l10 / ( l10 + l12 );
+        float nqt = 1.0f - qt;
+        F2 qtop = p0 * ( nqt * nqt ) + p1 * ( 2.0f * nqt * qt ) + p2 * ( qt * qt );
+        line_segment( p0, qtop, &bounds );
+        line_segment( qtop, p2, &bounds );
+        break;
+    }
+    }
+
+    prev_pos = p2;
+}
+
+
+void LinePainter::close() {
+    if ( sqr_length( start_pos - prev_pos ) < 1e-7 ) return;
+    line_to( start_pos );
+}
+
+// World positions scale and translate, the parabola space positions are invariant
+// to both, only their line width offsets scale inversely
+
+void LinePainter::emit( const LineBounds *src, size_t count, F2 pos, float scale, float line_width ) {
+    size_t first = rects.size();
+    rects.resize( first + count );
+    write( src, count, pos, scale, line_width, &rects[ first ] );
+}
+
+void LinePainter::write( const LineBounds *src, size_t count, F2 pos, float scale, float line_width, SdfLineRect *dst ) {
+    F2 grow = F2( line_width );
+    F2 par_grow = F2( line_width / scale );
+
+    for ( size_t ib = 0; ib < count; ++ib ) {
+        const LineBounds &lb = src[ ib ];
+        SdfLineRect &lr = dst[ ib ];
+
+        for ( int ic = 0; ic < 4; ++ic ) {
+            lr.pos[ic] = lb.pos[ic] * scale + pos + lb.grow[ic] * grow;
+            lr.par[ic] = lb.par[ic] + lb.par_grow[ic] * par_grow;
+        }
+
+        lr.limits = lb.limits;
+        lr.scale = lb.scale * scale;
+        lr.line_width = line_width;
+    }
+}
+
+
+
+float rects_area( const std::vector<SdfLineRect> &rects ) {
+    float area = 0.0f;
+    for ( const SdfLineRect &lr : rects ) {
+        F2 d1 = lr.pos[1] - lr.pos[0];
+        F2 d2 = lr.pos[2] - lr.pos[0];
+        F2 d3 = lr.pos[3] - lr.pos[0];
+        area += 0.5f * fabsf( cross( d1, d2 ) ) + 0.5f * fabsf( cross( d2, d3 ) );
+    }
+    return area;
+}
+
+float triangles_area( const std::vector<SdfFillVertex> &vertices ) {
+    float area = 0.0f;
+    for ( size_t iv = 0; iv + 2 < vertices.size(); iv += 3 ) {
+        F2 d1 = vertices[ iv + 1 ].pos - vertices[ iv ].pos;
+        F2 d2 = vertices[ iv + 2 ].pos - vertices[ iv ].pos;
+        area += 0.5f * fabsf( cross( d1, d2 ) );
+    }
+    return area;
+}
+
+static void push_segment( F2 p0, F2 p1, F2 p2, const Parabola &par, std::vector<SdfSegment> *segments ) {
+    SdfSegment seg;
+    seg.p0 = p0;
+    seg.p1 = p1;
+    seg.p2 = p2;
+    seg.scale = par.scale;
+    seg.flags = 0;
+    seg.xaxis = par.mat[0];
+    seg.yaxis = par.mat[1];
+    seg.vertex = par.mat[2];
+    seg.limits = F2( par.xstart, par.xend );
+    segments->push_back( seg );
+}
 
-    F2 vmin = min( p0, mid01 );
-    vmin = min( vmin, mid12 );
-    vmin = min( vmin, p2 );
+static void push_line_segment( F2 p0, F2 p1, std::vector<SdfSegment> *segments ) {
+    if ( sqr_length( p1 - p0 ) < 1e-7 ) return;
+
+    SdfSegment seg;
+    seg.p0 = p0;
+    seg.p1 = F2( 0.5f ) * ( p0 + p1 );
+    seg.p2 = p1;
+    seg.scale = 1.0f;
+    seg.flags = SdfSegment::Line;
+    seg.xaxis = F2( 0.0f );
+    seg.yaxis = F2( 0.0f );
+    seg.vertex = p0;
+    seg.limits = p1;
+    segments->push_back( seg );
+}
 
-    F2 vmax = max( p0, mid01 );
-    vmax = max( vmax, mid12 );
-    vmax = max( vmax, p2 );
+void SegmentPainter::move_to( F2 p0 ) {
+    prev_pos = p0;
+    start_pos = p0;
+}
 
-    vmin -= F2( line_width );
-    vmax += F2( line_width );
+void SegmentPainter::line_to( F2 p1 ) {
+    line_count++;
+    push_line_segment( prev_pos, p1, &segments );
+    prev_pos = p1;
+}
 
+void SegmentPainter::qbez_to( F2 p1, F2 p2 ) {
+    F2 p0 = prev_pos;
+    
     F2 v10 = p0 - p1;
     F2 v12 = p2 - p1;
     F2 np10 = normalize( v10 );
     F2 np12 = normalize( v12 );
     
     QbezType qtype = qbez_type( np10, np12 );
-    Parabola par;
+    curve_count[ (int) qtype ]++;
     
     switch ( qtype ) {
     case QbezType::Parabola:
-        par = Parabola::from_qbez( p0, p1, p2 );
-        line_rect( par, vmin, vmax, line_width, &vertices );
+        push_segment( p0, p1, p2, Parabola::from_qbez( p0, p1, p2 ), &segments );
         break;
     case QbezType::Line:
-        par = Parabola::from_line( p0, p2 );
-        line_rect( par, vmin, vmax, line_width, &vertices );
+        push_line_segment( p0, p2, &segments );
         break;
     case QbezType::TwoLines: {
+        // Curve goes toward p1, turns back at qtop and ends at p2
         float l10 = length( v10 );
         float l12 = length( v12 );
         float qt = l10 / ( l10 + l12 );
         float nqt = 1.0f - qt;
         F2 qtop = p0 * ( nqt * nqt ) + p1 * ( 2.0f * nqt * qt ) + p2 * ( qt * qt );
-        Parabola par0 = Parabola::from_line( p0, qtop );
-        line_rect( par0, vmin, vmax, line_width, &vertices );
-        Parabola par1 = Parabola::from_line( qtop, p1 );
-        line_rect( par1, vmin, vmax, line_width, &vertices ); 
+        push_line_segment( p0, qtop, &segments );
+        push_line_segment( qtop, p2, &segments );
         break;
     }
     }
@@ -175,43 +319,332 @@ void LinePainter::qbez_to( F2 p1, F2 p2, float line_width ) {
     prev_pos = p2;
 }
 
-
-void LinePainter::close( float line_width ) {
+void SegmentPainter::close() {
     if ( sqr_length( start_pos - prev_pos ) < 1e-7 ) return;
-    line_to( start_pos, line_width );
+    line_to( start_pos );
 }
 
+void SegmentPainter::emit( const SdfSegment *src, size_t count, F2 pos, float scale ) {
+    size_t first = segments.size();
+    segments.resize( first + count );
+    write( src, count, pos, scale, &segments[ first ] );
+}
 
+void SegmentPainter::write( const SdfSegment *src, size_t count, F2 pos, float scale, SdfSegment *dst ) {
+    for ( size_t is = 0; is < count; ++is ) {
+        SdfSegment &seg = dst[ is ];
+        seg = src[ is ];
+        seg.p0 = seg.p0 * scale + pos;
+        seg.p1 = seg.p1 * scale + pos;
+        seg.p2 = seg.p2 * scale + pos;
+        seg.vertex = seg.vertex * scale + pos;
+        if ( seg.flags == SdfSegment::Line ) {
+            seg.limits = seg.limits * scale + pos;
+        } else {
+            seg.scale *= scale;
+        }
+    }
+}
 
-void GlyphPainter::draw_glyph( const Font *font, int glyph_index, F2 pos, float scale, float sdf_size ) {
+void SegmentPainter::glyph_quad( F2 vmin, F2 vmax ) {
+    size_t first = vertices.size();
+    vertices.resize( first + 6 );
+    write_quad( vmin, vmax, glyph_start, segments.size() - glyph_start, &vertices[ first ] );
+    glyph_start = segments.size();
+}
+
+void SegmentPainter::write_quad( F2 vmin, F2 vmax, size_t seg_start, size_t seg_count, SdfGlyphVertex *dst ) {
+    uint32_t start = seg_start;
+    uint32_t count = seg_count;
+
+    SdfGlyphVertex v0, v1, v2, v3;
+    v0 = { F2( vmin.x, vmin.y ), start, count };
+    v1 = { F2( vmax.x, vmin.y ), start, count };
+    v2 = { F2( vmax.x, vmax.y ), start, count };
+    v3 = { F2( vmin.x, vmax.y ), start, count };
+
+    dst[0] = v0;
+    dst[1] = v1;
+    dst[2] = v2;
+
+    dst[3] = v0;
+    dst[4] = v2;
+    dst[5] = v3;
+}
+
+
+float quads_area( const std::vector<SdfGlyphVertex> &vertices ) {
+    float area = 0.0f;
+    for ( size_t iv = 0; iv + 5 < vertices.size(); iv += 6 ) {
+        F2 d = vertices[ iv + 2 ].pos - vertices[ iv ].pos;
+        area += fabsf( d.x * d.y );
+    }
+    return area;
+}
+
+
+void GlyphTessellation::init( const Font *font, int glyph_index, bool segments_only ) {
     const Glyph& g = font->glyphs[ glyph_index ];
-    if ( g.command_count == 0 ) return;
+
+    FillPainter    fp;
+    LinePainter    lp;
+    SegmentPainter sp;
+
+    fp.vertices.swap( fill );
+    lp.bounds.swap( lines );
+    sp.segments.swap( segments );
+    fp.vertices.clear();
+    lp.bounds.clear();
+    sp.segments.clear();
 
     for ( int ic = g.command_start; ic < g.command_start + g.command_count; ++ic ) {
         const GlyphCommand& gc = font->glyph_commands[ ic ];
-        F2 p0, p1;
-
-        switch ( gc.type ) {
-        case GlyphCommand::MoveTo:
-            p0 = gc.p0 * scale + pos;
-            fp.move_to( p0 );
-            lp.move_to( p0 );
-            break;
-        case GlyphCommand::LineTo:
-            p0 = gc.p0 * scale + pos;
-            fp.line_to( p0 );
-            lp.line_to( p0, sdf_size );
-            break;
-        case GlyphCommand::BezTo:
-            p0 = gc.p0 * scale + pos;
-            p1 = gc.p1 * scale + pos;            
-            fp.qbez_to( p0, p1 );
-            lp.qbez_to( p0, p1, sdf_size );
-            break;
-        case GlyphCommand::ClosePath:
-            fp.close();
-            lp.close( sdf_size );
-            break;
+
+        if ( segments_only ) {
+            switch ( gc.type ) {
+            case GlyphCommand::MoveTo:
+                sp.move_to( gc.p0 );
+                break;
+            case GlyphCommand::LineTo:
+                sp.line_to( gc.p0 );
+                break;
+            case GlyphCommand::BezTo:
+                sp.qbez_to( gc.p0, gc.p1 );
+                break;
+            case GlyphCommand::ClosePath:
+                sp.close();
+                break;
+            }
+        } else {
+            switch ( gc.type ) {
+            case GlyphCommand::MoveTo:
+                fp.move_to( gc.p0 );
+                lp.move_to( gc.p0 );
+                break;
+            case GlyphCommand::LineTo:
+                fp.line_to( gc.p0 );
+                lp.line_to( gc.p0 );
+                break;
+            case GlyphCommand::BezTo:
+                fp.qbez_to( gc.p0, gc.p1 );
+                lp.qbez_to( gc.p0, gc.p1 );
+                break;
+            case GlyphCommand::ClosePath:
+                fp.close();
+                lp.close();
+                break;
+            }
+        }
+    }
+
+    fill.swap( fp.vertices );
+    lines.swap( lp.bounds );
+    segments.swap( sp.segments );
+
+    line_count = segments_only ? sp.line_count : lp.line_count;
+    for ( int it = 0; it < 3; ++it ) curve_count[ it ] = segments_only ? sp.curve_count[ it ] : lp.curve_count[ it ];
+}
+
+std::shared_ptr<const GlyphTessellation> TessellationCache::get( const Font *font, int glyph_index, bool segments_only ) {
+    Key key { font->data_hash, glyph_index, segments_only };
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        auto git = glyphs.find( key );
+        if ( git != glyphs.end() ) {
+            hits++;
+            use_order.splice( use_order.begin(), use_order, git->second.use );
+            return git->second.tessellation;
         }
     }
+
+    // Tessellating outside the lock, a concurrent miss of the same glyph keeps the first entry
+
+    std::shared_ptr<GlyphTessellation> gt = std::make_shared<GlyphTessellation>();
+    gt->init( font, glyph_index, segments_only );
+
+    std::lock_guard<std::mutex> lock( mutex );
+    misses++;
+
+    auto git = glyphs.find( key );
+    if ( git != glyphs.end() ) return git->second.tessellation;
+
+    while ( !glyphs.empty() && glyphs.size() >= max_glyphs ) {
+        glyphs.erase( use_order.back() );
+        use_order.pop_back();
+    }
+
+    use_order.push_front( key );
+    glyphs.emplace( key, Entry { gt, use_order.begin() } );
+    return gt;
+}
+
+size_t TessellationCache::memory() {
+    std::lock_guard<std::mutex> lock( mutex );
+
+    size_t bytes = 0;
+    for ( const auto &kv : glyphs ) {
+        const GlyphTessellation &gt = *kv.second.tessellation;
+        bytes += sizeof( GlyphTessellation ) + gt.fill.capacity() * sizeof( SdfFillVertex ) +
+                 gt.lines.capacity() * sizeof( LineBounds ) + gt.segments.capacity() * sizeof( SdfSegment );
+    }
+    return bytes;
+}
+
+void GlyphPainter::draw_glyph( const Font *font, int glyph_index, F2 pos, float scale, float sdf_size ) {
+    const Glyph& g = font->glyphs[ glyph_index ];
+    if ( g.command_count == 0 ) return;
+
+    bool segments_only = mode != SdfMode::Stencil;
+
+    if ( cache ) {
+        std::shared_ptr<const GlyphTessellation> gt = cache->get( font, glyph_index, segments_only );
+        emit( *gt, pos, scale, sdf_size );
+    } else {
+        tess.init( font, glyph_index, segments_only );
+        emit( tess, pos, scale, sdf_size );
+    }
+}
+
+void GlyphPainter::emit( const GlyphTessellation &gt, F2 pos, float scale, float sdf_size ) {
+    count_segments( gt );
+    fp.emit( gt.fill.data(), gt.fill.size(), pos, scale );
+    lp.emit( gt.lines.data(), gt.lines.size(), pos, scale, sdf_size );
+    sp.emit( gt.segments.data(), gt.segments.size(), pos, scale );
+}
+
+// Three passes: tessellations fetched on the threads, the output offsets from the prefix
+// sums, then each thread writes its glyphs into its own slices of the vertex streams.
+// The streams are resized once and the glyph order doesn't depend on the thread count.
+
+void GlyphPainter::draw_glyphs( const GlyphDraw *glyphs, size_t count, int thread_count ) {
+    bool segments_only = mode != SdfMode::Stencil;
+
+    std::vector<std::shared_ptr<const GlyphTessellation>> tessellations( count );
+
+    // Output offsets per glyph: fill vertices, line vertices, segments
+
+    struct Offsets {
+        size_t fill, line, segment;
+    };
+    std::vector<Offsets> offsets( count + 1 );
+
+    thread_count = std::max( 1, std::min( thread_count, (int) ( count / min_thread_glyphs ) ) );
+
+    auto run = [&]( std::function<void( size_t, size_t )> work ) {
+        if ( thread_count == 1 ) {
+            work( 0, count );
+            return;
+        }
+        std::vector<std::thread> threads;
+        for ( int it = 0; it < thread_count; ++it ) {
+            threads.emplace_back( work, count * it / thread_count, count * ( it + 1 ) / thread_count );
+        }
+        for ( std::thread &t : threads ) t.join();
+    };
+
+    run( [&]( size_t begin, size_t end ) {
+        for ( size_t ig = begin; ig < end; ++ig ) {
+            const GlyphDraw &gd = glyphs[ ig ];
+            if ( gd.font->glyphs[ gd.glyph_index ].command_count == 0 ) continue;
+
+            if ( cache ) {
+                tessellations[ ig ] = cache->get( gd.font, gd.glyph_index, segments_only );
+            } else {
+                std::shared_ptr<GlyphTessellation> gt = std::make_shared<GlyphTessellation>();
+                gt->init( gd.font, gd.glyph_index, segments_only );
+                tessellations[ ig ] = gt;
+            }
+        }
+    } );
+
+    offsets[0] = Offsets { fp.vertices.size(), lp.rects.size(), sp.segments.size() };
+    for ( size_t ig = 0; ig < count; ++ig ) {
+        offsets[ ig + 1 ] = offsets[ ig ];
+        const GlyphTessellation *gt = tessellations[ ig ].get();
+        if ( !gt ) continue;
+        count_segments( *gt );
+        offsets[ ig + 1 ].fill += gt->fill.size();
+        offsets[ ig + 1 ].line += gt->lines.size();
+        offsets[ ig + 1 ].segment += gt->segments.size();
+    }
+
+    // Line pass writes within sdf_size of the outline, a pixel outside the rect box is written
+    // only if the outline box grown by sdf_size reaches past the pixel center
+
+    if ( mode == SdfMode::Stencil ) {
+        for ( size_t ig = 0; ig < count; ++ig ) {
+            const GlyphDraw &gd = glyphs[ ig ];
+            if ( !tessellations[ ig ] ) continue;
+
+            const Glyph &g = gd.font->glyphs[ gd.glyph_index ];
+            F2 gmin = gd.pos + g.min * gd.scale - F2( gd.sdf_size + 0.5f );
+            F2 gmax = gd.pos + g.max * gd.scale + F2( gd.sdf_size + 0.5f );
+
+            SdfClip clip;
+            clip.x = (int) gd.quad_min.x;
+            clip.y = (int) gd.quad_min.y;
+            clip.w = (int) ceil( gd.quad_max.x - gd.quad_min.x );
+            clip.h = (int) ceil( gd.quad_max.y - gd.quad_min.y );
+
+            if ( gmin.x >= clip.x && gmin.y >= clip.y && gmax.x <= clip.x + clip.w && gmax.y <= clip.y + clip.h ) continue;
+
+            clip.fill_start = offsets[ ig ].fill;
+            clip.fill_end = offsets[ ig + 1 ].fill;
+            clip.line_start = offsets[ ig ].line;
+            clip.line_end = offsets[ ig + 1 ].line;
+            clips.push_back( clip );
+        }
+    }
+
+    size_t quad_start = sp.vertices.size();
+
+    fp.vertices.resize( offsets[ count ].fill );
+    lp.rects.resize( offsets[ count ].line );
+    sp.segments.resize( offsets[ count ].segment );
+    if ( segments_only ) sp.vertices.resize( quad_start + count * 6 );
+
+    run( [&]( size_t begin, size_t end ) {
+        for ( size_t ig = begin; ig < end; ++ig ) {
+            const GlyphDraw &gd = glyphs[ ig ];
+            const GlyphTessellation *gt = tessellations[ ig ].get();
+            const Offsets &off = offsets[ ig ];
+
+            if ( gt ) {
+                FillPainter::write( gt->fill.data(), gt->fill.size(), gd.pos, gd.scale, fp.vertices.data() + off.fill );
+                LinePainter::write( gt->lines.data(), gt->lines.size(), gd.pos, gd.scale, gd.sdf_size, lp.rects.data() + off.line );
+                SegmentPainter::write( gt->segments.data(), gt->segments.size(), gd.pos, gd.scale, sp.segments.data() + off.segment );
+            }
+
+            // Quad segment range as in glyph_quad(), the first one also takes the segments drawn before
+
+            if ( segments_only ) {
+                size_t seg_start = ig == 0 ? sp.glyph_start : off.segment;
+                SegmentPainter::write_quad( gd.quad_min, gd.quad_max, seg_start, offsets[ ig + 1 ].segment - seg_start,
+                                            sp.vertices.data() + quad_start + ig * 6 );
+            }
+        }
+    } );
+
+    if ( segments_only ) sp.glyph_start = sp.segments.size();
+}
+
+// A command adds at most two fill triangles and two line rects ( a curve split in two lines ),
+// or two segments. Quad vertices are 6 per glyph.
+
+size_t GlyphPainter::max_glyph_vertices( const Font *font, int glyph_index, SdfMode mode ) {
+    size_t commands = font->glyphs[ glyph_index ].command_count;
+    return mode == SdfMode::Stencil ? commands * 6 : std::max<size_t>( commands * 2, 6 );
+}
+
+// Line rects are at most a third of the fill vertices
+
+void GlyphPainter::reserve( size_t vertices ) {
+    if ( mode == SdfMode::Stencil ) {
+        fp.vertices.reserve( vertices );
+        lp.rects.reserve( vertices / 3 );
+    } else {
+        sp.segments.reserve( vertices );
+        sp.vertices.reserve( vertices );
+    }
 }
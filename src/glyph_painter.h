@@ -22,15 +22,24 @@
 
 #pragma once
 
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "float2.h"
 #include "sdf_gl.h"
 #include "font.h"
 
+// Glyphs are tessellated in glyph units, independent of the size, then emitted into
+// the vertex streams by a translation and a uniform scale. Parabola fitting and segment
+// classification are done once per glyph, emitting only transforms the positions.
+
 
 struct FillPainter {
-    std::vector<SdfVertex> vertices;
+    std::vector<SdfFillVertex> vertices;
 
     F2 fan_pos = F2( 0.0f );
     F2 prev_pos = F2( 0.0f );
@@ -42,22 +51,162 @@ struct FillPainter {
     void qbez_to( F2 p1, F2 p2 );
 
     void close();
+
+    // Appends the triangles scaled and translated by pos
+    void emit( const SdfFillVertex *src, size_t count, F2 pos, float scale );
+
+    static void write( const SdfFillVertex *src, size_t count, F2 pos, float scale, SdfFillVertex *dst );
 };
 
 
+// Line pass segment rect before the line width inflation, so the same rect serves any line width
+
+struct LineBounds {
+    F2    pos[4];       // Corners
+    F2    grow[4];      // Corner offsets per unit of line width
+    F2    par[4];       // Corners in the parabola space
+    F2    par_grow[4];  // Parabola space offsets per unit of line width
+    F2    limits;       // Parabolic segment xstart, xend
+    float scale;        // Parabola scale
+};
+
 struct LinePainter {
-    std::vector<SdfVertex> vertices;
+    std::vector<SdfLineRect> rects;
+    std::vector<LineBounds>  bounds;    // Tessellated segments
+
+    size_t line_count = 0;              // Outline segments drawn: straight ones and curves by QbezType
+    size_t curve_count[3] = { 0, 0, 0 };
 
     F2 start_pos = F2( 0.0f );    
     F2 prev_pos;
 
     void move_to( F2 p0 );
 
-    void line_to( F2 p1, float line_width );
+    void line_to( F2 p1 );
+
+    void qbez_to( F2 p1, F2 p2 );
+
+    void close();
 
-    void qbez_to( F2 p1, F2 p2, float line_width );
+    // Appends the segment rects scaled and translated by pos, inflated by line_width
+    void emit( const LineBounds *src, size_t count, F2 pos, float scale, float line_width );
 
-    void close( float line_width );
+    // Writes a rect per segment
+    static void write( const LineBounds *src, size_t count, F2 pos, float scale, float line_width, SdfLineRect *dst );
+};
+
+
+// Total area of the rects, estimate of the fragments shaded in the line pass
+float rects_area( const std::vector<SdfLineRect> &rects );
+
+// Total area of the triangles, estimate of the fragments shaded in the stencil fill pass
+float triangles_area( const std::vector<SdfFillVertex> &vertices );
+
+
+// Glyph segments and glyph quads for SdfMode::GlyphQuad and SdfMode::Compute
+
+struct SegmentPainter {
+    std::vector<SdfSegment>     segments;
+    std::vector<SdfGlyphVertex> vertices;
+
+    F2 start_pos = F2( 0.0f );
+    F2 prev_pos  = F2( 0.0f );
+
+    size_t glyph_start = 0; // First segment of the current glyph
+
+    size_t line_count = 0;  // Outline segments drawn: straight ones and curves by QbezType
+    size_t curve_count[3] = { 0, 0, 0 };
+
+    void move_to( F2 p0 );
+
+    void line_to( F2 p1 );
+
+    void qbez_to( F2 p1, F2 p2 );
+
+    void close();
+
+    // Appends the segments scaled and translated by pos
+    void emit( const SdfSegment *src, size_t count, F2 pos, float scale );
+
+    static void write( const SdfSegment *src, size_t count, F2 pos, float scale, SdfSegment *dst );
+
+    // Quad covering the glyph rect, segments added since the previous quad belong to the glyph
+    void glyph_quad( F2 vmin, F2 vmax );
+
+    // Writes 6 quad vertices for the segment range
+    static void write_quad( F2 vmin, F2 vmax, size_t seg_start, size_t seg_count, SdfGlyphVertex *dst );
+};
+
+
+// Total area of the glyph quads, estimate of the fragments shaded in the GlyphQuad mode
+float quads_area( const std::vector<SdfGlyphVertex> &vertices );
+
+
+// Glyph outline in glyph units
+
+struct GlyphTessellation {
+    std::vector<SdfFillVertex> fill;        // Stencil mode fill pass triangles
+    std::vector<LineBounds>    lines;       // Stencil mode line pass segments
+    std::vector<SdfSegment>    segments;    // GlyphQuad and Compute mode segments
+
+    uint32_t line_count = 0;                // Outline segments: straight ones and curves by QbezType
+    uint32_t curve_count[3] = { 0, 0, 0 };
+
+    // Tessellates the fill and line data, or the segments only
+    void init( const Font *font, int glyph_index, bool segments_only );
+};
+
+
+// Tessellations shared by the painters of all the atlases, keyed by the font data hash,
+// so the atlases of a font at any size share them. Entries are immutable, get() is thread safe.
+// Above max_glyphs the least recently used entries are dropped, the ones in use stay alive.
+
+struct TessellationCache {
+    struct Key {
+        uint64_t font_hash;
+        int      glyph_index;
+        bool     segments_only;
+
+        bool operator==( const Key &k ) const {
+            return font_hash == k.font_hash && glyph_index == k.glyph_index && segments_only == k.segments_only;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()( const Key &k ) const {
+            return k.font_hash ^ ( (uint64_t) k.glyph_index * 0x9e3779b97f4a7c15ull + k.segments_only );
+        }
+    };
+
+    struct Entry {
+        std::shared_ptr<const GlyphTessellation> tessellation;
+        std::list<Key>::iterator                 use;     // Position in the use order
+    };
+
+    std::mutex mutex;
+    std::unordered_map<Key, Entry, KeyHash> glyphs;
+    std::list<Key> use_order;           // Most recently used first
+    size_t     max_glyphs = 1 << 16;
+    size_t     hits = 0;
+    size_t     misses = 0;
+
+    std::shared_ptr<const GlyphTessellation> get( const Font *font, int glyph_index, bool segments_only );
+
+    // Bytes held by the entries
+    size_t memory();
+};
+
+
+// Glyph placement for GlyphPainter::draw_glyphs()
+
+struct GlyphDraw {
+    const Font *font;
+    int         glyph_index;
+    F2          pos;
+    float       scale;
+    float       sdf_size;
+    F2          quad_min;   // Glyph rect, the quad of the GlyphQuad and Compute modes, the Stencil mode clip box
+    F2          quad_max;
 };
 
 
@@ -66,11 +215,51 @@ struct GlyphPainter {
     FillPainter fp;
 
     LinePainter lp;
+
+    SegmentPainter sp;
+
+    SdfMode mode = SdfMode::Stencil;
+
+    TessellationCache *cache = nullptr;     // Optional, otherwise the glyph is tessellated on every draw
+
+    GlyphTessellation  tess;                // Tessellation of the last glyph drawn without the cache
+
+    std::vector<SdfClip> clips;             // Stencil mode glyphs reaching past their rects, in the draw order
+
+    size_t line_count = 0;                  // Outline segments of the glyphs drawn since clear():
+    size_t curve_count[3] = { 0, 0, 0 };    // straight ones and curves by QbezType
     
     void draw_glyph( const Font *font, int glyph_index, F2 pos, float scale, float sdf_size );
 
+    // Draws the glyphs and their quads on up to thread_count threads, the result is the same
+    // as of the draw_glyph() and glyph_quad() calls in the list order. In the Stencil mode
+    // the glyphs reaching past their rects get a clip, so every rect is drawn by its glyph only.
+    void draw_glyphs( const GlyphDraw *glyphs, size_t count, int thread_count );
+
+    static const size_t min_thread_glyphs = 64;    // Fewer glyphs per thread aren't worth starting one
+
+    // Upper bound of the vertices ( or rects, segments ) the glyph adds to any one stream, for sizing the batches
+    static size_t max_glyph_vertices( const Font *font, int glyph_index, SdfMode mode );
+
+    // Preallocates the streams of the mode for 'vertices'
+    void reserve( size_t vertices );
+
+    void emit( const GlyphTessellation &gt, F2 pos, float scale, float sdf_size );
+
     void clear() {
         fp.vertices.clear();
-        lp.vertices.clear();
+        lp.rects.clear();
+        sp.segments.clear();
+        sp.vertices.clear();
+        sp.glyph_start = 0;
+        clips.clear();
+        line_count = 0;
+        curve_count[0] = curve_count[1] = curve_count[2] = 0;
+    }
+
+    // Adds the outline segment counts of a tessellation
+    void count_segments( const GlyphTessellation &gt ) {
+        line_count += gt.line_count;
+        for ( int it = 0; it < 3; ++it ) curve_count[ it ] += gt.curve_count[ it ];
     }
 };
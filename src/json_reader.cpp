@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "json_reader.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+const JsonValue* JsonValue::find( const std::string &key ) const {
+    for ( const auto &kv : object ) {
+        if ( kv.first == key ) return &kv.second;
+    }
+    return nullptr;
+}
+
+struct JsonReader {
+    const char *start = nullptr;
+    const char *pos   = nullptr;
+    const char *end   = nullptr;
+    std::string error;
+
+    // Values are parsed recursively, so the nesting is limited to keep the stack bounded
+    // for any input, e.g. a server request
+    static const int max_depth = 64;
+    int         depth = 0;
+
+    bool fail( const char *message ) {
+        if ( error.empty() ) {
+            int line = 1;
+            for ( const char *p = start; p < pos; ++p ) {
+                if ( *p == '\n' ) line++;
+            }
+            error = std::string( message ) + " at line " + std::to_string( line );
+        }
+        return false;
+    }
+
+    void skip_space() {
+        while ( pos < end && ( *pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' ) ) pos++;
+    }
+
+    bool literal( const char *word ) {
+        size_t len = strlen( word );
+        if ( (size_t) ( end - pos ) < len || strncmp( pos, word, len ) != 0 ) return fail( "Unexpected token" );
+        pos += len;
+        return true;
+    }
+
+    static void append_utf8( std::string &s, uint32_t cp ) {
+        if ( cp < 0x80 ) {
+            s += (char) cp;
+        } else if ( cp < 0x800 ) {
+            s += (char) ( 0xc0 | ( cp >> 6 ) );
+            s += (char) ( 0x80 | ( cp & 0x3f ) );
+        } else if ( cp < 0x10000 ) {
+            s += (char) ( 0xe0 | ( cp >> 12 ) );
+            s += (char) ( 0x80 | ( ( cp >> 6 ) & 0x3f ) );
+            s += (char) ( 0x80 | ( cp & 0x3f ) );
+        } else {
+            s += (char) ( 0xf0 | ( cp >> 18 ) );
+            s += (char) ( 0x80 | ( ( cp >> 12 ) & 0x3f ) );
+            s += (char) ( 0x80 | ( ( cp >> 6 ) & 0x3f ) );
+            s += (char) ( 0x80 | ( cp & 0x3f ) );
+        }
+    }
+
+    bool hex4( uint32_t &cp ) {
+        if ( end - pos < 4 ) return fail( "Bad unicode escape" );
+        cp = 0;
+        for ( int i = 0; i < 4; ++i ) {
+            char c = *pos++;
+            cp <<= 4;
+            if ( c >= '0' && c <= '9' ) cp |= c - '0';
+            else if ( c >= 'a' && c <= 'f' ) cp |= c - 'a' + 10;
+            else if ( c >= 'A' && c <= 'F' ) cp |= c - 'A' + 10;
+            else return fail( "Bad unicode escape" );
+        }
+        return true;
+    }
+
+    bool read_string( std::string &s ) {
+        pos++; // opening quote
+        while ( pos < end && *pos != '"' ) {
+            char c = *pos++;
+            if ( c != '\\' ) {
+                s += c;
+                continue;
+            }
+            if ( pos >= end ) break;
+            char e = *pos++;
+            switch ( e ) {
+            case '"':  s += '"';  break;
+            case '\\': s += '\\'; break;
+            case '/':  s += '/';  break;
+            case 'b':  s += '\b'; break;
+            case 'f':  s += '\f'; break;
+            case 'n':  s += '\n'; break;
+            case 'r':  s += '\r'; break;
+            case 't':  s += '\t'; break;
+            case 'u': {
+                uint32_t cp = 0;
+                if ( !hex4( cp ) ) return false;
+                // Surrogate pair
+                if ( cp >= 0xd800 && cp < 0xdc00 && end - pos >= 6 && pos[ 0 ] == '\\' && pos[ 1 ] == 'u' ) {
+                    pos += 2;
+                    uint32_t low = 0;
+                    if ( !hex4( low ) ) return false;
+                    cp = 0x10000 + ( ( cp - 0xd800 ) << 10 ) + ( low - 0xdc00 );
+                }
+                append_utf8( s, cp );
+                break;
+            }
+            default:
+                return fail( "Bad escape" );
+            }
+        }
+        if ( pos >= end ) return fail( "Unterminated string" );
+        pos++; // closing quote
+        return true;
+    }
+
+    bool value( JsonValue &v ) {
+        if ( depth == max_depth ) return fail( "Nesting too deep" );
+        depth++;
+        bool ok = nested_value( v );
+        depth--;
+        return ok;
+    }
+
+    bool nested_value( JsonValue &v ) {
+        skip_space();
+        if ( pos >= end ) return fail( "Unexpected end" );
+
+        switch ( *pos ) {
+        case '{': {
+            v.type = JsonValue::Object;
+            pos++;
+            skip_space();
+            if ( pos < end && *pos == '}' ) {
+                pos++;
+                return true;
+            }
+            for (;;) {
+                skip_space();
+                if ( pos >= end || *pos != '"' ) return fail( "Expected key" );
+                std::string key;
+                if ( !read_string( key ) ) return false;
+                skip_space();
+                if ( pos >= end || *pos != ':' ) return fail( "Expected ':'" );
+                pos++;
+                v.object.push_back( { key, JsonValue() } );
+                if ( !value( v.object.back().second ) ) return false;
+                skip_space();
+                if ( pos < end && *pos == ',' ) {
+                    pos++;
+                    continue;
+                }
+                if ( pos < end && *pos == '}' ) {
+                    pos++;
+                    return true;
+                }
+                return fail( "Expected ',' or '}'" );
+            }
+        }
+        case '[': {
+            v.type = JsonValue::Array;
+            pos++;
+            skip_space();
+            if ( pos < end && *pos == ']' ) {
+                pos++;
+                return true;
+            }
+            for (;;) {
+                v.array.push_back( JsonValue() );
+                if ( !value( v.array.back() ) ) return false;
+                skip_space();
+                if ( pos < end && *pos == ',' ) {
+                    pos++;
+                    continue;
+                }
+                if ( pos < end && *pos == ']' ) {
+                    pos++;
+                    return true;
+                }
+                return fail( "Expected ',' or ']'" );
+            }
+        }
+        case '"':
+            v.type = JsonValue::String;
+            return read_string( v.str );
+        case 't':
+            v.type = JsonValue::Bool;
+            v.boolean = true;
+            return literal( "true" );
+        case 'f':
+            v.type = JsonValue::Bool;
+            v.boolean = false;
+            return literal( "false" );
+        case 'n':
+            v.type = JsonValue::Null;
+            return literal( "null" );
+        default: {
+            // strtod needs a terminated string, the text is terminated by std::string
+            char *num_end = nullptr;
+            v.type = JsonValue::Number;
+            v.number = strtod( pos, &num_end );
+            if ( num_end == pos ) return fail( "Unexpected token" );
+            pos = num_end;
+            return true;
+        }
+        }
+    }
+};
+
+bool parse_json( const std::string &text, JsonValue &value, std::string &error ) {
+    JsonReader reader;
+    reader.start = text.c_str();
+    reader.pos = reader.start;
+    reader.end = reader.start + text.size();
+
+    value = JsonValue();
+    bool ok = reader.value( value );
+    if ( ok ) {
+        reader.skip_space();
+        if ( reader.pos != reader.end ) ok = reader.fail( "Trailing characters" );
+    }
+
+    error = reader.error;
+    return ok;
+}
@@ -24,43 +24,83 @@
 #include <fstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <csignal>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <GL/gl.h>
 
-#include "float2.h"
 #include "args_parser.h"
-#include "sdf_gl.h"
-#include "sdf_atlas.h"
-#include "glyph_painter.h"
-#include "font.h"
+#include "json_reader.h"
+#include "sdf_generator.h"
+#include "atlas_server.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "../third_party/stb_image_write.h"
+// Command line client of the generator library, the globals are the options
 
 ArgsParser   args;
-SdfGl        sdf_gl;
-SdfAtlas     sdf_atlas;
-Font         font;
-GlyphPainter gp;
 
 int          max_tex_size = 2048;
 int          width = 1024;
-int          height = 0;
+int          tex_height = 0;        // Requested atlas height, 0 - packed height
 int          row_height = 96;
 int          border_size = 16;
+bool         border_set = false;
 
-std::string  filename;
+bool         fit_atlas = false;
+int          fit_width = 0;
+int          fit_height = 0;
+
+SdfMode      sdf_mode = SdfMode::Stencil;
+PackerType   packer_type = PackerType::Shelf;
+PagePolicy   page_policy = PagePolicy::Fill;
+bool         compare_modes = false;
+
+std::vector<std::string> filenames;
 std::string  res_filename;
-F2           tex_size = F2( 1024, 1024 );
+
+std::vector<UnicodeRange> unicode_ranges;
 
 
-struct UnicodeRange {
-    uint32_t start;
-    uint32_t end;
+struct SizeConfig {
+    int row_height;
+    int border_size;
 };
 
-std::vector<UnicodeRange> unicode_ranges;
+std::vector<SizeConfig> size_configs;
+
+// Corpus codepoints ordered by frequency
+std::vector<uint32_t>   corpus_codepoints;
+std::unordered_map<uint32_t, size_t> corpus_freq;
+
+std::string  batch_filename;
+
+// Glyph tile cache, shared by all the batch jobs
+TileCache    tile_cache;
+std::string  tile_cache_dir;
+int          tile_cache_mb = 256;
+
+// Server mode
+AtlasServer  server;
+std::string  socket_path;
+int          max_fonts = 16;
+
+// Stage times and counters
+GenerationStats stats;
+std::string  stats_filename;
+
+// First error of the option readers. They don't exit, since the batch jobs are read on
+// the pipeline threads, the callers check it after ArgsParser::run().
+std::string  option_error;
+
+void option_failed( const std::string &text ) {
+    if ( option_error.empty() ) option_error = text;
+}
 
 
 std::string help = R"(Program for generating signed distance field font atlas.
@@ -70,13 +110,54 @@ License: MIT
 Usage: sdf_atlas -f font_file.ttf [options]
 Options:
     -h              this help
+    -f 'filename'   TTF font file, repeat for a fallback chain: each codepoint is taken
+                    from the first font containing it, all glyphs share one atlas
     -o 'filename'   output file name (without extension)
     -tw 'size'      atlas image width in pixels, default 1024
-    -th 'size'      atlas image height in pixels (optional)
+    -th 'size'      atlas image height in pixels (optional), glyphs not fitting
+                    into it continue on the next pages saved as 'name_N.png'
     -ur 'ranges'    unicode ranges 'start1:end1,start:end2,single_codepoint' without spaces,
                     default: 31:126,0xffff
+    -c 'filename'   UTF-8 text corpus, can be repeated: only the codepoints used in the corpus
+                    are allocated, most frequent first; '-ur' ranges are always included
     -bs 'size'      SDF distance in pixels, default 16
     -rh 'size'      row height in pixels (without SDF border), default 96
+    -m 'mode'       rendering mode, default 'stencil':
+                    'stencil' - distance pass, stencil fill pass and full screen inversion
+                    'quad'    - single pass, glyph quads computing both distance and sign
+                    'compute' - compute shader over screen tiles, requires OpenGL 4.3
+    -pk 'packer'    glyph rect packer, default 'shelf':
+                    'shelf'    - full row height rects in codepoint order
+                    'skyline'  - tight glyph rects sorted by height, skyline packing
+                    'maxrects' - tight glyph rects sorted by height, maximal free rects packing
+    -pp 'policy'    page policy, default 'fill':
+                    'fill'  - next page starts when the current one is full
+                    'block' - glyphs are grouped by Unicode block, a block not fitting
+                              into the current page starts the next one
+    -sz 'sizes'     several atlases from one run, 'rh1:bs1,rh2:bs2' row height and border
+                    size pairs, saved as 'name_rh_bs'
+    -fit 'WxH'      find the largest row height, for which the glyphs fit into WxH atlas,
+                    border size is scaled with the row height unless '-bs' is set
+    -cmp            compare the result with the 'stencil' mode output
+    -tc 'dir'       glyph tile cache directory: rendered glyph tiles are stored there
+                    and reused by the next runs, only the missing glyphs are rendered.
+                    A tile is reused only at the same place of the same size page,
+                    so the output is the same as without the cache
+    -tcs 'size'     tile cache size cap in megabytes, least recently used tiles
+                    are removed above it, default 256
+    -b 'file'       (--batch) run the jobs of a JSON manifest, options other than '-tc',
+                    '-tcs' and '-st' are ignored:
+                    { "defaults": { job }, "jobs": [ { job }, ... ] }, job keys are
+                    font, output, width, height, ranges, corpus, border_size, row_height,
+                    mode, packer, page_policy, sizes, fit, compare;
+                    fonts and GL resources are shared between the jobs
+    -s 'socket'     (--serve) serve atlas requests on a Unix domain socket until
+                    SIGINT or SIGTERM, see the readme for the protocol; options other
+                    than '-tc', '-tcs' and '-fc' are ignored
+    -fc 'count'     server font cache size, least recently used fonts are unloaded
+                    above it, default 16
+    -st 'file'      (--stats) print the time of every generation stage and the glyph,
+                    geometry and memory counters, and save them as JSON to the file
 Example:
     sdf_atlas -f Roboto-Regular.ttf -o roboto -tw 2048 -th 2048 -bs 22 -rh 70 -ur 31:126,0xA0:0xFF,0x400:0x4FF,0xFFFF
 )";
@@ -87,7 +168,7 @@ void show_help( ArgsParser* ) {
 }
 
 void read_filename( ArgsParser* ap ) {
-    filename = ap->word();
+    filenames.push_back( ap->word() );
 }
 
 void read_res_filename( ArgsParser* ap ) {
@@ -98,8 +179,8 @@ void read_tex_width( ArgsParser *ap ) {
     errno = 0;
     width = strtol( ap->word().c_str(), nullptr, 0 );
     if ( errno != 0 || width <= 0 ) {
-        std::cerr << "Error reading texture width." << std::endl;
-        exit( 1 );
+        option_failed( "Error reading texture width." );
+        return;
     }
     if ( width > max_tex_size ) {
         std::cerr << "Maximum texture size is " << max_tex_size << ". Clamping width." << std::endl;
@@ -109,14 +190,14 @@ void read_tex_width( ArgsParser *ap ) {
 
 void read_tex_height( ArgsParser *ap ) {
     errno = 0;
-    height = strtol( ap->word().c_str(), nullptr, 0 );
-    if ( errno != 0 || height <= 0 ) {
-        std::cerr << "Error reading texture height." << std::endl;
-        exit( 1 );
+    tex_height = strtol( ap->word().c_str(), nullptr, 0 );
+    if ( errno != 0 || tex_height <= 0 ) {
+        option_failed( "Error reading texture height." );
+        return;
     }
-    if ( height > max_tex_size ) {
+    if ( tex_height > max_tex_size ) {
         std::cout << "Height exceeds maximum texture size. Setting to " << max_tex_size << ".\n";
-        height = max_tex_size;
+        tex_height = max_tex_size;
     }
 };
 
@@ -124,8 +205,8 @@ void read_row_height( ArgsParser *ap ) {
     errno = 0;
     row_height = strtol( ap->word().c_str(), nullptr, 0 );
     if ( errno != 0 || row_height <= 4 ) {
-        std::cerr << "Error reading row height." << std::endl;
-        exit( 1 );
+        option_failed( "Error reading row height." );
+        return;
     }
 }
 
@@ -133,67 +214,524 @@ void read_border_size( ArgsParser *ap ) {
     errno = 0;
     border_size = strtol( ap->word().c_str(), nullptr, 0 );
     if ( errno != 0 || border_size <= 0 ) {
-        std::cerr << "Error reading border size." << std::endl;
-        exit( 1 );        
+        option_failed( "Error reading border size." );
+        return;
     }
+    border_set = true;
 }
 
-void read_unicode_ranges( ArgsParser *ap ) {
+void read_fit( ArgsParser *ap ) {
+    std::string size = ap->word();
+    char *pos = nullptr;
+
+    errno = 0;
+    fit_width = strtol( size.c_str(), &pos, 10 );
+    if ( errno != 0 || fit_width <= 0 || ( *pos != 'x' && *pos != 'X' ) ) {
+        option_failed( "Error reading fit size." );
+        return;
+    }
+
     errno = 0;
-    int range_start = 0;
-    int range_end   = 0;
+    fit_height = strtol( pos + 1, &pos, 10 );
+    if ( errno != 0 || fit_height <= 0 || *pos != 0 ) {
+        option_failed( "Error reading fit size." );
+        return;
+    }
+
+    if ( fit_width > max_tex_size || fit_height > max_tex_size ) {
+        std::cerr << "Maximum texture size is " << max_tex_size << ". Clamping fit size." << std::endl;
+        fit_width = std::min( fit_width, max_tex_size );
+        fit_height = std::min( fit_height, max_tex_size );
+    }
+
+    fit_atlas = true;
+}
+
+void read_mode( ArgsParser *ap ) {
+    std::string mode = ap->word();
+    if ( mode == "stencil" ) {
+        sdf_mode = SdfMode::Stencil;
+    } else if ( mode == "quad" ) {
+        sdf_mode = SdfMode::GlyphQuad;
+    } else if ( mode == "compute" ) {
+        sdf_mode = SdfMode::Compute;
+    } else {
+        option_failed( "Unknown rendering mode '" + mode + "'" );
+        return;
+    }
+}
+
+void read_packer( ArgsParser *ap ) {
+    std::string packer = ap->word();
+    if ( packer == "shelf" ) {
+        packer_type = PackerType::Shelf;
+    } else if ( packer == "skyline" ) {
+        packer_type = PackerType::Skyline;
+    } else if ( packer == "maxrects" ) {
+        packer_type = PackerType::MaxRects;
+    } else {
+        option_failed( "Unknown packer '" + packer + "'" );
+        return;
+    }
+}
+
+void read_page_policy( ArgsParser *ap ) {
+    std::string policy = ap->word();
+    if ( policy == "fill" ) {
+        page_policy = PagePolicy::Fill;
+    } else if ( policy == "block" ) {
+        page_policy = PagePolicy::Block;
+    } else {
+        option_failed( "Unknown page policy '" + policy + "'" );
+        return;
+    }
+}
 
-    std::string nword = ap->word();
-    char *pos = const_cast<char*>( nword.c_str() );
+void read_sizes( ArgsParser *ap ) {
+    std::string sizes = ap->word();
+    const char *pos = sizes.c_str();
 
     for(;;) {
+        SizeConfig sc;
+        char *end = nullptr;
+
         errno = 0;
-        char *new_pos = pos;
-        range_start = strtol( pos, &new_pos, 0 );
-        if ( errno != 0 || range_start < 0 ) {
-            std::cerr << "Error reading unicode ranges" << std::endl;
-            exit( 1 );
+        sc.row_height = strtol( pos, &end, 10 );
+        if ( errno != 0 || sc.row_height <= 4 || *end != ':' ) {
+            option_failed( "Error reading sizes" );
+            return;
+        }
+
+        pos = end + 1;
+        errno = 0;
+        sc.border_size = strtol( pos, &end, 10 );
+        if ( errno != 0 || sc.border_size <= 0 ) {
+            option_failed( "Error reading sizes" );
+            return;
         }
-        range_end = range_start;
 
-        pos = new_pos;
+        size_configs.push_back( sc );
+
+        pos = end;
         char lim = *pos++;
+        if ( lim == 0 ) break;
+        if ( lim != ',' ) {
+            option_failed( "Error reading sizes" );
+            return;
+        }
+    }
+}
 
-        if ( lim == ':' ) {
-            errno = 0;
-            range_end = strtol( pos, &new_pos, 0 );
-            if ( errno != 0 || range_end < 0 ) {
-                std::cerr << "Error reading unicode ranges" << std::endl;
-                exit( 1 );
-            }
-            pos = new_pos;
-            lim = *pos++;
+void read_corpus( ArgsParser *ap ) {
+    std::unordered_map<uint32_t, size_t> &freq = corpus_freq;
+
+    std::string corpus_filename = ap->word();
+    std::ifstream corpus_file( corpus_filename, std::ios::binary );
+    if ( !corpus_file ) {
+        option_failed( "Error reading corpus file '" + corpus_filename + "'" );
+        return;
+    }
+
+    std::string text( ( std::istreambuf_iterator<char>( corpus_file ) ), std::istreambuf_iterator<char>() );
+    count_utf8( text, freq );
+    corpus_codepoints = frequency_order( freq );
+}
+
+void read_batch( ArgsParser *ap ) {
+    batch_filename = ap->word();
+}
+
+void read_serve( ArgsParser *ap ) {
+    socket_path = ap->word();
+}
+
+void read_stats( ArgsParser *ap ) {
+    stats_filename = ap->word();
+}
+
+void read_max_fonts( ArgsParser *ap ) {
+    errno = 0;
+    max_fonts = strtol( ap->word().c_str(), nullptr, 0 );
+    if ( errno != 0 || max_fonts <= 0 ) {
+        option_failed( "Error reading font cache size." );
+        return;
+    }
+}
+
+void read_tile_cache( ArgsParser *ap ) {
+    tile_cache_dir = ap->word();
+}
+
+void read_tile_cache_size( ArgsParser *ap ) {
+    errno = 0;
+    tile_cache_mb = strtol( ap->word().c_str(), nullptr, 0 );
+    if ( errno != 0 || tile_cache_mb <= 0 ) {
+        option_failed( "Error reading tile cache size." );
+        return;
+    }
+}
+
+void read_compare( ArgsParser * ) {
+    compare_modes = true;
+}
+
+void read_unicode_ranges( ArgsParser *ap ) {
+    if ( !parse_unicode_ranges( ap->word(), unicode_ranges ) ) {
+        option_failed( "Error reading unicode ranges" );
+        return;
+    }
+}
+
+// Saves the pages as 'name.png' ( or 'name_N.png' ) and the atlas JSON as 'name.js'
+
+struct FileSink : AtlasSink {
+    bool page( const AtlasOptions &options, const SdfAtlas &atlas, int page, std::vector<uint8_t> &png ) override {
+        std::string png_filename = options.name + ".png";
+        if ( atlas.page_count > 1 ) {
+            png_filename = options.name + "_" + std::to_string( page ) + ".png";
         }
-        
-        if ( lim == ',' ) {
-            unicode_ranges.push_back( UnicodeRange { (uint32_t) range_start, (uint32_t) range_end } );
-            continue;
-        } else if ( lim == 0 ) {
-            unicode_ranges.push_back( UnicodeRange { (uint32_t) range_start, (uint32_t) range_end } );
-            return;
+
+        std::ofstream png_file( png_filename, std::ios::binary );
+        png_file.write( (const char*) png.data(), png.size() );
+        if ( !png_file ) {
+            std::cout << "Error writing png file." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool atlas( const AtlasOptions &options, const SdfAtlas &atlas, int height ) override {
+        std::ofstream json_file( options.name + ".js" );
+        if ( !json_file ) {
+            std::cout << "Error writing json file." << std::endl;
+        }
+        json_file << atlas.json( height );
+        return true;
+    }
+};
+
+// Adds the atlases for the current options to the list, false with the error message on errors.
+// Batch jobs are planned on the tessellation thread, so the errors are left to the caller.
+
+bool plan_job( SdfGenerator &generator, std::vector<AtlasOptions> &atlases, std::string &error ) {
+
+    if ( filenames.empty() ) {
+        error = "Input file not specified";
+        return false;
+    }
+
+    const std::string& filename = filenames.front();
+
+    if ( res_filename.empty() ) {
+        size_t ext_dot = filename.find_last_of( "." );
+        if ( ext_dot == std::string::npos ) {
+            res_filename = filename;
         } else {
-            std::cerr << "Error reading unicode ranges" << std::endl;
-            exit( 1 );
+            res_filename = filename.substr( 0, ext_dot );
+        }
+    }
+
+    AtlasOptions options;
+
+    for ( const std::string &font_filename : filenames ) {
+        const Font *font = generator.load_font( font_filename );
+        if ( !font ) {
+            error = generator.error;
+            return false;
+        }
+        options.fonts.push_back( font );
+    }
+
+    if ( fit_atlas && !size_configs.empty() ) {
+        error = "Options '-fit' and '-sz' can't be used together";
+        return false;
+    }
+
+    if ( sdf_mode == SdfMode::Compute && !generator.sdf_gl.compute_supported ) {
+        error = "Compute rendering mode requires OpenGL 4.3.";
+        return false;
+    }
+
+    options.unicode_ranges = unicode_ranges;
+    options.corpus_codepoints = corpus_codepoints;
+    options.width = width;
+    options.tex_height = tex_height;
+    options.row_height = row_height;
+    options.border_size = border_size;
+    options.sdf_mode = sdf_mode;
+    options.packer_type = packer_type;
+    options.page_policy = page_policy;
+    options.compare_modes = compare_modes;
+    options.use_tile_cache = !tile_cache_dir.empty();
+    options.name = res_filename;
+
+    if ( fit_atlas ) {
+        if ( !generator.fit( options, fit_width, fit_height, border_set ) ) {
+            error = generator.error;
+            return false;
+        }
+        std::stringstream ss;
+        ss << "Fitted row height " << options.row_height << ", border size " << options.border_size << std::endl;
+        generator.message( ss.str() );
+    }
+
+    // The fonts and GL objects are shared between the sizes
+
+    if ( size_configs.empty() ) {
+        atlases.push_back( options );
+    } else {
+        for ( const SizeConfig &sc : size_configs ) {
+            options.row_height = sc.row_height;
+            options.border_size = sc.border_size;
+            options.name = res_filename + "_" + std::to_string( sc.row_height ) + "_" + std::to_string( sc.border_size );
+            atlases.push_back( options );
+        }
+    }
+
+    return true;
+}
+
+void generate( SdfGenerator &generator, const std::vector<AtlasOptions> &atlases ) {
+    FileSink sink;
+    if ( !generator.generate( atlases, sink ) ) {
+        std::cerr << generator.error << std::endl;
+        exit( 1 );
+    }
+}
+
+// Resets the options to the defaults between the batch jobs
+
+void reset_options() {
+    width = 1024;
+    tex_height = 0;
+    row_height = 96;
+    border_size = 16;
+    border_set = false;
+    fit_atlas = false;
+    fit_width = 0;
+    fit_height = 0;
+    sdf_mode = SdfMode::Stencil;
+    packer_type = PackerType::Shelf;
+    page_policy = PagePolicy::Fill;
+    compare_modes = false;
+    filenames.clear();
+    res_filename.clear();
+    unicode_ranges.clear();
+    size_configs.clear();
+    corpus_codepoints.clear();
+    corpus_freq.clear();
+    option_error.clear();
+}
+
+// Manifest job keys and the matching command line options
+
+struct JobKey {
+    const char *key;
+    const char *option;
+};
+
+const JobKey job_keys[] = {
+    { "font",        "-f" },
+    { "output",      "-o" },
+    { "width",       "-tw" },
+    { "height",      "-th" },
+    { "ranges",      "-ur" },
+    { "corpus",      "-c" },
+    { "border_size", "-bs" },
+    { "row_height",  "-rh" },
+    { "mode",        "-m" },
+    { "packer",      "-pk" },
+    { "page_policy", "-pp" },
+    { "sizes",       "-sz" },
+    { "fit",         "-fit" },
+    { "compare",     "-cmp" }
+};
+
+// Appends the command line words for a job key value, arrays repeat the option
+
+void job_words( const std::string &key, const JsonValue &value, std::vector<std::string> &words ) {
+    const char *option = nullptr;
+    for ( const JobKey &jk : job_keys ) {
+        if ( key == jk.key ) option = jk.option;
+    }
+
+    if ( !option ) {
+        std::cerr << "Unknown manifest key '" << key << "'" << std::endl;
+        exit( 1 );
+    }
+
+    switch ( value.type ) {
+    case JsonValue::Bool:
+        if ( value.boolean ) words.push_back( option );
+        break;
+    case JsonValue::Number: {
+        char num[ 32 ];
+        snprintf( num, 32, "%.0f", value.number );
+        words.push_back( option );
+        words.push_back( num );
+        break;
+    }
+    case JsonValue::String:
+        words.push_back( option );
+        words.push_back( value.str );
+        break;
+    case JsonValue::Array:
+        for ( const JsonValue &item : value.array ) {
+            job_words( key, item, words );
+        }
+        break;
+    default:
+        std::cerr << "Bad value of manifest key '" << key << "'" << std::endl;
+        exit( 1 );
+    }
+}
+
+// File sink timing the batch jobs from their planning to their last atlas
+
+struct BatchSink : FileSink {
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex                     mutex;
+    std::vector<Clock::time_point> job_starts;
+    std::vector<size_t>            job_ends;        // Atlas count after the job
+    std::vector<double>            job_times;
+    size_t                         atlas_count = 0;
+
+    bool atlas( const AtlasOptions &options, const SdfAtlas &atlas, int height ) override {
+        bool ok = FileSink::atlas( options, atlas, height );
+
+        std::lock_guard<std::mutex> lock( mutex );
+        atlas_count++;
+        while ( job_times.size() < job_ends.size() && job_ends[ job_times.size() ] <= atlas_count ) {
+            job_times.push_back( std::chrono::duration<double>( Clock::now() - job_starts[ job_times.size() ] ).count() );
         }
+        return ok;
     }
 };
 
-void render() {
-    glClearColor( 0.0, 0.0, 0.0, 0.0 );
-    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+// Manifest: { "defaults": { job keys }, "jobs": [ { job keys }, ... ] }
+// Job keys override the defaults. Fonts are loaded once per path,
+// the GL context, programs and framebuffer are shared between the jobs.
+
+void run_batch( SdfGenerator &generator, const std::string &manifest_filename ) {
+    std::ifstream manifest_file( manifest_filename, std::ios::binary );
+    if ( !manifest_file ) {
+        std::cerr << "Error reading manifest '" << manifest_filename << "'" << std::endl;
+        exit( 1 );
+    }
+
+    std::string text( ( std::istreambuf_iterator<char>( manifest_file ) ), std::istreambuf_iterator<char>() );
+    JsonValue manifest;
+    std::string error;
+    if ( !parse_json( text, manifest, error ) ) {
+        std::cerr << "Error parsing manifest: " << error << std::endl;
+        exit( 1 );
+    }
+
+    const JsonValue *defaults = manifest.find( "defaults" );
+    const JsonValue *jobs = manifest.find( "jobs" );
+    if ( !jobs || jobs->type != JsonValue::Array ) {
+        std::cerr << "Manifest has no 'jobs' array" << std::endl;
+        exit( 1 );
+    }
+
+    using Clock = BatchSink::Clock;
+    auto seconds = []( Clock::time_point t0, Clock::time_point t1 ) {
+        return std::chrono::duration<double>( t1 - t0 ).count();
+    };
+
+    Clock::time_point batch_start = Clock::now();
+
+    // Command line words of the jobs, the manifest errors are found before the generation
+
+    std::vector<std::vector<std::string>> job_args;
+
+    for ( const JsonValue &job : jobs->array ) {
+        std::vector<std::string> words { "sdf_atlas" };
+        if ( defaults ) {
+            for ( const auto &kv : defaults->object ) {
+                if ( !job.find( kv.first ) ) job_words( kv.first, kv.second, words );
+            }
+        }
+        for ( const auto &kv : job.object ) {
+            job_words( kv.first, kv.second, words );
+        }
+        job_args.push_back( std::move( words ) );
+    }
+
+    // Jobs are planned on the tessellation thread as they enter the pipeline, so the font
+    // loading and layout of a job overlap with the rendering and encoding of the previous ones.
+    // A job error stops the generation, it's reported after generate() returns.
+
+    BatchSink sink;
+    size_t    next_job = 0;
+    size_t    atlas_count = 0;
+    double    planning = 0.0;
+
+    auto plan_next = [&]( std::vector<AtlasOptions> &atlases ) {
+        if ( next_job == job_args.size() ) return true;
 
-    F2 tex_size = F2( width, height );
+        Clock::time_point job_start = Clock::now();
+        std::vector<std::string> &words = job_args[ next_job++ ];
 
-    glViewport( 0, 0, width, height );
-    sdf_gl.render_sdf( tex_size, gp.fp.vertices, gp.lp.vertices );
+        std::vector<char*> job_argv;
+        for ( std::string &w : words ) job_argv.push_back( &w[ 0 ] );
+
+        reset_options();
+        bool parsed = args.run( job_argv.size(), job_argv.data() );
+        if ( !option_error.empty() ) return generator.fail( option_error );
+        if ( !parsed ) return generator.fail( "Error reading the job options" );
+
+        std::string error;
+        if ( !plan_job( generator, atlases, error ) ) return generator.fail( error );
+        atlas_count += atlases.size();
+        planning += seconds( job_start, Clock::now() );
+
+        std::lock_guard<std::mutex> lock( sink.mutex );
+        sink.job_starts.push_back( job_start );
+        sink.job_ends.push_back( atlas_count );
+        return true;
+    };
+
+    if ( !generator.generate( plan_next, sink ) ) {
+        std::cerr << generator.error << std::endl;
+        exit( 1 );
+    }
+
+    double total = seconds( batch_start, Clock::now() );
+    size_t job_count = jobs->array.size();
+    double slowest = sink.job_times.empty() ? 0.0 : *std::max_element( sink.job_times.begin(), sink.job_times.end() );
+
+    std::cout << "Batch: " << job_count << " jobs, " << atlas_count << " atlases, " << generator.fonts.size() << " fonts loaded, ";
+    std::cout << "planning " << planning << " s, ";
+    std::cout << "total " << total << " s, ";
+    std::cout << "average " << ( job_count ? total / job_count : 0.0 ) << " s, ";
+    std::cout << "slowest " << slowest << " s" << std::endl;
+}
+
+void stop_server( int ) {
+    server.stop();
 }
 
+// Serves the requests until a signal, the generator keeps the fonts and GL objects warm
+
+void run_server( SdfGenerator &generator ) {
+    std::string error;
+    if ( !server.init( generator, socket_path, error ) ) {
+        std::cerr << error << std::endl;
+        exit( 1 );
+    }
+
+    generator.log = nullptr;
+    generator.max_fonts = max_fonts;
 
+    signal( SIGINT, stop_server );
+    signal( SIGTERM, stop_server );
+
+    std::cout << "Serving on '" << socket_path << "'" << std::endl;
+    server.run();
+    std::cout << "Served " << server.served << " requests, " << server.failed << " failed" << std::endl;
+}
 
 int main( int argc, char* argv[] ) {
     if ( argc == 1 ) {
@@ -223,9 +761,19 @@ int main( int argc, char* argv[] ) {
         exit( 1 );
     }
 
+    SdfGenerator generator;
+    if ( !generator.init() ) {
+        std::cerr << "Error creating the shader programs" << std::endl;
+        exit( 1 );
+    }
+
+    generator.log = []( const std::string &text ) {
+        std::cout << text;
+    };
+
     // Reading command line parameters
 
-    glGetIntegerv( GL_MAX_RENDERBUFFER_SIZE, &max_tex_size );
+    max_tex_size = generator.max_tex_size;
 
     args.commands["-h"]  = show_help;    
     args.commands["-f"]  = read_filename;
@@ -235,125 +783,74 @@ int main( int argc, char* argv[] ) {
     args.commands["-ur"] = read_unicode_ranges;
     args.commands["-bs"] = read_border_size;
     args.commands["-rh"] = read_row_height;
+    args.commands["-m"]  = read_mode;
+    args.commands["-pk"] = read_packer;
+    args.commands["-pp"] = read_page_policy;
+    args.commands["-sz"] = read_sizes;
+    args.commands["-c"]  = read_corpus;
+    args.commands["-fit"] = read_fit;
+    args.commands["--fit"] = read_fit;
+    args.commands["-cmp"] = read_compare;
+    args.commands["-tc"] = read_tile_cache;
+    args.commands["-tcs"] = read_tile_cache_size;
+    args.commands["-b"]  = read_batch;
+    args.commands["--batch"] = read_batch;
+    args.commands["-s"]  = read_serve;
+    args.commands["--serve"] = read_serve;
+    args.commands["-fc"] = read_max_fonts;
+    args.commands["-st"] = read_stats;
+    args.commands["--stats"] = read_stats;
     args.run( argc, argv );
 
-    if ( filename.empty() ) {
-        std::cerr << "Input file not specified" << std::endl;
+    if ( !option_error.empty() ) {
+        std::cerr << option_error << std::endl;
         exit( 1 );
     }
 
-    if ( res_filename.empty() ) {
-        size_t ext_dot = filename.find_last_of( "." );
-        if ( ext_dot == std::string::npos ) {
-            res_filename = filename;
-        } else {
-            res_filename = filename.substr( 0, ext_dot );
-        }
+    if ( !stats_filename.empty() && socket_path.empty() ) {
+        generator.stats = &stats;
     }
 
-    if ( !font.load_ttf_file( filename.c_str() ) ) {
-        std::cerr << "Error reading TTF file '" << filename << "' " << std::endl;
-        exit( 1 );
+    if ( !tile_cache_dir.empty() ) {
+        if ( !tile_cache.init( tile_cache_dir, (size_t) tile_cache_mb << 20 ) ) {
+            std::cerr << "Error creating tile cache directory '" << tile_cache_dir << "'" << std::endl;
+            exit( 1 );
+        }
+        generator.tile_cache = &tile_cache;
     }
 
-    // Allocating glyph rects
-
-    sdf_atlas.init( &font, width, row_height, border_size );
-
-    if ( unicode_ranges.empty() ) {
-        sdf_atlas.allocate_unicode_range( 0x21, 0x7e );
-        sdf_atlas.allocate_unicode_range( 0xffff, 0xffff );
+    if ( !socket_path.empty() ) {
+        run_server( generator );
+    } else if ( !batch_filename.empty() ) {
+        run_batch( generator, batch_filename );
     } else {
-        for ( const UnicodeRange& ur : unicode_ranges ) {
-            sdf_atlas.allocate_unicode_range( ur.start, ur.end );
+        std::vector<AtlasOptions> atlases;
+        std::string error;
+        if ( !plan_job( generator, atlases, error ) ) {
+            std::cerr << error << std::endl;
+            exit( 1 );
         }
-    }
-    
-    sdf_atlas.draw_glyphs( gp );
-
-    std::cout << "Allocated " << sdf_atlas.glyph_count << " glyphs" << std::endl;
-    std::cout << "Atlas maximum height is " << sdf_atlas.max_height << std::endl;
-
-    if ( height == 0 ) {
-        height = sdf_atlas.max_height;
-    }
-
-    uint8_t* picbuf = (uint8_t*) malloc( width * height );
-
-    // GL initialization
-    
-    sdf_gl.init();    
-
-    GLuint rbcolor;
-    glGenRenderbuffers( 1, &rbcolor );
-    glBindRenderbuffer( GL_RENDERBUFFER, rbcolor );
-    glRenderbufferStorage( GL_RENDERBUFFER, GL_RED, width, height );
-    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
-
-    GLuint rbds;
-    glGenRenderbuffers( 1, &rbds );
-    glBindRenderbuffer( GL_RENDERBUFFER, rbds );
-    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_STENCIL, width, height );
-    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
-
-    GLuint fbo;
-    glGenFramebuffers( 1, &fbo );
-    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
-    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbcolor );
-    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbds );
-
-    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
-        std::cerr << "Error creating framebuffer!" << std::endl;
-        exit( 1 );
+        generate( generator, atlases );
     }
 
-    // Rendering glyphs
-
-    glViewport( 0, 0, width, height );
-    glClearColor( 0.0, 0.0, 0.0, 0.0 );
-    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
-    sdf_gl.render_sdf( F2( width, height ), gp.fp.vertices, gp.lp.vertices );
-
-    glReadPixels( 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, picbuf );
-
-    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
-    glFinish();
-
-    // Flipping the picture vertically
-
-    uint8_t *row_swap = (uint8_t*) malloc( width );
-
-    for ( int iy = 0; iy < height / 2; ++iy ) {
-        uint8_t* row0 = picbuf + iy * width;
-        uint8_t* row1 = picbuf + ( height - 1 - iy ) * width;
-        memcpy( row_swap, row0, width );
-        memcpy( row0, row1, width );
-        memcpy( row1, row_swap, width );
+    if ( !tile_cache_dir.empty() ) {
+        size_t trimmed = tile_cache.trim();
+        std::cout << "Tile cache: " << tile_cache.hits << " hits, " << tile_cache.misses << " misses, ";
+        std::cout << tile_cache.stored << " stored, " << trimmed << " trimmed" << std::endl;
     }
 
-    free( row_swap );
-
-    // Saving the picture
+    if ( generator.stats ) {
+        std::cout << std::endl << stats.table();
 
-    std::string png_filename = res_filename + ".png";
-    if ( !stbi_write_png( png_filename.c_str(), width, height, 1, picbuf, width ) ) {
-        std::cout << "Error writing png file." << std::endl;
-        exit( 1 );
+        std::ofstream stats_file( stats_filename );
+        stats_file << stats.json();
+        if ( !stats_file ) {
+            std::cerr << "Error writing stats file '" << stats_filename << "'" << std::endl;
+            exit( 1 );
+        }
     }
 
-    free( picbuf );
-
-    // Saving JSON
-
-    std::string json = sdf_atlas.json( height );
-    std::ofstream json_file;
-    json_file.open( res_filename + ".js" );
-    if ( !json_file ) {
-        std::cout << "Error writing json file." << std::endl;
-    }
-    json_file << json;
-    json_file.close();
-    
+    generator.destroy();
     glfwTerminate();
     
     return 0;
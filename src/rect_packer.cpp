@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rect_packer.h"
+
+#include <algorithm>
+#include <climits>
+
+void RectPacker::init( int width, int max_height ) {
+    this->width = width;
+    this->max_height = max_height;
+    height = 0;
+}
+
+std::unique_ptr<RectPacker> RectPacker::create( PackerType type ) {
+    switch ( type ) {
+    case PackerType::Skyline:
+        return std::unique_ptr<RectPacker>( new SkylinePacker() );
+    case PackerType::MaxRects:
+        return std::unique_ptr<RectPacker>( new MaxRectsPacker() );
+    default:
+        return std::unique_ptr<RectPacker>( new ShelfPacker() );
+    }
+}
+
+// Shelf
+
+void ShelfPacker::init( int width, int max_height ) {
+    RectPacker::init( width, max_height );
+    posx = 0;
+    posy = 0;
+    shelf_height = 0;
+}
+
+bool ShelfPacker::insert( int w, int h, int &x, int &y ) {
+    if ( w > width ) return false;
+
+    if ( posx + w > width ) {
+        posx = 0;
+        posy += shelf_height;
+        shelf_height = 0;
+    }
+
+    if ( posy + h > max_height ) return false;
+
+    x = posx;
+    y = posy;
+    posx += w;
+    shelf_height = std::max( shelf_height, h );
+    height = std::max( height, posy + h );
+
+    return true;
+}
+
+std::unique_ptr<RectPacker> ShelfPacker::clone() const {
+    return std::unique_ptr<RectPacker>( new ShelfPacker( *this ) );
+}
+
+// Skyline
+
+void SkylinePacker::init( int width, int max_height ) {
+    RectPacker::init( width, max_height );
+    skyline.clear();
+    skyline.push_back( { 0, 0, width } );
+}
+
+int SkylinePacker::fit( size_t inode, int w, int h ) const {
+    int x = skyline[ inode ].x;
+    if ( x + w > width ) return -1;
+
+    int y = 0;
+    int w_left = w;
+
+    for ( size_t i = inode; w_left > 0; ++i ) {
+        y = std::max( y, skyline[ i ].y );
+        if ( y + h > max_height ) return -1;
+        w_left -= skyline[ i ].w;
+    }
+
+    return y;
+}
+
+bool SkylinePacker::insert( int w, int h, int &x, int &y ) {
+    int    best_top = INT_MAX;
+    int    best_x = 0;
+    size_t best_node = 0;
+
+    for ( size_t i = 0; i < skyline.size(); ++i ) {
+        int fy = fit( i, w, h );
+        if ( fy < 0 ) continue;
+        if ( fy + h < best_top || ( fy + h == best_top && skyline[ i ].x < best_x ) ) {
+            best_top = fy + h;
+            best_x = skyline[ i ].x;
+            best_node = i;
+        }
+    }
+
+    if ( best_top == INT_MAX ) return false;
+
+    x = best_x;
+    y = best_top - h;
+
+    // Inserting the new node and shrinking the nodes it covers
+
+    skyline.insert( skyline.begin() + best_node, Node { x, best_top, w } );
+
+    for ( size_t i = best_node + 1; i < skyline.size(); ) {
+        Node &prev = skyline[ i - 1 ];
+        Node &node = skyline[ i ];
+        int shrink = prev.x + prev.w - node.x;
+        if ( shrink <= 0 ) break;
+        if ( shrink < node.w ) {
+            node.x += shrink;
+            node.w -= shrink;
+            break;
+        }
+        skyline.erase( skyline.begin() + i );
+    }
+
+    // Merging the nodes of the same height
+
+    for ( size_t i = 1; i < skyline.size(); ) {
+        if ( skyline[ i - 1 ].y == skyline[ i ].y ) {
+            skyline[ i - 1 ].w += skyline[ i ].w;
+            skyline.erase( skyline.begin() + i );
+        } else {
+            ++i;
+        }
+    }
+
+    height = std::max( height, best_top );
+
+    return true;
+}
+
+std::unique_ptr<RectPacker> SkylinePacker::clone() const {
+    return std::unique_ptr<RectPacker>( new SkylinePacker( *this ) );
+}
+
+// MaxRects
+
+void MaxRectsPacker::init( int width, int max_height ) {
+    RectPacker::init( width, max_height );
+    free_rects.clear();
+    free_rects.push_back( { 0, 0, width, max_height } );
+}
+
+bool MaxRectsPacker::insert( int w, int h, int &x, int &y ) {
+    int best_top = INT_MAX;
+    int best_x = INT_MAX;
+
+    for ( const Rect &fr : free_rects ) {
+        if ( w > fr.w || h > fr.h ) continue;
+        int top = fr.y + h;
+        if ( top < best_top || ( top == best_top && fr.x < best_x ) ) {
+            best_top = top;
+            best_x = fr.x;
+        }
+    }
+
+    if ( best_top == INT_MAX ) return false;
+
+    x = best_x;
+    y = best_top - h;
+
+    split_free_rects( Rect { x, y, w, h } );
+    prune_free_rects();
+
+    height = std::max( height, best_top );
+
+    return true;
+}
+
+std::unique_ptr<RectPacker> MaxRectsPacker::clone() const {
+    return std::unique_ptr<RectPacker>( new MaxRectsPacker( *this ) );
+}
+
+void MaxRectsPacker::split_free_rects( const Rect &used ) {
+    std::vector<Rect> split;
+    split.reserve( free_rects.size() + 4 );
+
+    for ( const Rect &fr : free_rects ) {
+        if ( used.x >= fr.x + fr.w || used.x + used.w <= fr.x ||
+             used.y >= fr.y + fr.h || used.y + used.h <= fr.y ) {
+            split.push_back( fr );
+            continue;
+        }
+
+        // Maximal free rects left over around the used rect
+
+        if ( used.x > fr.x ) {
+            split.push_back( { fr.x, fr.y, used.x - fr.x, fr.h } );
+        }
+        if ( used.x + used.w < fr.x + fr.w ) {
+            split.push_back( { used.x + used.w, fr.y, fr.x + fr.w - used.x - used.w, fr.h } );
+        }
+        if ( used.y > fr.y ) {
+            split.push_back( { fr.x, fr.y, fr.w, used.y - fr.y } );
+        }
+        if ( used.y + used.h < fr.y + fr.h ) {
+            split.push_back( { fr.x, used.y + used.h, fr.w, fr.y + fr.h - used.y - used.h } );
+        }
+    }
+
+    free_rects.swap( split );
+}
+
+void MaxRectsPacker::prune_free_rects() {
+    auto contains = []( const Rect &a, const Rect &b ) {
+        return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+    };
+
+    for ( size_t i = 0; i < free_rects.size(); ++i ) {
+        for ( size_t j = i + 1; j < free_rects.size(); ) {
+            if ( contains( free_rects[ i ], free_rects[ j ] ) ) {
+                free_rects.erase( free_rects.begin() + j );
+            } else if ( contains( free_rects[ j ], free_rects[ i ] ) ) {
+                free_rects.erase( free_rects.begin() + i );
+                j = i + 1;
+            } else {
+                ++j;
+            }
+        }
+    }
+}
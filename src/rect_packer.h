@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+// Rect packing strategies:
+// Shelf    - rows of rects, a new row starts when the current one is full
+// Skyline  - bottom-left placement over the skyline of the packed rects
+// MaxRects - bottom-left placement over the list of maximal free rects
+
+enum class PackerType {
+    Shelf, Skyline, MaxRects
+};
+
+struct RectPacker {
+    int width      = 0;
+    int max_height = 0;
+    int height     = 0;     // Packed height
+
+    virtual ~RectPacker() {}
+
+    virtual void init( int width, int max_height );
+
+    // Returns false if the rect doesn't fit
+    virtual bool insert( int w, int h, int &x, int &y ) = 0;
+
+    virtual std::unique_ptr<RectPacker> clone() const = 0;
+
+    static std::unique_ptr<RectPacker> create( PackerType type );
+};
+
+struct ShelfPacker : RectPacker {
+    int posx = 0;
+    int posy = 0;
+    int shelf_height = 0;
+
+    void init( int width, int max_height ) override;
+
+    bool insert( int w, int h, int &x, int &y ) override;
+
+    std::unique_ptr<RectPacker> clone() const override;
+};
+
+struct SkylinePacker : RectPacker {
+    struct Node {
+        int x, y, w;
+    };
+
+    std::vector<Node> skyline;
+
+    void init( int width, int max_height ) override;
+
+    bool insert( int w, int h, int &x, int &y ) override;
+
+    std::unique_ptr<RectPacker> clone() const override;
+
+    // Lowest y for the rect starting at the node inode, -1 if it doesn't fit
+    int fit( size_t inode, int w, int h ) const;
+};
+
+struct MaxRectsPacker : RectPacker {
+    struct Rect {
+        int x, y, w, h;
+    };
+
+    std::vector<Rect> free_rects;
+
+    void init( int width, int max_height ) override;
+
+    bool insert( int w, int h, int &x, int &y ) override;
+
+    std::unique_ptr<RectPacker> clone() const override;
+
+    void split_free_rects( const Rect &used );
+
+    void prune_free_rects();
+};
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "runtime_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool AtlasTarget::init( SdfGl &sdf_gl, int width, int height, SdfMode mode ) {
+    if ( mode == SdfMode::Compute ) return false;
+
+    this->sdf_gl = &sdf_gl;
+    this->mode = mode;
+    if ( !gp.cache ) gp.cache = &tessellation_cache;
+    this->width = width;
+    this->height = height;
+
+    glGenTextures( 1, &texture );
+    glBindTexture( GL_TEXTURE_2D, texture );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    glGenRenderbuffers( 1, &rbds );
+    glBindRenderbuffer( GL_RENDERBUFFER, rbds );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_STENCIL, width, height );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    glGenFramebuffers( 1, &fbo );
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0 );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbds );
+    bool complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+
+    glClearColor( 0.0, 0.0, 0.0, 0.0 );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+    return complete;
+}
+
+void AtlasTarget::render( const SdfAtlas &atlas, const std::vector<bool> &skip, const DirtyRect *rects, size_t rect_count ) {
+    if ( rect_count == 0 ) return;
+
+    // Clearing the rects only, the line pass depth test and the stencil fill
+    // stay inside the glyph rects, so the other glyphs are left intact
+
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+    glEnable( GL_SCISSOR_TEST );
+    glClearColor( 0.0, 0.0, 0.0, 0.0 );
+
+    int bx0 = width, by0 = height, bx1 = 0, by1 = 0;
+
+    for ( size_t irect = 0; irect < rect_count; ++irect ) {
+        const DirtyRect &dr = rects[ irect ];
+        glScissor( dr.x, dr.y, dr.w, dr.h );
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+
+        bx0 = std::min( bx0, dr.x );
+        by0 = std::min( by0, dr.y );
+        bx1 = std::max( bx1, dr.x + dr.w );
+        by1 = std::max( by1, dr.y + dr.h );
+    }
+
+    gp.clear();
+    gp.mode = mode;
+    atlas.draw_glyphs( gp, 0, &skip );
+
+    glScissor( bx0, by0, bx1 - bx0, by1 - by0 );
+
+    F2 tex_size = F2( width, height );
+
+    if ( mode == SdfMode::Stencil ) {
+        sdf_gl->render_sdf( tex_size, gp.fp.vertices, gp.lp.rects, gp.clips );
+    } else {
+        sdf_gl->render_sdf_quads( tex_size, atlas.sdf_size, gp.sp.segments, gp.sp.vertices );
+    }
+
+    glDisable( GL_SCISSOR_TEST );
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+void AtlasTarget::read_rect( const DirtyRect &rect, uint8_t *pixels ) {
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+    glReadPixels( rect.x, rect.y, rect.w, rect.h, GL_RED, GL_UNSIGNED_BYTE, pixels );
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+void AtlasTarget::destroy() {
+    glDeleteFramebuffers( 1, &fbo );
+    glDeleteRenderbuffers( 1, &rbds );
+    glDeleteTextures( 1, &texture );
+    fbo = rbds = texture = 0;
+}
+
+bool RuntimeAtlas::init( SdfGl &sdf_gl, const std::vector<const Font*> &fonts, int width, int height, float row_height, float sdf_size,
+                         SdfMode mode, PackerType packer_type ) {
+    atlas.init( fonts, width, row_height, sdf_size, packer_type );
+    atlas.page_count = 1;
+
+    packer = RectPacker::create( packer_type );
+    packer->init( width, height );
+    codepoints.clear();
+
+    return target.init( sdf_gl, width, height, mode );
+}
+
+bool RuntimeAtlas::add_codepoints( const std::vector<uint32_t> &new_codepoints, std::vector<DirtyRect> &dirty ) {
+    size_t first_rect = atlas.glyph_rects.size();
+    bool   all_fit = true;
+
+    // Packing the new unique rects, aliases take the position of their source
+
+    for ( uint32_t cp : new_codepoints ) {
+        if ( !codepoints.emplace( cp, -1 ).second ) continue;
+
+        size_t rect_count = atlas.glyph_rects.size();
+        atlas.allocate_codepoint( cp );
+        if ( atlas.glyph_rects.size() == rect_count ) continue;
+
+        codepoints[ cp ] = rect_count;
+
+        GlyphRect &gr = atlas.glyph_rects.back();
+
+        if ( gr.source != -1 ) {
+            const GlyphRect &src = atlas.glyph_rects[ gr.source ];
+            gr.x0 = src.x0;
+            gr.y0 = src.y0;
+            gr.x1 = src.x1;
+            gr.y1 = src.y1;
+            continue;
+        }
+
+        float w = gr.x1 - gr.x0;
+        float h = gr.y1 - gr.y0;
+        int x, y;
+        if ( !packer->insert( ceil( w ), ceil( h ), x, y ) ) {
+            atlas.remove_last_rect();
+            codepoints.erase( cp );
+            all_fit = false;
+            continue;
+        }
+
+        gr.x0 = x;
+        gr.y0 = y;
+        gr.x1 = x + w;
+        gr.y1 = y + h;
+        atlas.max_height = std::max( atlas.max_height, (int) ceil( gr.y1 ) );
+    }
+
+    // Rendering the new unique rects
+
+    std::vector<bool> skip( atlas.glyph_rects.size(), true );
+    size_t first_dirty = dirty.size();
+
+    for ( size_t irect = first_rect; irect < atlas.glyph_rects.size(); ++irect ) {
+        const GlyphRect &gr = atlas.glyph_rects[ irect ];
+        if ( gr.source != -1 ) continue;
+
+        skip[ irect ] = false;
+
+        DirtyRect dr;
+        dr.x = gr.x0;
+        dr.y = gr.y0;
+        dr.w = std::min( (int) ceil( gr.x1 - gr.x0 ), target.width - dr.x );
+        dr.h = std::min( (int) ceil( gr.y1 - gr.y0 ), target.height - dr.y );
+        dirty.push_back( dr );
+    }
+
+    target.render( atlas, skip, dirty.data() + first_dirty, dirty.size() - first_dirty );
+
+    return all_fit;
+}
+
+const GlyphRect* RuntimeAtlas::find( uint32_t codepoint ) const {
+    auto cit = codepoints.find( codepoint );
+    return cit == codepoints.end() || cit->second == -1 ? nullptr : &atlas.glyph_rects[ cit->second ];
+}
+
+void RuntimeAtlas::destroy() {
+    target.destroy();
+    packer.reset();
+}
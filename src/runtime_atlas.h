@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "sdf_atlas.h"
+#include "rect_packer.h"
+
+// Atlas built at runtime as new text appears. add_codepoints() allocates and packs
+// only the new glyphs and renders them into the persistent GL_R8 texture, scissored
+// to the new rects. Placed glyphs never move, so the texcoords taken from the
+// previous json() or glyph_rects stay valid.
+//
+// Requires a current GL context and initialized SdfGl. Compute mode writes the whole
+// texture, so only Stencil and GlyphQuad modes are supported.
+
+struct DirtyRect {
+    int x, y, w, h;     // Pixels, y from the bottom row of the texture as in glReadPixels
+};
+
+// Persistent GL_R8 texture with a depth stencil buffer, rendered by rects
+
+struct AtlasTarget {
+    SdfGl       *sdf_gl = nullptr;
+    SdfMode      mode = SdfMode::Stencil;
+    GlyphPainter gp;                // Uses the own tessellation cache, can be pointed to a shared one
+    TessellationCache tessellation_cache;
+
+    int          width = 0;
+    int          height = 0;
+
+    GLuint       texture = 0;   // GL_R8 SDF texture
+    GLuint       rbds = 0;
+    GLuint       fbo = 0;
+
+    // Returns false for the Compute mode or an incomplete framebuffer
+    bool init( SdfGl &sdf_gl, int width, int height, SdfMode mode );
+
+    // Clears the rects and draws the atlas glyphs not marked in 'skip', scissored to the rects bounds.
+    // Drawing stays inside the glyph rects, so the rest of the texture is left intact.
+    void render( const SdfAtlas &atlas, const std::vector<bool> &skip, const DirtyRect *rects, size_t rect_count );
+
+    // Reads the rect pixels from the texture, rows bottom to top
+    void read_rect( const DirtyRect &rect, uint8_t *pixels );
+
+    void destroy();
+};
+
+struct RuntimeAtlas {
+    SdfAtlas     atlas;
+    AtlasTarget  target;
+
+    std::unique_ptr<RectPacker>  packer;
+    std::unordered_map<uint32_t, int> codepoints;   // Requested codepoint -> rect, -1 for the ones without a glyph
+
+    // Creates width x height texture and framebuffer. Returns false for the Compute mode
+    // or an incomplete framebuffer.
+    bool init( SdfGl &sdf_gl, const std::vector<const Font*> &fonts, int width, int height, float row_height, float sdf_size,
+               SdfMode mode = SdfMode::Stencil, PackerType packer_type = PackerType::Skyline );
+
+    // Allocates, packs and renders the codepoints not in the atlas yet, appends the rendered rects to 'dirty'.
+    // Returns false if some glyphs didn't fit, the ones that fit are still added.
+    bool add_codepoints( const std::vector<uint32_t> &new_codepoints, std::vector<DirtyRect> &dirty );
+
+    // Rect of an added codepoint, nullptr if it has no glyph or wasn't added
+    const GlyphRect* find( uint32_t codepoint ) const;
+
+    void read_rect( const DirtyRect &rect, uint8_t *pixels ) {
+        target.read_rect( rect, pixels );
+    }
+
+    void destroy();
+};
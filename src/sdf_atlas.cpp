@@ -23,60 +23,166 @@
 #include "sdf_atlas.h"
 
 #include <algorithm>
-#include <unordered_set>
 #include <iostream>
 #include <sstream>
 
-void SdfAtlas::init( Font *font, float tex_width, float row_height, float sdf_size ) {
-    this->font = font;
+// Unicode block starts, coarse outside of the BMP
+
+static const uint32_t unicode_blocks[] = {
+    0x0000, 0x0080, 0x0100, 0x0180, 0x0250, 0x02B0, 0x0300, 0x0370, 0x0400, 0x0500, 0x0530, 0x0590,
+    0x0600, 0x0700, 0x0750, 0x0780, 0x07C0, 0x0800, 0x0840, 0x0860, 0x0870, 0x08A0, 0x0900, 0x0980,
+    0x0A00, 0x0A80, 0x0B00, 0x0B80, 0x0C00, 0x0C80, 0x0D00, 0x0D80, 0x0E00, 0x0E80, 0x0F00, 0x1000,
+    0x10A0, 0x1100, 0x1200, 0x1380, 0x13A0, 0x1400, 0x1680, 0x16A0, 0x1700, 0x1720, 0x1740, 0x1760,
+    0x1780, 0x1800, 0x18B0, 0x1900, 0x1950, 0x1980, 0x19E0, 0x1A00, 0x1A20, 0x1AB0, 0x1B00, 0x1B80,
+    0x1BC0, 0x1C00, 0x1C50, 0x1C80, 0x1C90, 0x1CC0, 0x1CD0, 0x1D00, 0x1D80, 0x1DC0, 0x1E00, 0x1F00,
+    0x2000, 0x2070, 0x20A0, 0x20D0, 0x2100, 0x2150, 0x2190, 0x2200, 0x2300, 0x2400, 0x2440, 0x2460,
+    0x2500, 0x2580, 0x25A0, 0x2600, 0x2700, 0x27C0, 0x27F0, 0x2800, 0x2900, 0x2980, 0x2A00, 0x2B00,
+    0x2C00, 0x2C60, 0x2C80, 0x2D00, 0x2D30, 0x2D80, 0x2DE0, 0x2E00, 0x2E80, 0x2F00, 0x2FF0, 0x3000,
+    0x3040, 0x30A0, 0x3100, 0x3130, 0x3190, 0x31A0, 0x31C0, 0x31F0, 0x3200, 0x3300, 0x3400, 0x4DC0,
+    0x4E00, 0xA000, 0xA490, 0xA4D0, 0xA500, 0xA640, 0xA6A0, 0xA700, 0xA720, 0xA800, 0xA830, 0xA840,
+    0xA880, 0xA8E0, 0xA900, 0xA930, 0xA960, 0xA980, 0xA9E0, 0xAA00, 0xAA60, 0xAA80, 0xAAE0, 0xAB00,
+    0xAB30, 0xAB70, 0xABC0, 0xAC00, 0xD7B0, 0xD800, 0xE000, 0xF900, 0xFB00, 0xFB50, 0xFE00, 0xFE10,
+    0xFE20, 0xFE30, 0xFE50, 0xFE70, 0xFF00, 0xFFF0, 0x10000, 0x10100, 0x10300, 0x10800, 0x11000,
+    0x12000, 0x13000, 0x16800, 0x17000, 0x1B000, 0x1D000, 0x1D400, 0x1E800, 0x1F000, 0x1F100, 0x1F300,
+    0x1F600, 0x1F680, 0x1F700, 0x1F900, 0x20000, 0x2A700, 0x2F800, 0x30000, 0xE0000, 0xF0000
+};
+
+static uint32_t unicode_block( uint32_t codepoint ) {
+    const uint32_t *end = unicode_blocks + sizeof( unicode_blocks ) / sizeof( unicode_blocks[ 0 ] );
+    const uint32_t *it = std::upper_bound( unicode_blocks, end, codepoint );
+    return *( it - 1 );
+}
+
+void SdfAtlas::init( const std::vector<const Font*> &fonts, float tex_width, float row_height, float sdf_size, PackerType packer_type, PagePolicy page_policy ) {
+    this->fonts = fonts;
 
     glyph_rects.clear();
 
-    this->tex_width  = tex_width;
-    this->row_height = row_height;
-    this->sdf_size   = sdf_size;
+    this->tex_width   = tex_width;
+    this->row_height  = row_height;
+    this->sdf_size    = sdf_size;
+    this->packer_type = packer_type;
+    this->page_policy = page_policy;
     glyph_count = 0;
-    posx = 0.0f;
-    posy = 0.0f;
-    max_height = row_height + sdf_size * 2.0f;
+    unique_count = 0;
+    max_height = 0;
+    page_count = 0;
+
+    glyph_rect_map.clear();
+    outline_rect_map.clear();
 }
 
-void SdfAtlas::allocate_codepoint( uint32_t codepoint ) {
-    int glyph_idx = font->glyph_idx( codepoint );
-    if ( glyph_idx == -1 ) return;
-    if ( glyph_idx == 0 ) return;
+int SdfAtlas::font_for_codepoint( uint32_t codepoint, int &glyph_idx ) const {
+    for ( size_t ifont = 0; ifont < fonts.size(); ++ifont ) {
+        glyph_idx = fonts[ ifont ]->glyph_idx( codepoint );
+        if ( glyph_idx > 0 ) return ifont;
+    }
+    glyph_idx = -1;
+    return -1;
+}
+
+bool SdfAtlas::glyph_rect( uint32_t codepoint, GlyphRect &gr ) const {
+    int glyph_idx = -1;
+    int font_idx = font_for_codepoint( codepoint, glyph_idx );
+    if ( font_idx == -1 ) return false;
+    const Font *font = fonts[ font_idx ];
     const Glyph& g = font->glyphs[ glyph_idx ];
-    if ( g.command_count <= 2 ) return;
+    if ( g.command_count <= 2 ) return false;
     
     float fheight = font->ascent - font->descent;
     float scale = row_height / fheight;
     float rect_width = ( g.max.x - g.min.x ) * scale + sdf_size * 2.0f;
-    float row_and_border = row_height + sdf_size * 2.0f;
+    float rect_height = row_height + sdf_size * 2.0f;
+    float bottom = font->descent;
 
-    if ( ( posx + rect_width ) > tex_width ) {
-        posx = 0.0f;
-        
-        posy = ceil( posy + row_and_border );
-        max_height = ceil( posy + row_and_border );
+    if ( packer_type != PackerType::Shelf ) {
+        rect_height = ( g.max.y - g.min.y ) * scale + sdf_size * 2.0f;
+        bottom = g.min.y;
     }
 
-    GlyphRect gr;
+    gr = GlyphRect();
     gr.codepoint = codepoint;
     gr.glyph_idx = glyph_idx;
-    gr.x0 = posx;
-    gr.x1 = posx + rect_width;
-    gr.y0 = posy;
-    gr.y1 = posy + row_and_border;
+    gr.x1 = rect_width;
+    gr.y1 = rect_height;
+    gr.bottom = bottom;
+    gr.font_idx = font_idx;
+
+    return true;
+}
+
+void SdfAtlas::allocate_codepoint( uint32_t codepoint ) {
+    GlyphRect gr;
+    if ( !glyph_rect( codepoint, gr ) ) return;
+
+    int glyph_idx = gr.glyph_idx;
+    int font_idx = gr.font_idx;
+    const Font *font = fonts[ font_idx ];
+
+    int rect_idx = glyph_rects.size();
+
+    // With the Block page policy rects are shared only inside a Unicode block,
+    // so every block page set is self-contained
+
+    auto shareable = [&]( int irect ) {
+        const GlyphRect &src = glyph_rects[ irect ];
+        if ( src.font_idx != font_idx ) return false;
+        return page_policy != PagePolicy::Block || unicode_block( src.codepoint ) == unicode_block( codepoint );
+    };
+
+    uint64_t glyph_key = ( (uint64_t) font_idx << 32 ) | (uint32_t) glyph_idx;
+
+    auto git = glyph_rect_map.find( glyph_key );
+    if ( git != glyph_rect_map.end() && shareable( git->second ) ) {
+        gr.source = git->second;
+    } else {
+        std::vector<int> &same_hash = outline_rect_map[ font->outline_hash( glyph_idx ) ];
+        for ( int irect : same_hash ) {
+            if ( shareable( irect ) && font->same_outline( glyph_rects[ irect ].glyph_idx, glyph_idx ) ) {
+                gr.source = irect;
+                break;
+            }
+        }
+        if ( gr.source == -1 ) {
+            same_hash.push_back( rect_idx );
+            unique_count++;
+        }
+        glyph_rect_map[ glyph_key ] = gr.source == -1 ? rect_idx : gr.source;
+    }
 
     glyph_rects.push_back( gr );
 
-    posx = ceil( posx + rect_width );
     glyph_count++;
 }
 
+void SdfAtlas::remove_last_rect() {
+    int rect_idx = glyph_rects.size() - 1;
+    const GlyphRect &gr = glyph_rects.back();
+
+    if ( gr.source == -1 ) {
+        std::vector<int> &same_hash = outline_rect_map[ fonts[ gr.font_idx ]->outline_hash( gr.glyph_idx ) ];
+        same_hash.erase( std::remove( same_hash.begin(), same_hash.end(), rect_idx ), same_hash.end() );
+        unique_count--;
+    }
+
+    uint64_t glyph_key = ( (uint64_t) gr.font_idx << 32 ) | (uint32_t) gr.glyph_idx;
+    auto git = glyph_rect_map.find( glyph_key );
+    if ( git != glyph_rect_map.end() && git->second == rect_idx ) {
+        glyph_rect_map.erase( git );
+    }
+
+    glyph_rects.pop_back();
+    glyph_count--;
+}
+
 void SdfAtlas::allocate_all_glyphs() {
-    for ( auto kv : font->glyph_map ) {
-        allocate_codepoint( kv.first );
+    for ( size_t ifont = 0; ifont < fonts.size(); ++ifont ) {
+        for ( auto kv : fonts[ ifont ]->glyph_map ) {
+            int glyph_idx;
+            if ( font_for_codepoint( kv.first, glyph_idx ) == (int) ifont ) {
+                allocate_codepoint( kv.first );
+            }
+        }
     }
 }
 
@@ -86,31 +192,231 @@ void SdfAtlas::allocate_unicode_range( uint32_t start, uint32_t end ) {
     }
 }
 
-void SdfAtlas::draw_glyphs( GlyphPainter& gp ) const {
-    float fheight = font->ascent - font->descent;
-    float scale = row_height / fheight;
-    float baseline = -font->descent * scale;
-    
+bool SdfAtlas::pack( int max_tex_height ) {
+    std::vector<size_t> order( glyph_rects.size() );
+    for ( size_t i = 0; i < order.size(); ++i ) order[ i ] = i;
+
+    order.erase( std::remove_if( order.begin(), order.end(), [this]( size_t i ) {
+        return glyph_rects[ i ].source != -1;
+    } ), order.end() );
+
+    auto by_height = [this]( size_t a, size_t b ) {
+        const GlyphRect &ga = glyph_rects[ a ];
+        const GlyphRect &gb = glyph_rects[ b ];
+        return ( ga.y1 - ga.y0 ) > ( gb.y1 - gb.y0 );
+    };
+
+    if ( packer_type != PackerType::Shelf && !ordered ) {
+        std::stable_sort( order.begin(), order.end(), by_height );
+    }
+
+    if ( page_policy == PagePolicy::Block ) {
+        std::stable_sort( order.begin(), order.end(), [this]( size_t a, size_t b ) {
+            return unicode_block( glyph_rects[ a ].codepoint ) < unicode_block( glyph_rects[ b ].codepoint );
+        } );
+    }
+
+    std::unique_ptr<RectPacker> packer = RectPacker::create( packer_type );
+    packer->init( tex_width, max_tex_height );
+    page_count = 1;
+    max_height = 0;
+
+    auto next_page = [&]() {
+        max_height = std::max( max_height, packer->height );
+        packer = RectPacker::create( packer_type );
+        packer->init( tex_width, max_tex_height );
+        page_count++;
+    };
+
+    auto place = [&]( RectPacker *p, size_t i, int page ) {
+        GlyphRect &gr = glyph_rects[ i ];
+        float w = gr.x1 - gr.x0;
+        float h = gr.y1 - gr.y0;
+        int x, y;
+        if ( !p->insert( ceil( w ), ceil( h ), x, y ) ) return false;
+        gr.x0 = x;
+        gr.y0 = y;
+        gr.x1 = x + w;
+        gr.y1 = y + h;
+        gr.page = page;
+        return true;
+    };
+
+    // Rects are placed in groups: single rects for the Fill policy,
+    // whole Unicode blocks for the Block policy. A group that doesn't fit
+    // into the current page starts a new one, a group larger than a page
+    // is split between pages.
+
+    for ( size_t igroup = 0; igroup < order.size(); ) {
+        size_t group_end = igroup + 1;
+        if ( page_policy == PagePolicy::Block ) {
+            uint32_t block = unicode_block( glyph_rects[ order[ igroup ] ].codepoint );
+            while ( group_end < order.size() && unicode_block( glyph_rects[ order[ group_end ] ].codepoint ) == block ) {
+                group_end++;
+            }
+        }
+
+        bool placed = true;
+
+        if ( group_end - igroup == 1 ) {
+            placed = place( packer.get(), order[ igroup ], page_count - 1 );
+        } else {
+            std::unique_ptr<RectPacker> trial = packer->clone();
+            for ( size_t i = igroup; i < group_end && placed; ++i ) {
+                placed = place( trial.get(), order[ i ], page_count - 1 );
+            }
+            if ( placed ) packer = std::move( trial );
+        }
+
+        if ( placed ) {
+            igroup = group_end;
+            continue;
+        }
+
+        if ( packer->height > 0 ) {
+            next_page();
+            continue;
+        }
+
+        // Group doesn't fit into an empty page
+
+        for ( size_t i = igroup; i < group_end; ++i ) {
+            if ( place( packer.get(), order[ i ], page_count - 1 ) ) continue;
+            if ( packer->height == 0 ) return false;
+            next_page();
+            if ( !place( packer.get(), order[ i ], page_count - 1 ) ) return false;
+        }
+
+        igroup = group_end;
+    }
+
+    max_height = std::max( max_height, packer->height );
+
+    // Ordered allocation fills the pages in allocation order, then every page
+    // is repacked with height sorted rects, if they still fit into it
+
+    if ( ordered && packer_type != PackerType::Shelf ) {
+        max_height = 0;
+
+        for ( int page = 0; page < page_count; ++page ) {
+            std::vector<size_t> page_rects;
+            std::vector<GlyphRect> placed;
+            for ( size_t i : order ) {
+                if ( glyph_rects[ i ].page != page ) continue;
+                page_rects.push_back( i );
+                placed.push_back( glyph_rects[ i ] );
+            }
+
+            std::stable_sort( page_rects.begin(), page_rects.end(), by_height );
+
+            std::unique_ptr<RectPacker> page_packer = RectPacker::create( packer_type );
+            page_packer->init( tex_width, max_tex_height );
+
+            bool fits = true;
+            for ( size_t i : page_rects ) {
+                if ( !place( page_packer.get(), i, page ) ) {
+                    fits = false;
+                    break;
+                }
+            }
+
+            int page_height = page_packer->height;
+
+            if ( !fits ) {
+                page_height = 0;
+                size_t iplaced = 0;
+                for ( size_t i : order ) {
+                    if ( glyph_rects[ i ].page != page ) continue;
+                    glyph_rects[ i ] = placed[ iplaced++ ];
+                    page_height = std::max( page_height, (int) ceil( glyph_rects[ i ].y1 ) );
+                }
+            }
+
+            max_height = std::max( max_height, page_height );
+        }
+    }
+
+    // An atlas without glyphs is an empty page one row high
+    if ( max_height == 0 ) max_height = row_height + sdf_size * 2.0f;
+
+    for ( GlyphRect &gr : glyph_rects ) {
+        if ( gr.source == -1 ) continue;
+        const GlyphRect &src = glyph_rects[ gr.source ];
+        gr.x0 = src.x0;
+        gr.y0 = src.y0;
+        gr.x1 = src.x1;
+        gr.y1 = src.y1;
+        gr.page = src.page;
+    }
+
+    return true;
+}
+
+float SdfAtlas::occupancy() const {
+    if ( max_height == 0 ) return 0.0f;
+
+    float area = 0.0f;
+    for ( const GlyphRect& gr : glyph_rects ) {
+        if ( gr.source != -1 ) continue;
+        area += ( gr.x1 - gr.x0 ) * ( gr.y1 - gr.y0 );
+    }
+
+    return area / ( tex_width * max_height * page_count );
+}
+
+void SdfAtlas::draw_glyphs( GlyphPainter& gp, int page, const std::vector<bool> *skip, int thread_count ) const {
+    std::vector<GlyphDraw> glyphs;
+    page_glyphs( page, skip, glyphs );
+    gp.draw_glyphs( glyphs.data(), glyphs.size(), thread_count );
+}
+
+void SdfAtlas::page_glyphs( int page, const std::vector<bool> *skip, std::vector<GlyphDraw> &glyphs ) const {
+    glyphs.clear();
+
     for ( size_t iglyph = 0; iglyph < glyph_rects.size(); ++iglyph ) {
         const GlyphRect& gr = glyph_rects[ iglyph ];
+        if ( gr.source != -1 || gr.page != page ) continue;
+        if ( skip && ( *skip )[ iglyph ] ) continue;
+        const Font *font = fonts[ gr.font_idx ];
+        float fheight = font->ascent - font->descent;
+        float scale = row_height / fheight;
         float left = font->glyphs[ gr.glyph_idx ].left_side_bearing * scale;
+        float baseline = -gr.bottom * scale;
         F2 glyph_pos = F2 { gr.x0, gr.y0 + baseline } + F2 { sdf_size - left, sdf_size };
-        gp.draw_glyph( font, gr.glyph_idx, glyph_pos, scale, sdf_size );
+        glyphs.push_back( GlyphDraw { font, gr.glyph_idx, glyph_pos, scale, sdf_size, F2( gr.x0, gr.y0 ), F2( gr.x1, gr.y1 ) } );
     }
 }
 
+// Glyph for the font metrics, .notdef if the font doesn't have the codepoint
+
+static const Glyph& metric_glyph( const Font *font, uint32_t codepoint ) {
+    int glyph_idx = font->glyph_idx( codepoint );
+    return font->glyphs[ glyph_idx < 0 ? 0 : glyph_idx ];
+}
+
+// Font metrics fields with the given indentation
+
+static void json_metrics( std::stringstream &ss, const char *indent, const Font *font, float scalex, float scaley ) {
+    ss << indent << "ascent: " << font->ascent * scaley << ", " << std::endl;
+    ss << indent << "descent: " << fabsf( font->descent * scaley ) << ", " << std::endl;
+    ss << indent << "line_gap: " << font->line_gap * scaley << ", " << std::endl;
+    ss << indent << "cap_height: " << metric_glyph( font, 'X' ).max.y * scaley  << ", " << std::endl;
+    ss << indent << "x_height: " << metric_glyph( font, 'x' ).max.y * scaley  << ", " << std::endl;
+    ss << indent << "space_advance: " << metric_glyph( font, ' ' ).advance_width * scalex << ", " << std::endl;
+}
+
 std::string SdfAtlas::json( float tex_height, bool flip_texcoord_y ) const {
-    float fheight = font->ascent - font->descent;
-    float scaley = row_height / tex_height / fheight; 
-    float scalex = row_height / tex_width / fheight;   
+    std::vector<float> scalex( fonts.size() ), scaley( fonts.size() );
+    for ( size_t ifont = 0; ifont < fonts.size(); ++ifont ) {
+        float fheight = fonts[ ifont ]->ascent - fonts[ ifont ]->descent;
+        scaley[ ifont ] = row_height / tex_height / fheight; 
+        scalex[ ifont ] = row_height / tex_width / fheight;   
+    }
 
-    const Glyph& gspace = font->glyphs[ font->glyph_idx( ' ' ) ];
-    const Glyph& gx     = font->glyphs[ font->glyph_idx( 'x' ) ];
-    const Glyph& gxcap  = font->glyphs[ font->glyph_idx( 'X' ) ];
-    
-    std::unordered_set<uint32_t> codepoints;
+    // Codepoint -> font index
+    std::unordered_map<uint32_t, int> codepoints;
     for ( size_t igr = 0; igr < glyph_rects.size(); ++igr ) {
-        codepoints.insert( glyph_rects[igr].codepoint );
+        codepoints.insert( { glyph_rects[igr].codepoint, glyph_rects[igr].font_idx } );
     }
 
     std::stringstream ss;
@@ -119,18 +425,27 @@ std::string SdfAtlas::json( float tex_height, bool flip_texcoord_y ) const {
     ss << "    iy: " << sdf_size / tex_height << ", " << std::endl;
     ss << "    row_height: " << ( row_height + 2.0f * sdf_size ) / tex_height << ", " << std::endl;
     ss << "    aspect: " <<  tex_width / tex_height << ", " << std::endl;
-    ss << "    ascent: " << font->ascent * scaley << ", " << std::endl;
-    ss << "    descent: " << fabsf( font->descent * scaley ) << ", " << std::endl;
-    ss << "    line_gap: " << font->line_gap * scaley << ", " << std::endl;
-    ss << "    cap_height: " << gxcap.max.y * scaley  << ", " << std::endl;
-    ss << "    x_height: " << gx.max.y * scaley  << ", " << std::endl;
-    ss << "    space_advance: " << gspace.advance_width * scalex << ", " << std::endl << std::endl;
+    ss << "    pages: " << page_count << ", " << std::endl;
+    json_metrics( ss, "    ", fonts[ 0 ], scalex[ 0 ], scaley[ 0 ] );
+    ss << std::endl;
+
+    ss << "    fonts: [" << std::endl;
+    for ( size_t ifont = 0; ifont < fonts.size(); ++ifont ) {
+        ss << "    {" << std::endl;
+        json_metrics( ss, "        ", fonts[ ifont ], scalex[ ifont ], scaley[ ifont ] );
+        ss << "    }";
+        if ( ifont != fonts.size() - 1 ) ss << ",";
+        ss << std::endl;
+    }
+    ss << "    ], // end fonts" << std::endl << std::endl;
     
     ss << "    chars: { " << std::endl;
 
     for ( size_t igr = 0; igr < glyph_rects.size(); ++igr ) {
         const GlyphRect& gr = glyph_rects[ igr ];
-        const Glyph& g = font->glyphs[ gr.glyph_idx ];
+        const Glyph& g = fonts[ gr.font_idx ]->glyphs[ gr.glyph_idx ];
+        float sx = scalex[ gr.font_idx ];
+        float sy = scaley[ gr.font_idx ];
         float tcy0 = gr.y0 / tex_height;
         float tcy1 = gr.y1 / tex_height;
 
@@ -146,8 +461,11 @@ std::string SdfAtlas::json( float tex_height, bool flip_texcoord_y ) const {
         ss << "        rect: [";
         ss << gr.x0 / tex_width << ", " << tcy0 << ", ";
         ss << gr.x1 / tex_width << ", " << tcy1 << "]," << std::endl;
-        ss << "        bearing_x: " << g.left_side_bearing * scalex << "," << std::endl;
-        ss << "        advance_x: " << g.advance_width * scalex << "," << std::endl;
+        ss << "        bearing_x: " << g.left_side_bearing * sx << "," << std::endl;
+        ss << "        bearing_y: " << gr.bottom * sy << "," << std::endl;
+        ss << "        page: " << gr.page << "," << std::endl;
+        ss << "        font: " << gr.font_idx << "," << std::endl;
+        ss << "        advance_x: " << g.advance_width * sx << "," << std::endl;
         ss << "        flags: " << (int)g.char_type << std::endl;
         ss << "    }";
         if ( igr != glyph_rects.size() - 1 ) ss << ",";
@@ -158,31 +476,39 @@ std::string SdfAtlas::json( float tex_height, bool flip_texcoord_y ) const {
 
     ss << "    kern: {" << std::endl;
 
-    for ( auto kv : font->kern_map ) {
-        uint32_t kern_pair = kv.first;
-        float kern_value = kv.second * scalex;
+    // Kerning pairs only between chars of the same font
 
-        int kern_first_idx = ( kern_pair >> 16 ) & 0xffff;        
-        int kern_second_idx = kern_pair & 0xffff;
+    for ( size_t ifont = 0; ifont < fonts.size(); ++ifont ) {
+        const Font *font = fonts[ ifont ];
 
-        auto it1 = font->cp_map.find( kern_first_idx );
-        auto it2 = font->cp_map.find( kern_second_idx );
+        for ( auto kv : font->kern_map ) {
+            uint32_t kern_pair = kv.first;
+            float kern_value = kv.second * scalex[ ifont ];
 
-        if ( it1 == font->cp_map.end() || it2 == font->cp_map.end() ) {
-            continue;
-        }
+            int kern_first_idx = ( kern_pair >> 16 ) & 0xffff;        
+            int kern_second_idx = kern_pair & 0xffff;
+
+            auto it1 = font->cp_map.find( kern_first_idx );
+            auto it2 = font->cp_map.find( kern_second_idx );
+
+            if ( it1 == font->cp_map.end() || it2 == font->cp_map.end() ) {
+                continue;
+            }
+
+            const std::vector<uint32_t>& v1 = it1->second;
+            const std::vector<uint32_t>& v2 = it2->second;
 
-        const std::vector<uint32_t>& v1 = it1->second;
-        const std::vector<uint32_t>& v2 = it2->second;
-
-        for ( uint32_t kern_first : v1 ) {
-            for ( uint32_t kern_second : v2 ) {
-                bool first_found = codepoints.find( kern_first ) != codepoints.end();
-                bool second_found = codepoints.find( kern_second ) != codepoints.end();
-                if ( first_found && second_found ) {
-                    char uckern[ 64 ];
-                    snprintf( uckern, 64, "        \"\\u%04x\\u%04x\" : ", kern_first, kern_second );
-                    ss << uckern << kern_value << "," << std::endl;
+            for ( uint32_t kern_first : v1 ) {
+                for ( uint32_t kern_second : v2 ) {
+                    auto cp1 = codepoints.find( kern_first );
+                    auto cp2 = codepoints.find( kern_second );
+                    bool first_found = cp1 != codepoints.end() && cp1->second == (int) ifont;
+                    bool second_found = cp2 != codepoints.end() && cp2->second == (int) ifont;
+                    if ( first_found && second_found ) {
+                        char uckern[ 64 ];
+                        snprintf( uckern, 64, "        \"\\u%04x\\u%04x\" : ", kern_first, kern_second );
+                        ss << uckern << kern_value << "," << std::endl;
+                    }
                 }
             }
         }
@@ -22,36 +22,90 @@
 #pragma once
 
 #include "glyph_painter.h"
+#include "rect_packer.h"
 #include <string>
+#include <unordered_map>
 
 struct GlyphRect {
     uint32_t codepoint = 0;
     int      glyph_idx = 0;
     float x0 = 0.0f, y0 = 0.0f, x1 = 0.0f, y1 = 0.0f;    
+    float bottom = 0.0f;    // Rect bottom without the SDF border relative to the baseline, in font units
+    int   source = -1;      // Index of the rect with the same outline, aliases are not packed or rendered
+    int   page = 0;
+    int   font_idx = 0;     // Index in the font fallback chain
+};
+
+// Paging policies:
+// Fill  - a new page starts when the next rect doesn't fit into the current one
+// Block - glyphs are grouped by Unicode block, a block that doesn't fit into
+//         the current page starts a new one, so scripts can be loaded lazily
+
+enum class PagePolicy {
+    Fill, Block
 };
 
 struct SdfAtlas {
-    Font *font        = nullptr;
+    // Font fallback chain, codepoints are taken from the first font containing them
+    std::vector<const Font*> fonts;
+
     float tex_width   = 2048.0f;
     float row_height  = 96.0f;
     float sdf_size    = 16.0f;
     int   glyph_count = 0;
+    int   unique_count = 0;
+    int   max_height = 0;      // Maximum packed page height
+    int   page_count = 0;
+
+    // Shelf packs full row height rects in allocation order,
+    // other packers use tight glyph rects sorted by height
+    PackerType packer_type = PackerType::Shelf;
+    PagePolicy page_policy = PagePolicy::Fill;
 
-    float posx = 0;
-    float posy = 0;
-    int   max_height = 0;
+    // Allocation order matters, e.g. by codepoint frequency: pages are filled in allocation order,
+    // rects are sorted by height only inside a page
+    bool ordered = false;
 
     std::vector<GlyphRect> glyph_rects;
 
-    void init( Font *font, float tex_width, float row_height, float sdf_size );
+    // Glyph index -> rect, outline hash -> rects, for finding aliases
+    std::unordered_map<uint64_t, int>              glyph_rect_map;     // ( font index << 32 | glyph index ) -> rect
+    std::unordered_map<uint64_t, std::vector<int>> outline_rect_map;
+
+    void init( const std::vector<const Font*> &fonts, float tex_width, float row_height, float sdf_size,
+               PackerType packer_type = PackerType::Shelf, PagePolicy page_policy = PagePolicy::Fill );
 
+    // First font in the chain containing the codepoint, -1 if none
+    int font_for_codepoint( uint32_t codepoint, int &glyph_idx ) const;
+
+    // Sized rect at the origin for the codepoint glyph, false if there's no glyph or it's empty
+    bool glyph_rect( uint32_t codepoint, GlyphRect &gr ) const;
+
+    // Allocated rects are sized only, pack() places them.
+    // Codepoints sharing a glyph index or an outline share the rect.
     void allocate_codepoint( uint32_t codepoint );
 
+    // Removes the last allocated rect, e.g. when it doesn't fit into a runtime atlas
+    void remove_last_rect();
+
     void allocate_all_glyphs();    
 
     void allocate_unicode_range( uint32_t start, uint32_t end ); // end is inclusive    
+
+    // Places the allocated rects on pages max_tex_height high, updates max_height and page_count,
+    // an atlas without glyphs is one row high.
+    // Returns false if a rect doesn't fit into an empty page.
+    bool pack( int max_tex_height );
+
+    // Glyph rects area to the packed atlas area ratio
+    float occupancy() const;
     
-    void draw_glyphs( GlyphPainter& gp ) const;
+    // Draws the page glyphs, rects marked in 'skip' ( e.g. cached tiles ) are left out.
+    // Glyphs are tessellated on up to thread_count threads, the vertex order stays the same.
+    void draw_glyphs( GlyphPainter& gp, int page = 0, const std::vector<bool> *skip = nullptr, int thread_count = 1 ) const;
+
+    // Placements of the page glyphs for GlyphPainter::draw_glyphs(), to draw them in parts
+    void page_glyphs( int page, const std::vector<bool> *skip, std::vector<GlyphDraw> &glyphs ) const;
 
     std::string json( float tex_height, bool flip_texcoord_y = true ) const;
 };
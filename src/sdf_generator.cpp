@@ -0,0 +1,931 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "sdf_generator.h"
+#include "bounded_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../third_party/stb_image_write.h"
+
+bool SdfGenerator::init() {
+    sdf_gl.init();
+
+    glGetIntegerv( GL_MAX_RENDERBUFFER_SIZE, &max_tex_size );
+
+    // Color attachment is a texture, so the compute shader can write it as an image
+
+    glGenTextures( 1, &color_tex );
+    glBindTexture( GL_TEXTURE_2D, color_tex );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    glGenRenderbuffers( 1, &rbds );
+    glGenFramebuffers( 1, &fbo );
+
+    return sdf_gl.fill_prog != 0;
+}
+
+void SdfGenerator::destroy() {
+    glDeleteFramebuffers( 1, &fbo );
+    glDeleteRenderbuffers( 1, &rbds );
+    glDeleteTextures( 1, &color_tex );
+    fbo = rbds = color_tex = 0;
+    target_width = target_height = 0;
+}
+
+int SdfGenerator::thread_count() const {
+    return tessellation_threads > 0 ? tessellation_threads : std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+void SdfGenerator::message( const std::string &text ) {
+    std::lock_guard<std::mutex> lock( log_mutex );
+    if ( log ) log( text );
+}
+
+bool SdfGenerator::fail( const std::string &text ) {
+    std::lock_guard<std::mutex> lock( log_mutex );
+    if ( error.empty() ) error = text;
+    return false;
+}
+
+const Font* SdfGenerator::load_font( const std::string &filename ) {
+    std::lock_guard<std::mutex> lock( font_mutex );
+
+    std::unique_ptr<Font> &font = fonts[ filename ];
+    if ( !font ) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::unique_ptr<Font> loaded( new Font() );
+        if ( !loaded->load_ttf_file( filename.c_str() ) ) {
+            fonts.erase( filename );
+            fail( "Error reading TTF file '" + filename + "'" );
+            return nullptr;
+        }
+        font = std::move( loaded );
+
+        if ( stats ) {
+            double total = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+            stats->add_time( Stage::FontLoad, total - font->cmap_time - font->outline_time );
+            stats->add_time( Stage::Cmap, font->cmap_time );
+            stats->add_time( Stage::Outlines, font->outline_time );
+
+            std::lock_guard<std::mutex> lock( stats->mutex );
+            stats->font_outlines += font->glyphs.capacity() * sizeof( Glyph ) + font->glyph_commands.capacity() * sizeof( GlyphCommand ) +
+                                    font->glyph_components.capacity() * sizeof( GlyphComponent );
+        }
+    }
+
+    font_use[ filename ] = ++font_clock;
+
+    return font.get();
+}
+
+size_t SdfGenerator::trim_fonts() {
+    std::lock_guard<std::mutex> lock( font_mutex );
+
+    size_t unloaded = 0;
+
+    while ( max_fonts && fonts.size() > max_fonts ) {
+        auto oldest = std::min_element( font_use.begin(), font_use.end(), []( const std::pair<const std::string, uint64_t> &a,
+                                                                               const std::pair<const std::string, uint64_t> &b ) {
+            return a.second < b.second;
+        } );
+        fonts.erase( oldest->first );
+        font_use.erase( oldest );
+        unloaded++;
+    }
+
+    return unloaded;
+}
+
+static void allocate_glyphs( const AtlasOptions &options, SdfAtlas &sdf_atlas ) {
+    sdf_atlas.init( options.fonts, options.width, options.row_height, options.border_size, options.packer_type, options.page_policy );
+
+    // Corpus glyphs in frequency order, then the ranges as the always included set
+
+    if ( !options.corpus_codepoints.empty() ) {
+        sdf_atlas.ordered = true;
+
+        std::unordered_set<uint32_t> allocated;
+        for ( uint32_t cp : options.corpus_codepoints ) {
+            allocated.insert( cp );
+            sdf_atlas.allocate_codepoint( cp );
+        }
+
+        for ( const UnicodeRange& ur : options.unicode_ranges ) {
+            for ( uint32_t cp = ur.start; cp <= ur.end; ++cp ) {
+                if ( allocated.insert( cp ).second ) {
+                    sdf_atlas.allocate_codepoint( cp );
+                }
+            }
+        }
+    } else if ( options.unicode_ranges.empty() ) {
+        sdf_atlas.allocate_unicode_range( 0x21, 0x7e );
+        sdf_atlas.allocate_unicode_range( 0xffff, 0xffff );
+    } else {
+        for ( const UnicodeRange& ur : options.unicode_ranges ) {
+            sdf_atlas.allocate_unicode_range( ur.start, ur.end );
+        }
+    }
+}
+
+bool SdfGenerator::layout( const AtlasOptions &options, SdfAtlas &sdf_atlas ) {
+    {
+        StageTimer timer( stats, Stage::Allocation );
+        allocate_glyphs( options, sdf_atlas );
+    }
+
+    int max_tex_height = options.tex_height ? options.tex_height : max_tex_size;
+
+    StageTimer timer( stats, Stage::Packing );
+
+    if ( !sdf_atlas.pack( max_tex_height ) ) {
+        return fail( "Glyph rect doesn't fit into an atlas page, maximum height is " + std::to_string( max_tex_height ) );
+    }
+
+    return true;
+}
+
+// Binary search over the row height, only packing
+
+bool SdfGenerator::fit( AtlasOptions &options, int fit_width, int fit_height, bool fixed_border ) {
+    AtlasOptions trial = options;
+    trial.width = fit_width;
+    trial.tex_height = fit_height;
+
+    float border_ratio = (float) options.border_size / options.row_height;
+    auto fit_border = [&]( int rh ) {
+        return fixed_border ? options.border_size : std::max( 1, (int) lroundf( rh * border_ratio ) );
+    };
+
+    int rh_min = 5;
+    int rh_max = fit_height;
+    int rh_best = 0;
+
+    SdfAtlas sdf_atlas;
+
+    while ( rh_min <= rh_max ) {
+        int rh = ( rh_min + rh_max ) / 2;
+        trial.row_height = rh;
+        trial.border_size = fit_border( rh );
+        {
+            StageTimer timer( stats, Stage::Allocation );
+            allocate_glyphs( trial, sdf_atlas );
+        }
+        StageTimer timer( stats, Stage::Packing );
+        if ( sdf_atlas.pack( fit_height ) && sdf_atlas.page_count == 1 ) {
+            rh_best = rh;
+            rh_min = rh + 1;
+        } else {
+            rh_max = rh - 1;
+        }
+    }
+
+    if ( rh_best == 0 ) {
+        return fail( "Glyphs don't fit into " + std::to_string( fit_width ) + "x" + std::to_string( fit_height ) );
+    }
+
+    options.width = fit_width;
+    options.tex_height = fit_height;
+    options.row_height = rh_best;
+    options.border_size = fit_border( rh_best );
+
+    return true;
+}
+
+// Reallocates the framebuffer attachments if the size has changed
+
+bool SdfGenerator::resize_target( int w, int h ) {
+    if ( w == target_width && h == target_height ) return true;
+
+    target_width = w;
+    target_height = h;
+
+    glBindTexture( GL_TEXTURE_2D, color_tex );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    glBindRenderbuffer( GL_RENDERBUFFER, rbds );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_STENCIL, w, h );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_tex, 0 );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbds );
+
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+        target_width = target_height = 0;
+        return fail( "Error creating framebuffer!" );
+    }
+
+    return true;
+}
+
+bool SdfGenerator::begin_page( int width, int height ) {
+    if ( !resize_target( width, height ) ) return false;
+
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+
+    glClearColor( 0.0, 0.0, 0.0, 0.0 );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+
+    glViewport( 0, 0, width, height );
+
+    return true;
+}
+
+bool SdfGenerator::render_batch( SdfMode mode, const SdfAtlas &sdf_atlas, const GlyphPainter &gp, int width, int height ) {
+    F2 tex_size = F2( width, height );
+
+    switch ( mode ) {
+    case SdfMode::Stencil:
+        sdf_gl.draw_sdf_batch( tex_size, gp.fp.vertices.data(), gp.fp.vertices.size(), gp.lp.rects.data(), gp.lp.rects.size(),
+                               gp.clips.data(), gp.clips.size() );
+        break;
+    case SdfMode::GlyphQuad:
+        sdf_gl.render_sdf_quads( tex_size, sdf_atlas.sdf_size, gp.sp.segments, gp.sp.vertices );
+        break;
+    case SdfMode::Compute:
+        if ( !sdf_gl.compute_supported ) {
+            glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+            return fail( "Compute rendering mode requires OpenGL 4.3." );
+        }
+        if ( !sdf_gl.render_sdf_compute( tex_size, sdf_atlas.sdf_size, gp.sp.segments, gp.sp.vertices, color_tex ) ) {
+            glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+            return fail( "Glyph segments don't fit into a shader storage buffer, use '-m quad'." );
+        }
+        break;
+    }
+
+    return true;
+}
+
+void SdfGenerator::end_page( SdfMode mode, int width, int height, uint8_t *pixels ) {
+    if ( mode == SdfMode::Stencil ) sdf_gl.invert_sdf_fill();
+
+    glReadPixels( 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, pixels );
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+void SdfGenerator::line_pass_message( const SdfAtlas &sdf_atlas, int page, float line_area ) {
+    size_t page_glyphs = std::count_if( sdf_atlas.glyph_rects.begin(), sdf_atlas.glyph_rects.end(), [page]( const GlyphRect& gr ) {
+        return gr.source == -1 && gr.page == page;
+    } );
+
+    if ( page_glyphs ) {
+        std::stringstream ss;
+        ss << "Line pass covers " << (size_t) line_area << " pixels, ";
+        ss << (size_t) ( line_area / page_glyphs ) << " per glyph" << std::endl;
+        message( ss.str() );
+    }
+}
+
+bool SdfGenerator::render( SdfMode mode, const SdfAtlas &sdf_atlas, const GlyphPainter &gp, int page, int width, int height, uint8_t *pixels ) {
+    if ( !begin_page( width, height ) ) return false;
+    if ( !render_batch( mode, sdf_atlas, gp, width, height ) ) return false;
+    end_page( mode, width, height, pixels );
+
+    if ( mode == SdfMode::Stencil ) {
+        line_pass_message( sdf_atlas, page, rects_area( gp.lp.rects ) );
+    }
+
+    return true;
+}
+
+// Glyph placements split into the batches fitting into an arena of 'capacity' vertices per stream,
+// 'ends' are the batch ends. A glyph larger than the arena takes a batch of its own.
+// The compute shader writes whole tiles, so the Compute mode page is one batch.
+
+static void split_batches( const std::vector<GlyphDraw> &glyphs, SdfMode mode, size_t capacity, std::vector<size_t> &ends ) {
+    ends.clear();
+
+    size_t batch_size = 0;
+
+    for ( size_t ig = 0; ig < glyphs.size() && mode != SdfMode::Compute; ++ig ) {
+        size_t size = GlyphPainter::max_glyph_vertices( glyphs[ ig ].font, glyphs[ ig ].glyph_index, mode );
+        if ( batch_size && batch_size + size > capacity ) {
+            ends.push_back( ig );
+            batch_size = 0;
+        }
+        batch_size += size;
+    }
+
+    ends.push_back( glyphs.size() );
+}
+
+bool SdfGenerator::render_page( const AtlasOptions &options, const SdfAtlas &sdf_atlas, int page, int height, uint8_t *pixels ) {
+    std::vector<GlyphDraw> glyphs;
+    std::vector<size_t> ends;
+    sdf_atlas.page_glyphs( page, nullptr, glyphs );
+    split_batches( glyphs, options.sdf_mode, batch_vertices, ends );
+
+    GlyphPainter gp;
+    gp.mode = options.sdf_mode;
+    gp.cache = &tessellation_cache;
+    gp.reserve( batch_vertices );
+
+    if ( !begin_page( options.width, height ) ) return false;
+
+    float line_area = 0.0f;
+    size_t begin = 0;
+
+    for ( size_t end : ends ) {
+        gp.clear();
+        gp.draw_glyphs( glyphs.data() + begin, end - begin, thread_count() );
+        if ( !render_batch( options.sdf_mode, sdf_atlas, gp, options.width, height ) ) return false;
+        line_area += rects_area( gp.lp.rects );
+        begin = end;
+    }
+
+    end_page( options.sdf_mode, options.width, height, pixels );
+
+    if ( options.sdf_mode == SdfMode::Stencil ) {
+        line_pass_message( sdf_atlas, page, line_area );
+    }
+
+    return true;
+}
+
+void SdfGenerator::flip_rows( uint8_t *pixels, int width, int height ) {
+    std::vector<uint8_t> row_swap( width );
+
+    for ( int iy = 0; iy < height / 2; ++iy ) {
+        uint8_t* row0 = pixels + iy * width;
+        uint8_t* row1 = pixels + ( height - 1 - iy ) * width;
+        memcpy( row_swap.data(), row0, width );
+        memcpy( row0, row1, width );
+        memcpy( row1, row_swap.data(), width );
+    }
+}
+
+bool SdfGenerator::encode_png( uint8_t *pixels, int width, int height, std::vector<uint8_t> &png ) {
+    flip_rows( pixels, width, height );
+    return write_png( pixels, width, height, png );
+}
+
+bool SdfGenerator::write_png( const uint8_t *pixels, int width, int height, std::vector<uint8_t> &png ) {
+    png.clear();
+    auto append = []( void *context, void *data, int size ) {
+        std::vector<uint8_t> *out = (std::vector<uint8_t>*) context;
+        out->insert( out->end(), (uint8_t*) data, (uint8_t*) data + size );
+    };
+
+    return stbi_write_png_to_func( append, &png, width, height, 1, pixels, width ) != 0;
+}
+
+// Pipeline stages, each on its own thread, connected by bounded queues:
+// tessellation ( job planning, allocation, packing, glyph geometry ) -> rendering ( GL, calling thread ) -> encoding ( PNG, sink ).
+// Tessellation of the next atlas and encoding of the previous one overlap with rendering,
+// queue_depth limits the pages held between the stages. After a failure the stages
+// drain their queues without working, so none of them blocks.
+
+static const size_t queue_depth = 2;
+
+// Glyph rect tile: cached, to be copied into the page, or rendered, to be stored in the cache
+
+struct GlyphTile {
+    int      rect = 0;
+    uint64_t key = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Tessellated batch of an atlas page. The batch geometry is in an arena painter, recycled
+// after rendering, so the vertex memory doesn't depend on the glyph count.
+
+struct PageItem {
+    std::shared_ptr<const AtlasOptions> options;
+    std::shared_ptr<const SdfAtlas>     atlas;
+    int          page = 0;
+    int          height = 0;
+    bool         first_batch = true;
+    bool         last_batch = true;
+    GlyphPainter gp;
+    GlyphPainter ref_gp;    // Whole page 'stencil' mode geometry for the comparison, on the last batch
+    std::vector<GlyphTile> cached_tiles;    // On the first batch
+    std::vector<GlyphTile> rendered_tiles;
+};
+
+// Rendered atlas page, the last page also completes the atlas
+
+struct EncodeItem {
+    std::shared_ptr<const AtlasOptions> options;
+    std::shared_ptr<const SdfAtlas>     atlas;
+    int          page = 0;
+    int          height = 0;
+    std::vector<uint8_t> pixels;
+    std::vector<GlyphTile> cached_tiles;
+    std::vector<GlyphTile> rendered_tiles;
+};
+
+// Pixel box of a glyph rect
+
+static void tile_box( const GlyphRect &gr, int &x, int &y, int &w, int &h ) {
+    x = (int) gr.x0;
+    y = (int) gr.y0;
+    w = (int) ceil( gr.x1 - gr.x0 );
+    h = (int) ceil( gr.y1 - gr.y0 );
+}
+
+// Looks up the page glyphs in the tile cache, marks the cached rects to skip drawing them
+
+static void lookup_tiles( TileCache &tile_cache, const AtlasOptions &options, const SdfAtlas &sdf_atlas, int height,
+                          PageItem &item, std::vector<bool> &cached ) {
+    cached.assign( sdf_atlas.glyph_rects.size(), false );
+
+    for ( size_t irect = 0; irect < sdf_atlas.glyph_rects.size(); ++irect ) {
+        const GlyphRect &gr = sdf_atlas.glyph_rects[ irect ];
+        if ( gr.source != -1 || gr.page != item.page ) continue;
+
+        int x, y, w, h;
+        tile_box( gr, x, y, w, h );
+
+        GlyphTile tile;
+        tile.rect = irect;
+        tile.key = TileCache::tile_key( sdf_atlas.fonts[ gr.font_idx ]->data_hash, gr.glyph_idx, sdf_atlas.row_height, sdf_atlas.sdf_size,
+                                        gr.x1 - gr.x0, gr.y1 - gr.y0, gr.bottom, options.sdf_mode, x, y, options.width, height );
+
+        if ( tile_cache.load( tile.key, w, h, tile.pixels ) ) {
+            cached[ irect ] = true;
+            item.cached_tiles.push_back( std::move( tile ) );
+        } else {
+            item.rendered_tiles.push_back( std::move( tile ) );
+        }
+    }
+}
+
+// Counters of a tessellated batch and its arena sizes
+
+static void add_batch_stats( GenerationStats &stats, const GlyphPainter &gp, size_t glyph_count, size_t arena_count ) {
+    double fill_area = gp.fp.vertices.empty() ? 0.0 : triangles_area( gp.fp.vertices );
+    double line_area = gp.lp.rects.empty() ? 0.0 : rects_area( gp.lp.rects );
+    double quad_area = gp.sp.vertices.empty() ? 0.0 : quads_area( gp.sp.vertices );
+
+    std::lock_guard<std::mutex> lock( stats.mutex );
+    stats.batches++;
+    stats.drawn_glyphs += glyph_count;
+    stats.lines += gp.line_count;
+    for ( int it = 0; it < 3; ++it ) stats.curves[ it ] += gp.curve_count[ it ];
+
+    stats.fill_vertices += gp.fp.vertices.size();
+    stats.line_rects += gp.lp.rects.size();
+    stats.segments += gp.sp.segments.size();
+    stats.quad_vertices += gp.sp.vertices.size();
+
+    stats.fill_fragments += fill_area;
+    stats.line_fragments += line_area;
+    stats.quad_fragments += quad_area;
+
+    stats.peak_fill_arena = std::max( stats.peak_fill_arena, gp.fp.vertices.capacity() * sizeof( SdfFillVertex ) );
+    stats.peak_line_arena = std::max( stats.peak_line_arena, gp.lp.rects.capacity() * sizeof( SdfLineRect ) );
+    stats.peak_segment_arena = std::max( stats.peak_segment_arena, gp.sp.segments.capacity() * sizeof( SdfSegment ) );
+    stats.peak_quad_arena = std::max( stats.peak_quad_arena, gp.sp.vertices.capacity() * sizeof( SdfGlyphVertex ) );
+    stats.arenas = std::max( stats.arenas, arena_count );
+}
+
+static void compare( SdfGenerator &gen, const uint8_t *pixels, const uint8_t *ref, size_t pic_size ) {
+    int    max_diff = 0;
+    size_t diff_count = 0;
+
+    for ( size_t i = 0; i < pic_size; ++i ) {
+        int diff = abs( (int) pixels[i] - (int) ref[i] );
+        max_diff = std::max( max_diff, diff );
+        if ( diff > 1 ) diff_count++;
+    }
+
+    std::stringstream ss;
+    ss << "Maximum difference from the 'stencil' mode is " << max_diff << ", ";
+    ss << diff_count << " pixels (" << 100.0 * diff_count / pic_size << "%) differ by more than 1" << std::endl;
+    gen.message( ss.str() );
+}
+
+bool SdfGenerator::generate( const std::vector<AtlasOptions> &atlases, AtlasSink &sink ) {
+    bool done = false;
+
+    return generate( [&]( std::vector<AtlasOptions> &job ) {
+        if ( !done ) job = atlases;
+        done = true;
+        return true;
+    }, sink );
+}
+
+bool SdfGenerator::generate( const JobSource &next_job, AtlasSink &sink ) {
+    BoundedQueue<PageItem>   pages( queue_depth );
+    BoundedQueue<EncodeItem> encoded( queue_depth );
+
+    // Arenas: one being filled, the queued ones and one being rendered
+
+    const size_t max_arenas = queue_depth + 2;
+    BoundedQueue<GlyphPainter> free_arenas( max_arenas );
+    size_t arena_count = 0;
+    std::atomic<bool>        failed( false );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    error.clear();
+
+    // Tessellation stage
+
+    auto tessellate = [&]() {
+        int threads = thread_count();
+        std::vector<AtlasOptions> job;
+
+        while ( !failed ) {
+            job.clear();
+            if ( !next_job( job ) ) {
+                failed = true;
+                break;
+            }
+            if ( job.empty() ) break;
+
+            for ( const AtlasOptions &opt : job ) {
+                if ( failed ) break;
+
+                std::shared_ptr<const AtlasOptions> options = std::make_shared<AtlasOptions>( opt );
+                std::shared_ptr<SdfAtlas> sdf_atlas = std::make_shared<SdfAtlas>();
+
+                if ( !layout( *options, *sdf_atlas ) ) {
+                    failed = true;
+                    break;
+                }
+
+                std::stringstream ss;
+                ss << "Generating " << options->name << std::endl;
+                ss << "Allocated " << sdf_atlas->glyph_count << " glyphs, " << sdf_atlas->unique_count << " unique" << std::endl;
+                ss << "Atlas maximum height is " << sdf_atlas->max_height << std::endl;
+                if ( sdf_atlas->page_count > 1 ) {
+                    ss << "Atlas has " << sdf_atlas->page_count << " pages" << std::endl;
+                }
+                ss << "Atlas occupancy is " << sdf_atlas->occupancy() * 100.0f << "%" << std::endl;
+                message( ss.str() );
+
+                if ( stats ) {
+                    double page_area = (double) sdf_atlas->tex_width * sdf_atlas->max_height * sdf_atlas->page_count;
+                    std::lock_guard<std::mutex> lock( stats->mutex );
+                    stats->atlases++;
+                    stats->pages += sdf_atlas->page_count;
+                    stats->glyphs += sdf_atlas->glyph_count;
+                    stats->unique_glyphs += sdf_atlas->unique_count;
+                    stats->glyph_area += sdf_atlas->occupancy() * page_area;
+                    stats->page_area += page_area;
+                }
+
+                int height = options->tex_height ? options->tex_height : sdf_atlas->max_height;
+                bool use_tile_cache = options->use_tile_cache && tile_cache && !options->compare_modes;
+
+                for ( int page = 0; page < sdf_atlas->page_count && !failed; ++page ) {
+                    PageItem first;
+                    std::vector<bool> cached;
+
+                    if ( use_tile_cache ) {
+                        first.page = page;
+                        lookup_tiles( *tile_cache, *options, *sdf_atlas, height, first, cached );
+                    }
+
+                    std::vector<GlyphDraw> glyphs;
+                    std::vector<size_t> ends;
+                    sdf_atlas->page_glyphs( page, use_tile_cache ? &cached : nullptr, glyphs );
+                    split_batches( glyphs, options->sdf_mode, batch_vertices, ends );
+
+                    size_t begin = 0;
+
+                    for ( size_t ib = 0; ib < ends.size(); ++ib ) {
+                        PageItem item;
+
+                        if ( arena_count < max_arenas ) {
+                            item.gp.mode = options->sdf_mode;
+                            item.gp.reserve( batch_vertices );
+                            arena_count++;
+                        } else {
+                            free_arenas.pop( item.gp );
+                        }
+
+                        item.options = options;
+                        item.atlas = sdf_atlas;
+                        item.page = page;
+                        item.height = height;
+                        item.first_batch = ib == 0;
+                        item.last_batch = ib + 1 == ends.size();
+                        item.gp.mode = options->sdf_mode;
+                        item.gp.cache = &tessellation_cache;
+                        {
+                            StageTimer timer( stats, Stage::Tessellation );
+                            item.gp.draw_glyphs( glyphs.data() + begin, ends[ ib ] - begin, threads );
+                        }
+                        if ( stats ) add_batch_stats( *stats, item.gp, ends[ ib ] - begin, arena_count );
+                        begin = ends[ ib ];
+
+                        if ( item.first_batch ) {
+                            if ( stats ) {
+                                std::lock_guard<std::mutex> lock( stats->mutex );
+                                stats->cached_tiles += first.cached_tiles.size();
+                            }
+                            item.cached_tiles = std::move( first.cached_tiles );
+                            item.rendered_tiles = std::move( first.rendered_tiles );
+                        }
+
+                        if ( item.last_batch && options->compare_modes ) {
+                            StageTimer timer( stats, Stage::Tessellation );
+                            item.ref_gp.cache = &tessellation_cache;
+                            sdf_atlas->draw_glyphs( item.ref_gp, page, nullptr, threads );
+                        }
+
+                        pages.push( std::move( item ) );
+                    }
+                }
+            }
+        }
+
+        pages.close();
+    };
+
+    // Encoding stage: storing the rendered tiles and copying the cached ones, PNG encoding
+
+    auto encode = [&]() {
+        EncodeItem item;
+
+        while ( encoded.pop( item ) ) {
+            if ( failed ) continue;
+
+            const AtlasOptions &options = *item.options;
+            int width = options.width;
+
+            for ( const GlyphTile &tile : item.rendered_tiles ) {
+                int x, y, w, h;
+                tile_box( item.atlas->glyph_rects[ tile.rect ], x, y, w, h );
+                std::vector<uint8_t> tile_pixels( w * h );
+                for ( int iy = 0; iy < h; ++iy ) {
+                    memcpy( &tile_pixels[ iy * w ], &item.pixels[ ( y + iy ) * width + x ], w );
+                }
+                tile_cache->store( tile.key, w, h, tile_pixels.data() );
+            }
+
+            for ( const GlyphTile &tile : item.cached_tiles ) {
+                int x, y, w, h;
+                tile_box( item.atlas->glyph_rects[ tile.rect ], x, y, w, h );
+                for ( int iy = 0; iy < h; ++iy ) {
+                    memcpy( &item.pixels[ ( y + iy ) * width + x ], &tile.pixels[ iy * w ], w );
+                }
+            }
+
+            {
+                StageTimer timer( stats, Stage::Flip );
+                flip_rows( item.pixels.data(), width, item.height );
+            }
+
+            std::vector<uint8_t> png;
+            if ( options.raw_pixels ) {
+                png.swap( item.pixels );
+            } else {
+                StageTimer timer( stats, Stage::PngEncode );
+                if ( !write_png( item.pixels.data(), width, item.height, png ) ) {
+                    fail( "Error encoding png." );
+                    failed = true;
+                    continue;
+                }
+            }
+
+            if ( stats ) {
+                std::lock_guard<std::mutex> lock( stats->mutex );
+                stats->peak_png = std::max( stats->peak_png, png.capacity() );
+            }
+
+            bool ok = false;
+            {
+                StageTimer timer( stats, Stage::PageOutput );
+                ok = sink.page( options, *item.atlas, item.page, png );
+            }
+            if ( ok && item.page == item.atlas->page_count - 1 ) {
+                StageTimer timer( stats, Stage::Json );
+                ok = sink.atlas( options, *item.atlas, item.height );
+            }
+
+            if ( !ok ) {
+                fail( "Error saving atlas '" + options.name + "'" );
+                failed = true;
+            }
+
+            item = EncodeItem();
+        }
+    };
+
+    std::thread tessellate_thread( tessellate );
+    std::thread encode_thread( encode );
+
+    // Rendering stage, GL calls stay on the thread owning the context.
+    // The batch arena goes back to the tessellation stage right after drawing.
+
+    PageItem   item;
+    EncodeItem out;
+    bool       render_gl = true;
+    float      line_area = 0.0f;
+
+    auto recycle = [&]() {
+        item.gp.clear();
+        free_arenas.push( std::move( item.gp ) );
+        item = PageItem();
+    };
+
+    while ( pages.pop( item ) ) {
+        if ( failed ) {
+            recycle();
+            continue;
+        }
+
+        const AtlasOptions &options = *item.options;
+        size_t pic_size = options.width * item.height;
+        bool ok = true;
+
+        if ( item.first_batch ) {
+            out = EncodeItem();
+            out.options = item.options;
+            out.atlas = item.atlas;
+            out.page = item.page;
+            out.height = item.height;
+            out.pixels.resize( pic_size );
+            out.cached_tiles = std::move( item.cached_tiles );
+
+            if ( stats ) {
+                std::lock_guard<std::mutex> lock( stats->mutex );
+                stats->peak_page_pixels = std::max( stats->peak_page_pixels, out.pixels.capacity() );
+            }
+            out.rendered_tiles = std::move( item.rendered_tiles );
+
+            // Page made of the cached tiles only is not rendered
+
+            bool use_tile_cache = !out.cached_tiles.empty() || !out.rendered_tiles.empty();
+            render_gl = !use_tile_cache || !out.rendered_tiles.empty();
+            line_area = 0.0f;
+
+            if ( render_gl ) {
+                StageTimer timer( stats, Stage::Render );
+                ok = begin_page( options.width, item.height );
+            }
+        }
+
+        if ( ok && render_gl ) {
+            StageTimer timer( stats, Stage::Render );
+            ok = render_batch( options.sdf_mode, *item.atlas, item.gp, options.width, item.height );
+            line_area += rects_area( item.gp.lp.rects );
+        }
+
+        if ( ok && render_gl && item.last_batch ) {
+            {
+                StageTimer timer( stats, Stage::Readback );
+                end_page( options.sdf_mode, options.width, item.height, out.pixels.data() );
+            }
+            if ( options.sdf_mode == SdfMode::Stencil ) line_pass_message( *item.atlas, item.page, line_area );
+        }
+
+        if ( ok && item.last_batch && options.compare_modes ) {
+            StageTimer timer( stats, Stage::Render );
+            std::vector<uint8_t> ref( pic_size );
+            ok = render( SdfMode::Stencil, *item.atlas, item.ref_gp, item.page, options.width, item.height, ref.data() );
+            if ( ok ) compare( *this, out.pixels.data(), ref.data(), pic_size );
+        }
+
+        bool last_batch = item.last_batch;
+        recycle();
+
+        if ( !ok ) {
+            failed = true;
+            continue;
+        }
+
+        if ( last_batch ) encoded.push( std::move( out ) );
+    }
+
+    encoded.close();
+
+    tessellate_thread.join();
+    encode_thread.join();
+
+    glFinish();
+
+    if ( stats ) {
+        size_t cache_memory = tessellation_cache.memory();
+        std::lock_guard<std::mutex> lock( stats->mutex );
+        stats->wall_time += std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        stats->peak_tessellation_cache = std::max( stats->peak_tessellation_cache, cache_memory );
+    }
+
+    return !failed;
+}
+
+bool parse_unicode_ranges( const std::string &text, std::vector<UnicodeRange> &ranges ) {
+    const char *pos = text.c_str();
+
+    for(;;) {
+        char *new_pos = nullptr;
+
+        errno = 0;
+        long range_start = strtol( pos, &new_pos, 0 );
+        if ( errno != 0 || new_pos == pos || range_start < 0 ) return false;
+        long range_end = range_start;
+
+        pos = new_pos;
+        char lim = *pos++;
+
+        if ( lim == ':' ) {
+            errno = 0;
+            range_end = strtol( pos, &new_pos, 0 );
+            if ( errno != 0 || new_pos == pos || range_end < 0 ) return false;
+            pos = new_pos;
+            lim = *pos++;
+        }
+
+        if ( lim != ',' && lim != 0 ) return false;
+
+        ranges.push_back( UnicodeRange { (uint32_t) range_start, (uint32_t) range_end } );
+        if ( lim == 0 ) return true;
+    }
+}
+
+void count_utf8( const std::string &text, std::unordered_map<uint32_t, size_t> &freq ) {
+    // Smallest codepoint of a sequence length, shorter sequences are overlong
+    static const uint32_t min_cp[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    size_t i = 0;
+    while ( i < text.size() ) {
+        uint8_t c = text[ i ];
+        uint32_t cp = 0;
+        int len = 0;
+
+        if ( c < 0x80 ) {
+            cp = c; len = 1;
+        } else if ( ( c & 0xe0 ) == 0xc0 ) {
+            cp = c & 0x1f; len = 2;
+        } else if ( ( c & 0xf0 ) == 0xe0 ) {
+            cp = c & 0x0f; len = 3;
+        } else if ( ( c & 0xf8 ) == 0xf0 ) {
+            cp = c & 0x07; len = 4;
+        } else {
+            i++;
+            continue;
+        }
+
+        bool valid = i + len <= text.size();
+        for ( int k = 1; valid && k < len; ++k ) {
+            uint8_t cc = text[ i + k ];
+            if ( ( cc & 0xc0 ) != 0x80 ) {
+                valid = false;
+                break;
+            }
+            cp = ( cp << 6 ) | ( cc & 0x3f );
+        }
+
+        if ( valid && ( cp < min_cp[ len ] || cp > 0x10ffff || ( cp >= 0xd800 && cp <= 0xdfff ) ) ) valid = false;
+
+        if ( !valid ) {
+            i++;
+            continue;
+        }
+
+        freq[ cp ]++;
+        i += len;
+    }
+}
+
+std::vector<uint32_t> frequency_order( const std::unordered_map<uint32_t, size_t> &freq ) {
+    std::vector<uint32_t> codepoints;
+    for ( const auto &kv : freq ) {
+        codepoints.push_back( kv.first );
+    }
+
+    std::sort( codepoints.begin(), codepoints.end(), [&freq]( uint32_t a, uint32_t b ) {
+        size_t fa = freq.at( a ), fb = freq.at( b );
+        return fa != fb ? fa > fb : a < b;
+    } );
+
+    return codepoints;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sdf_gl.h"
+#include "sdf_atlas.h"
+#include "glyph_painter.h"
+#include "tile_cache.h"
+#include "generation_stats.h"
+#include "font.h"
+
+// SDF atlas generation library. SdfGenerator is the context holding the GL objects
+// and the loaded fonts, there is no global state, so the generators with their own
+// GL contexts can run concurrently on different threads.
+// Loaded fonts are immutable and shared as const, safe to read from any thread.
+
+struct UnicodeRange {
+    uint32_t start;
+    uint32_t end;       // Inclusive
+};
+
+// Options of one atlas
+
+struct AtlasOptions {
+    std::vector<const Font*>  fonts;                // Fallback chain
+    std::vector<UnicodeRange> unicode_ranges;       // Empty - printable ASCII
+    std::vector<uint32_t>     corpus_codepoints;    // If set, allocated first in this order, ranges are added after
+    int          width = 1024;
+    int          tex_height = 0;                    // Page height, 0 - packed height
+    int          row_height = 96;
+    int          border_size = 16;
+    SdfMode      sdf_mode = SdfMode::Stencil;
+    PackerType   packer_type = PackerType::Shelf;
+    PagePolicy   page_policy = PagePolicy::Fill;
+    bool         compare_modes = false;             // Log the difference from the 'stencil' mode
+    bool         use_tile_cache = false;
+    bool         raw_pixels = false;                // Sink gets the unencoded page rows, top to bottom, instead of a PNG
+    std::string  name;                              // Passed to the sink
+};
+
+// Receives the generated atlases on the encoding thread. Returning false stops the generation.
+
+struct AtlasSink {
+    virtual ~AtlasSink() {}
+
+    // Encoded PNG ( or raw pixels ) of a page, the buffer can be taken over with swap()
+    virtual bool page( const AtlasOptions &options, const SdfAtlas &atlas, int page, std::vector<uint8_t> &png ) = 0;
+
+    // All the pages are done, the atlas is complete
+    virtual bool atlas( const AtlasOptions &options, const SdfAtlas &atlas, int height ) = 0;
+};
+
+struct SdfGenerator {
+    SdfGl        sdf_gl;
+    int          max_tex_size = 2048;
+
+    // Optional, shared by the generators
+    TileCache   *tile_cache = nullptr;
+
+    // Optional stage times and counters, accumulated by load_font(), layout() and generate()
+    GenerationStats *stats = nullptr;
+
+    // Glyph tessellations shared by all the atlases and sizes
+    TessellationCache tessellation_cache;
+
+    int          tessellation_threads = 0;                // Page tessellation threads, 0 - hardware concurrency
+
+    // Pages are tessellated and rendered in batches of glyphs, each fitting into an arena of
+    // batch_vertices per vertex stream. A few arenas are recycled between the pipeline stages,
+    // so the vertex memory doesn't depend on the glyph count.
+    size_t       batch_vertices = 1 << 16;
+
+    // Progress messages, called from the pipeline threads one message at a time
+    std::function<void( const std::string& )> log;
+
+    // Render target, resized to the page size
+    GLuint       color_tex = 0;
+    GLuint       rbds = 0;
+    GLuint       fbo = 0;
+    int          target_width = 0;
+    int          target_height = 0;
+
+    std::mutex   font_mutex;
+    std::map<std::string, std::unique_ptr<Font>> fonts;   // Loaded fonts by path
+    std::map<std::string, uint64_t> font_use;             // Last load_font() call of a font
+    uint64_t     font_clock = 0;
+    size_t       max_fonts = 0;                           // Loaded fonts cap for trim_fonts(), 0 - unlimited
+
+    std::mutex   log_mutex;
+
+    std::string  error;                                   // Last error
+
+    // Requires a current GL context, rendering calls must be made with the same context current
+    bool init();
+
+    void destroy();
+
+    // Loads the font or returns the already loaded one, nullptr on error
+    const Font* load_font( const std::string &filename );
+
+    // Unloads the least recently used fonts above max_fonts, returns the number unloaded.
+    // Their pointers become invalid, so it's called between the generate() calls.
+    size_t trim_fonts();
+
+    // Allocates and packs the glyphs, no GL calls
+    bool layout( const AtlasOptions &options, SdfAtlas &atlas );
+
+    // Largest row height, for which the glyphs fit into a fit_width x fit_height page, no rendering.
+    // The border size keeps its ratio to the row height unless 'fixed_border'. Updates the options.
+    bool fit( AtlasOptions &options, int fit_width, int fit_height, bool fixed_border );
+
+    // Renders the tessellated page into the caller buffer of width x height bytes, rows in the GL order
+    bool render( SdfMode mode, const SdfAtlas &atlas, const GlyphPainter &gp, int page, int width, int height, uint8_t *pixels );
+
+    // Tessellates and renders a page in batches
+    bool render_page( const AtlasOptions &options, const SdfAtlas &atlas, int page, int height, uint8_t *pixels );
+
+    // Batched page rendering: begin_page(), render_batch() for every batch, end_page() reading the pixels
+    bool begin_page( int width, int height );
+
+    bool render_batch( SdfMode mode, const SdfAtlas &atlas, const GlyphPainter &gp, int width, int height );
+
+    void end_page( SdfMode mode, int width, int height, uint8_t *pixels );
+
+    // Logs the stencil mode line pass area of a page
+    void line_pass_message( const SdfAtlas &atlas, int page, float line_area );
+
+    // Flips the GL order rows in place, top to bottom
+    static void flip_rows( uint8_t *pixels, int width, int height );
+
+    // Flips the GL order rows in place and encodes them as a grayscale PNG
+    static bool encode_png( uint8_t *pixels, int width, int height, std::vector<uint8_t> &png );
+
+    // Encodes the top to bottom rows as a grayscale PNG
+    static bool write_png( const uint8_t *pixels, int width, int height, std::vector<uint8_t> &png );
+
+    // Generates the atlases through the tessellation, rendering ( calling thread ) and encoding stages
+    bool generate( const std::vector<AtlasOptions> &atlases, AtlasSink &sink );
+
+    // Appends the atlases of the next job, leaves them empty when there are no more jobs.
+    // Returns false on error, setting it with fail().
+    using JobSource = std::function<bool( std::vector<AtlasOptions> &atlases )>;
+
+    // Generates the jobs as they come, next_job is called on the tessellation thread when it's
+    // ready for the next job, so the job planning and font loading overlap with the rendering
+    bool generate( const JobSource &next_job, AtlasSink &sink );
+
+    int thread_count() const;
+
+    void message( const std::string &text );
+
+    // Sets the error, returns false
+    bool fail( const std::string &text );
+
+    bool resize_target( int w, int h );
+};
+
+// Parses 'start1:end1,start2:end2,single_codepoint' ranges, returns false on syntax errors
+bool parse_unicode_ranges( const std::string &text, std::vector<UnicodeRange> &ranges );
+
+// Counts the codepoints of UTF-8 text. Invalid sequences, overlong encodings, surrogates
+// and values above U+10FFFF are skipped.
+void count_utf8( const std::string &text, std::unordered_map<uint32_t, size_t> &freq );
+
+// Codepoints ordered by frequency, most frequent first, ties in codepoint order
+std::vector<uint32_t> frequency_order( const std::unordered_map<uint32_t, size_t> &freq );
@@ -28,41 +28,135 @@
 #include "shaders/line_vsh.cpp"
 #include "shaders/line_fsh.cpp"
 
+#include "shaders/quad_vsh.cpp"
+#include "shaders/quad_fsh.cpp"
+
+#include "shaders/sdf_csh.cpp"
+
+#include <algorithm>
+#include <cmath>
+
 
 VertexAttrib vattribs[] = {
     VertexAttrib( 0, "pos", 2 ),
-    VertexAttrib( 1, "par", 2 ),
-    VertexAttrib( 2, "limits", 2 ),
-    VertexAttrib( 3, "scale", 1 ),
-    VertexAttrib( 4, "line_width", 1 )
+    VertexAttrib( 1, "par", 2, vatypes::gl_byte )
 };
 
 constexpr size_t vattribs_count = sizeof( vattribs ) / sizeof( vattribs[0] );
 
+VertexAttrib qattribs[] = {
+    VertexAttrib( 0, "pos", 2 ),
+    VertexAttrib( 1, "segments", 2, vatypes::gl_uint, false, nullptr, true )
+};
+
+constexpr size_t qattribs_count = sizeof( qattribs ) / sizeof( qattribs[0] );
+
+// SdfSegment size in RGBA32F texels
+constexpr size_t seg_texels = sizeof( SdfSegment ) / ( 4 * sizeof( float ) );
+
+// SdfLineRect size in RGBA32F texels
+constexpr size_t line_texels = sizeof( SdfLineRect ) / ( 4 * sizeof( float ) );
+
+// Compute shader tile size
+constexpr int tile_size = 16;
+
 void SdfGl::init() {
-    initVertexAttribs( vattribs, vattribs_count );
+    initVertexAttribs( vattribs, vattribs_count, nullptr, sizeof( SdfFillVertex ) );
     fill_prog = createProgram( "fill", shape_vsh, shape_fsh, vattribs, vattribs_count );
     initUniformStruct( fill_prog, ufill );
 
-    line_prog = createProgram( "line", line_vsh, line_fsh, vattribs, vattribs_count );
+    line_prog = createProgram( "line", line_vsh, line_fsh );
     initUniformStruct( line_prog, uline );
+
+    glGenBuffers( 1, &line_buffer );
+    glGenTextures( 1, &line_texture );
+
+    initVertexAttribs( qattribs, qattribs_count );
+    quad_prog = createProgram( "quad", quad_vsh, quad_fsh, qattribs, qattribs_count );
+    initUniformStruct( quad_prog, uquad );
+
+    glGenBuffers( 1, &seg_buffer );
+    glGenTextures( 1, &seg_texture );
+    glGetIntegerv( GL_MAX_TEXTURE_BUFFER_SIZE, &max_seg_texels );
+
+    GLint major = 0, minor = 0;
+    glGetIntegerv( GL_MAJOR_VERSION, &major );
+    glGetIntegerv( GL_MINOR_VERSION, &minor );
+    compute_supported = major > 4 || ( major == 4 && minor >= 3 );
+
+    if ( compute_supported ) {
+        compute_prog = createComputeProgram( "sdf", sdf_csh );
+        initUniformStruct( compute_prog, ucompute );
+
+        glGenBuffers( 1, &seg_ssbo );
+        glGenBuffers( 1, &tiles_ssbo );
+        glGenBuffers( 1, &tile_segs_ssbo );
+        glGenBuffers( 1, &glyph_rects_ssbo );
+        glGetIntegerv( GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &max_ssbo_size );
+    }
 }
 
-void SdfGl::render_sdf( F2 tex_size, const std::vector<SdfVertex> &fill_vertices, const std::vector<SdfVertex> &line_vertices ) {
+void SdfGl::render_sdf( F2 tex_size, const std::vector<SdfFillVertex> &fill_vertices, const std::vector<SdfLineRect> &line_rects,
+                        const std::vector<SdfClip> &clips ) {
+    draw_sdf_batch( tex_size, fill_vertices.data(), fill_vertices.size(), line_rects.data(), line_rects.size(), clips.data(), clips.size() );
+    if ( fill_vertices.size() ) invert_sdf_fill();
+}
 
-    // full screen quad vertices    
-    SdfVertex fs_quad[6] = {
-        { F2( -1.0, -1.0 ), F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f },
-        { F2(  1.0, -1.0 ), F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f },
-        { F2(  1.0,  1.0 ), F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f },
-        
-        { F2( -1.0, -1.0 ), F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f },
-        { F2(  1.0,  1.0 ), F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f },
-        { F2( -1.0,  1.0 ), F2( 0.0f, 1.0f ), F2( 0.0f ), 0.0f, 0.0f }
-    };
+// Calls draw( first, count ) for the [ begin, end ) items, the clip ranges scissored to their boxes
+// intersected with the scissor box set by the caller. range( clip, start, end ) selects the clip item range.
+
+template <class Range, class Draw>
+static void draw_clipped( size_t begin, size_t end, const SdfClip *clips, size_t clip_count, Range range, Draw draw ) {
+    if ( clip_count == 0 ) {
+        if ( end > begin ) draw( begin, end - begin );
+        return;
+    }
+
+    GLboolean outer_scissor = glIsEnabled( GL_SCISSOR_TEST );
+    GLint outer[4];
+    glGetIntegerv( GL_SCISSOR_BOX, outer );
+
+    size_t pos = begin;
+
+    for ( size_t ic = 0; ic < clip_count; ++ic ) {
+        const SdfClip &clip = clips[ ic ];
+        size_t cstart, cend;
+        range( clip, cstart, cend );
+        cstart = std::max( cstart, begin );
+        cend = std::min( cend, end );
+        if ( cstart >= cend ) continue;
+
+        if ( cstart > pos ) draw( pos, cstart - pos );
+
+        int x0 = clip.x, y0 = clip.y, x1 = clip.x + clip.w, y1 = clip.y + clip.h;
+        if ( outer_scissor ) {
+            x0 = std::max( x0, outer[0] );
+            y0 = std::max( y0, outer[1] );
+            x1 = std::min( x1, outer[0] + outer[2] );
+            y1 = std::min( y1, outer[1] + outer[3] );
+        }
+
+        if ( x1 > x0 && y1 > y0 ) {
+            glEnable( GL_SCISSOR_TEST );
+            glScissor( x0, y0, x1 - x0, y1 - y0 );
+            draw( cstart, cend - cstart );
+        }
+
+        if ( outer_scissor ) {
+            glScissor( outer[0], outer[1], outer[2], outer[3] );
+        } else {
+            glDisable( GL_SCISSOR_TEST );
+        }
+
+        pos = cend;
+    }
+
+    if ( end > pos ) draw( pos, end - pos );
+}
 
-    size_t lcount = line_vertices.size();
-    size_t fcount = fill_vertices.size();
+void SdfGl::draw_sdf_batch( F2 tex_size, const SdfFillVertex *fill_vertices, size_t fcount, const SdfLineRect *line_rects, size_t lcount,
+                            const SdfClip *clips, size_t clip_count ) {
+    static_assert( sizeof( SdfLineRect ) % ( 4 * sizeof( float ) ) == 0, "SdfLineRect should be a whole number of RGBA32F texels" );
 
     // screen matrix
     float mscreen3[] = {
@@ -70,37 +164,52 @@ void SdfGl::render_sdf( F2 tex_size, const std::vector<SdfVertex> &fill_vertices
           0, 2.0f / tex_size.y, 0,
           -1, -1, 1 };
 
-    // identity matrix
-    float mid[] = {
-        1, 0, 0,
-        0, 1, 0,
-        0, 0, 1
-    };
-
     glViewport( 0, 0, tex_size.x, tex_size.y );    
 
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
 
-    // Drawing lines with depth test
+    // Drawing lines with depth test, rects are drawn in parts fitting into the buffer texture
 
-    if ( line_vertices.size() ) {
-    
-        bindAttribs( vattribs, vattribs_count, (size_t) line_vertices.data() );
+    if ( lcount ) {
 
         glUseProgram( line_prog );
         uline.transform_matrix.setv( mscreen3 );
+        uline.line_data.set( 0 );
+
+        glActiveTexture( GL_TEXTURE0 );
+        glBindTexture( GL_TEXTURE_BUFFER, line_texture );
+
         glEnable( GL_DEPTH_TEST );
         glDepthFunc( GL_LEQUAL );
-        glDrawArrays( GL_TRIANGLES, 0, lcount );    
-        glDisable( GL_DEPTH_TEST );
 
+        size_t max_rects = max_seg_texels / line_texels;
+
+        for ( size_t rstart = 0; rstart < lcount; rstart += max_rects ) {
+            size_t rcount = std::min( max_rects, lcount - rstart );
+
+            glBindBuffer( GL_TEXTURE_BUFFER, line_buffer );
+            glBufferData( GL_TEXTURE_BUFFER, rcount * sizeof( SdfLineRect ), line_rects + rstart, GL_STREAM_DRAW );
+            glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, line_buffer );
+            glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+            auto line_range = []( const SdfClip &clip, size_t &start, size_t &end ) {
+                start = clip.line_start;
+                end = clip.line_end;
+            };
+            draw_clipped( rstart, rstart + rcount, clips, clip_count, line_range, [rstart]( size_t first, size_t count ) {
+                glDrawArrays( GL_TRIANGLES, ( first - rstart ) * 6, count * 6 );
+            } );
+        }
+
+        glDisable( GL_DEPTH_TEST );
+        glBindTexture( GL_TEXTURE_BUFFER, 0 );
     }
 
-    // Drawing fills
+    // Drawing fills into the stencil buffer
 
-    if ( fill_vertices.size() ) {
+    if ( fcount ) {
     
-        bindAttribs( vattribs, vattribs_count, (size_t) fill_vertices.data() );
+        bindAttribs( vattribs, vattribs_count, (size_t) fill_vertices );
     
         glUseProgram( fill_prog );
         ufill.transform_matrix.setv( mscreen3 );
@@ -111,25 +220,242 @@ void SdfGl::render_sdf( F2 tex_size, const std::vector<SdfVertex> &fill_vertices
         glStencilFunc( GL_ALWAYS, 0, 0xff );
         glStencilOpSeparate( GL_FRONT, GL_KEEP, GL_INCR_WRAP, GL_INCR_WRAP );
         glStencilOpSeparate( GL_BACK, GL_KEEP, GL_DECR_WRAP, GL_DECR_WRAP );
-        glDrawArrays( GL_TRIANGLES, 0, fcount );        
+        auto fill_range = []( const SdfClip &clip, size_t &start, size_t &end ) {
+            start = clip.fill_start;
+            end = clip.fill_end;
+        };
+        draw_clipped( 0, fcount, clips, clip_count, fill_range, []( size_t first, size_t count ) {
+            glDrawArrays( GL_TRIANGLES, first, count );
+        } );
 
-        // Drawing full screen quad, inverting colors where stencil == 1
+        glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+        glDisable( GL_STENCIL_TEST );
+    }
 
-        bindAttribs( vattribs, vattribs_count, (size_t) fs_quad );
+    unbindAttribs( vattribs, vattribs_count );
+    glUseProgram( 0 );
+}
 
-        glEnable( GL_BLEND );
-        glBlendEquation( GL_FUNC_ADD );
-        glBlendFunc( GL_ONE_MINUS_DST_COLOR, GL_ZERO );
-        glStencilFunc( GL_NOTEQUAL, 0, 0xff );
-        glStencilOp( GL_ZERO, GL_ZERO, GL_ZERO );
-        glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
-        ufill.transform_matrix.setv( mid );
-        glDrawArrays( GL_TRIANGLES, 0, 6 );
+void SdfGl::invert_sdf_fill() {
 
-    }
+    // full screen quad vertices    
+    SdfFillVertex fs_quad[6] = {
+        { F2( -1.0, -1.0 ), { 0, 1 }, { 0, 0 } },
+        { F2(  1.0, -1.0 ), { 0, 1 }, { 0, 0 } },
+        { F2(  1.0,  1.0 ), { 0, 1 }, { 0, 0 } },
+        
+        { F2( -1.0, -1.0 ), { 0, 1 }, { 0, 0 } },
+        { F2(  1.0,  1.0 ), { 0, 1 }, { 0, 0 } },
+        { F2( -1.0,  1.0 ), { 0, 1 }, { 0, 0 } }
+    };
+
+    // identity matrix
+    float mid[] = {
+        1, 0, 0,
+        0, 1, 0,
+        0, 0, 1
+    };
+
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    bindAttribs( vattribs, vattribs_count, (size_t) fs_quad );
+
+    glUseProgram( fill_prog );
+    ufill.transform_matrix.setv( mid );
+
+    // Inverting colors where stencil != 0
+
+    glEnable( GL_STENCIL_TEST );
+    glEnable( GL_BLEND );
+    glBlendEquation( GL_FUNC_ADD );
+    glBlendFunc( GL_ONE_MINUS_DST_COLOR, GL_ZERO );
+    glStencilFunc( GL_NOTEQUAL, 0, 0xff );
+    glStencilOp( GL_ZERO, GL_ZERO, GL_ZERO );
+    glDrawArrays( GL_TRIANGLES, 0, 6 );
 
     glDisable( GL_BLEND );
     glDisable( GL_STENCIL_TEST );
-    
+
+    unbindAttribs( vattribs, vattribs_count );
     glUseProgram( 0 );
 }
+
+void SdfGl::render_sdf_quads( F2 tex_size, float line_width, const std::vector<SdfSegment> &segments, const std::vector<SdfGlyphVertex> &vertices ) {
+    static_assert( sizeof( SdfSegment ) % ( 4 * sizeof( float ) ) == 0, "SdfSegment should be a whole number of RGBA32F texels" );
+
+    if ( vertices.empty() ) return;
+
+    // screen matrix
+    float mscreen3[] = {
+          2.0f / tex_size.x, 0, 0,
+          0, 2.0f / tex_size.y, 0,
+          -1, -1, 1 };
+
+    glViewport( 0, 0, tex_size.x, tex_size.y );
+
+    glUseProgram( quad_prog );
+    uquad.transform_matrix.setv( mscreen3 );
+    uquad.seg_data.set( 0 );
+    uquad.line_width.set( line_width );
+
+    glActiveTexture( GL_TEXTURE0 );
+    glBindTexture( GL_TEXTURE_BUFFER, seg_texture );
+
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    bindAttribs( qattribs, qattribs_count, (size_t) vertices.data() );
+
+    // Glyph quads are drawn in batches, so the segments of a batch fit into the buffer texture
+
+    size_t max_segs = max_seg_texels / seg_texels;
+    size_t vstart = 0;
+
+    while ( vstart < vertices.size() ) {
+        size_t seg_start = vertices[ vstart ].seg_start;
+        size_t seg_end = seg_start;
+        size_t vend = vstart;
+
+        for ( ; vend < vertices.size(); vend += 6 ) {
+            size_t glyph_end = (size_t) vertices[ vend ].seg_start + vertices[ vend ].seg_count;
+            if ( glyph_end - seg_start > max_segs && vend != vstart ) break;
+            seg_end = glyph_end;
+        }
+
+        glBindBuffer( GL_TEXTURE_BUFFER, seg_buffer );
+        glBufferData( GL_TEXTURE_BUFFER, ( seg_end - seg_start ) * sizeof( SdfSegment ), segments.data() + seg_start, GL_STREAM_DRAW );
+        glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, seg_buffer );
+        glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+        uquad.seg_offset.set( seg_start );
+        glDrawArrays( GL_TRIANGLES, vstart, vend - vstart );
+
+        vstart = vend;
+    }
+
+    glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    unbindAttribs( qattribs, qattribs_count );
+    glUseProgram( 0 );
+}
+
+
+// Calls fn( tile index, tile entry, glyph index ) for every segment and tile pair.
+// Only the tiles covered by the glyph rect are considered, the shader ignores
+// the glyph segments for the tile pixels outside the glyph rect.
+// Segments closer than line_width to the tile are used for distance.
+// Segments crossing the tile rows to the right of the tile start are used for winding.
+
+template <class Fn>
+static void for_each_tile_segment( int tiles_x, int tiles_y, float line_width, const std::vector<SdfSegment> &segments, const std::vector<SdfGlyphVertex> &vertices, Fn fn ) {
+    for ( size_t iv = 0; iv + 5 < vertices.size(); iv += 6 ) {
+        F2 gmin = vertices[ iv ].pos;
+        F2 gmax = vertices[ iv + 2 ].pos;
+        uint32_t seg_start = vertices[ iv ].seg_start;
+        uint32_t seg_end = seg_start + vertices[ iv ].seg_count;
+        uint32_t glyph = iv / 6;
+
+        int gtx0 = std::max( 0, (int) floorf( gmin.x / tile_size ) );
+        int gty0 = std::max( 0, (int) floorf( gmin.y / tile_size ) );
+        int gtx1 = std::min( tiles_x - 1, (int) floorf( gmax.x / tile_size ) );
+        int gty1 = std::min( tiles_y - 1, (int) floorf( gmax.y / tile_size ) );
+
+        for ( uint32_t iseg = seg_start; iseg < seg_end; ++iseg ) {
+            const SdfSegment &seg = segments[ iseg ];
+
+            F2 wmin = min( min( seg.p0, seg.p1 ), seg.p2 );
+            F2 wmax = max( max( seg.p0, seg.p1 ), seg.p2 );
+
+            F2 dmin = seg.flags != 0 ? min( seg.vertex, seg.limits ) : wmin;
+            F2 dmax = seg.flags != 0 ? max( seg.vertex, seg.limits ) : wmax;
+            dmin -= F2( line_width );
+            dmax += F2( line_width );
+
+            for ( int ty = gty0; ty <= gty1; ++ty ) {
+                float ty0 = ty * tile_size;
+                float ty1 = ty0 + tile_size;
+                bool  wrow = wmin.y <= ty1 && wmax.y >= ty0;
+                bool  drow = dmin.y <= ty1 && dmax.y >= ty0;
+
+                if ( !wrow && !drow ) continue;
+
+                for ( int tx = gtx0; tx <= gtx1; ++tx ) {
+                    float tx0 = tx * tile_size;
+                    float tx1 = tx0 + tile_size;
+                    uint32_t flags = 0;
+                    if ( drow && dmin.x <= tx1 && dmax.x >= tx0 ) flags |= 1;
+                    if ( wrow && wmax.x >= tx0 ) flags |= 2;
+                    if ( flags ) fn( ty * tiles_x + tx, ( iseg << 2 ) | flags, glyph );
+                }
+            }
+        }
+    }
+}
+
+
+bool SdfGl::render_sdf_compute( F2 tex_size, float line_width, const std::vector<SdfSegment> &segments, const std::vector<SdfGlyphVertex> &vertices, GLuint target_tex ) {
+    if ( !compute_supported ) return false;
+    if ( segments.size() * sizeof( SdfSegment ) > (size_t) max_ssbo_size ) return false;
+
+    int tiles_x = ( (int) tex_size.x + tile_size - 1 ) / tile_size;
+    int tiles_y = ( (int) tex_size.y + tile_size - 1 ) / tile_size;
+
+    // Binning segments, counting entries and then filling them
+
+    tiles.assign( tiles_x * tiles_y * 2, 0 );
+
+    for_each_tile_segment( tiles_x, tiles_y, line_width, segments, vertices, [this]( int itile, uint32_t, uint32_t ) {
+        tiles[ itile * 2 + 1 ]++;
+    } );
+
+    uint32_t entry_count = 0;
+    for ( size_t itile = 0; itile < tiles.size(); itile += 2 ) {
+        tiles[ itile ] = entry_count;
+        entry_count += tiles[ itile + 1 ];
+        tiles[ itile + 1 ] = 0;
+    }
+
+    if ( entry_count * 2 * sizeof( uint32_t ) > (size_t) max_ssbo_size ) return false;
+
+    tile_segs.resize( std::max( entry_count, 1u ) * 2 );
+
+    for_each_tile_segment( tiles_x, tiles_y, line_width, segments, vertices, [this]( int itile, uint32_t entry, uint32_t glyph ) {
+        uint32_t ientry = tiles[ itile * 2 ] + tiles[ itile * 2 + 1 ]++;
+        tile_segs[ ientry * 2 ] = entry;
+        tile_segs[ ientry * 2 + 1 ] = glyph;
+    } );
+
+    glyph_rects.clear();
+    for ( size_t iv = 0; iv + 5 < vertices.size(); iv += 6 ) {
+        glyph_rects.push_back( vertices[ iv ].pos );
+        glyph_rects.push_back( vertices[ iv + 2 ].pos );
+    }
+    if ( glyph_rects.empty() ) glyph_rects.resize( 2 );
+
+    // Uploading and dispatching one workgroup per tile
+
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, seg_ssbo );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, std::max( segments.size(), (size_t) 1 ) * sizeof( SdfSegment ), segments.data(), GL_STREAM_DRAW );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, tiles_ssbo );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, tiles.size() * sizeof( uint32_t ), tiles.data(), GL_STREAM_DRAW );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, tile_segs_ssbo );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, tile_segs.size() * sizeof( uint32_t ), tile_segs.data(), GL_STREAM_DRAW );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, glyph_rects_ssbo );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, glyph_rects.size() * sizeof( F2 ), glyph_rects.data(), GL_STREAM_DRAW );
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, seg_ssbo );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, tiles_ssbo );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, tile_segs_ssbo );
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 3, glyph_rects_ssbo );
+    glBindImageTexture( 0, target_tex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8 );
+
+    glUseProgram( compute_prog );
+    ucompute.line_width.set( line_width );
+    ucompute.tex_size.set( tex_size.x, tex_size.y );
+    ucompute.tiles_x.set( tiles_x );
+
+    glDispatchCompute( tiles_x, tiles_y, 1 );
+    glMemoryBarrier( GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT );
+
+    glBindImageTexture( 0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8 );
+    glUseProgram( 0 );
+
+    return true;
+}
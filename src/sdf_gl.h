@@ -23,32 +23,155 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include "float2.h"
 #include "gl_utils.h"
 
 
-struct SdfVertex {
-    F2    pos;        // Vertex position
-    F2    par;        // Vertex position in parabola space
+// Fill pass vertex. Curve triangle coordinates are -1, 0 or 1, exact in bytes.
+
+struct SdfFillVertex {
+    F2     pos;       // Vertex position
+    int8_t par[2];    // Vertex position in the curve triangle space, 0, 1 for the solid triangles
+    int8_t pad[2];
+};
+
+
+// Line pass segment rect, stored as 5 RGBA32F texels in a buffer texture.
+// The vertex shader expands a rect into 2 triangles, so the per-segment data
+// is not repeated per vertex.
+
+struct SdfLineRect {
+    F2    pos[4];     // Corners
+    F2    par[4];     // Corners in parabola space
     F2    limits;     // Parabolic segment xstart, xend
     float scale;      // Parabola scale relative to world
     float line_width; // Line width in world space
 };
 
 
+// Stencil mode geometry of a glyph reaching past its rect, drawn scissored to the rect pixel box,
+// so the glyph doesn't draw into the neighbouring rects
+
+struct SdfClip {
+    int    x, y, w, h;                  // Scissor box
+    size_t fill_start, fill_end;        // Fill vertices
+    size_t line_start, line_end;        // Line rects
+};
+
+
+// Rendering modes:
+// Stencil   - line pass with depth test, stencil fill pass and full screen inversion
+// GlyphQuad - single pass, one quad per glyph looping over the glyph segments
+// Compute   - compute shader, segments binned into screen tiles, requires GL 4.3
+
+enum class SdfMode {
+    Stencil, GlyphQuad, Compute
+};
+
+
+// Glyph segment for the GlyphQuad and Compute modes, stored as 4 RGBA32F texels in a buffer texture.
+// Straight segments use exact point to line distance and crossing instead of the parabola,
+// their endpoints are stored in place of the parabola vertex and limits.
+
+struct SdfSegment {
+    enum Flags {
+        Line = 1      // Straight segment
+    };
+
+    F2    p0, p1;     // Quadratic Bezier control points, used for the winding number
+    F2    p2;
+    float scale;      // Parabola scale relative to world
+    float flags;
+    F2    xaxis;      // Parabola transform
+    F2    yaxis;
+    F2    vertex;     // Line start for straight segments
+    F2    limits;     // Parabolic segment xstart, xend or line end for straight segments
+};
+
+
+struct SdfGlyphVertex {
+    F2       pos;         // Vertex position
+    uint32_t seg_start;   // Glyph segments, integer attributes, exact for any segment count
+    uint32_t seg_count;
+};
+
+
 struct GlyphUnf {
     UNIFORM_MATRIX( 3, transform_matrix );
 };
 
 
+struct LineUnf {
+    UNIFORM_MATRIX( 3, transform_matrix );
+    UNIFORM( 1i, line_data );
+};
+
+
+struct GlyphQuadUnf {
+    UNIFORM_MATRIX( 3, transform_matrix );
+    UNIFORM( 1i, seg_data );
+    UNIFORM( 1i, seg_offset );
+    UNIFORM( 1f, line_width );
+};
+
+
+struct ComputeUnf {
+    UNIFORM( 1f, line_width );
+    UNIFORM( 2i, tex_size );
+    UNIFORM( 1i, tiles_x );
+};
+
+
 struct SdfGl {
     
-    GLuint fill_prog = 0, line_prog = 0;
+    GLuint fill_prog = 0, line_prog = 0, quad_prog = 0;
+
+    GlyphUnf ufill;
 
-    GlyphUnf ufill, uline;
+    LineUnf  uline;
+
+    GLuint line_buffer = 0, line_texture = 0;
+
+    GlyphQuadUnf uquad;
+
+    GLuint seg_buffer = 0, seg_texture = 0;
+    GLint  max_seg_texels = 0;
+
+    GLuint compute_prog = 0;
+    bool   compute_supported = false;
+
+    ComputeUnf ucompute;
+
+    GLuint seg_ssbo = 0, tiles_ssbo = 0, tile_segs_ssbo = 0, glyph_rects_ssbo = 0;
+    GLint  max_ssbo_size = 0;
+
+    // Per tile start and count in tile_segs
+    std::vector<uint32_t> tiles;
+    // Tile entry pairs: segment index << 2 | 1 - distance, 2 - winding; glyph index
+    std::vector<uint32_t> tile_segs;
+    // Glyph rects min.xy, max.xy
+    std::vector<F2>       glyph_rects;
 
     void init();
 
-    void render_sdf( F2 tex_size, const std::vector<SdfVertex> &fill_vertices, const std::vector<SdfVertex> &line_vertices );
+    void render_sdf( F2 tex_size, const std::vector<SdfFillVertex> &fill_vertices, const std::vector<SdfLineRect> &line_rects,
+                     const std::vector<SdfClip> &clips = std::vector<SdfClip>() );
+
+    // Stencil mode in batches: draw_sdf_batch() for every batch, then invert_sdf_fill() once.
+    // The line pass depth test and the stencil fill parity don't depend on the drawing order,
+    // so the glyphs can be split between the batches in any way.
+    // Clip ranges are in the vertex and rect order, an enabled scissor box also applies to them.
+    void draw_sdf_batch( F2 tex_size, const SdfFillVertex *fill_vertices, size_t fcount, const SdfLineRect *line_rects, size_t lcount,
+                         const SdfClip *clips = nullptr, size_t clip_count = 0 );
+
+    void invert_sdf_fill();
+
+    // Single pass rendering, line_width is the SDF border size in pixels
+    void render_sdf_quads( F2 tex_size, float line_width, const std::vector<SdfSegment> &segments, const std::vector<SdfGlyphVertex> &vertices );
+
+    // Compute shader rendering into the GL_R8 texture, takes the same glyph quads and segments as render_sdf_quads.
+    // Returns false if the segments do not fit into a shader storage buffer.
+    bool render_sdf_compute( F2 tex_size, float line_width, const std::vector<SdfSegment> &segments, const std::vector<SdfGlyphVertex> &vertices, GLuint target_tex );
 };
@@ -1,4 +1,5 @@
 const char * const line_fsh =  R"(  // "
+#version 140
 /*
  * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
  *
@@ -20,11 +21,11 @@ const char * const line_fsh =  R"(  // "
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */    
-uniform float line_width;
-    
-varying vec2 vpar;
-varying vec2 vlimits;
-varying float dist_scale;
+in vec2  vpar;
+flat in vec2  vlimits;
+flat in float dist_scale;
+
+out vec4 frag_color;
 
 
 
@@ -118,7 +119,22 @@ float solve_par_dist( vec2 pcoord, int iter ) {
 }
 
 
+// Lower bound of the distance: distance to the bounding box of the parabolic segment
+
+float box_dist( vec2 pcoord ) {
+    float y0 = vlimits.x * vlimits.x;
+    float y1 = vlimits.y * vlimits.y;
+    float ymin = vlimits.x * vlimits.y > 0.0 ? min( y0, y1 ) : 0.0;
+    float ymax = max( y0, y1 );
+    vec2 dmin = vec2( vlimits.x, ymin ) - pcoord;
+    vec2 dmax = pcoord - vec2( vlimits.y, ymax );
+    return length( max( max( dmin, dmax ), 0.0 ) );
+}
+
+
 void main() {
+    if ( box_dist( vpar ) * dist_scale >= 1.0 ) discard;
+
     //float dist = solve_par_dist_old( vpar );
     float dist = solve_par_dist( vpar, 3 );
     float pdist = min( dist * dist_scale, 1.0 );
@@ -127,7 +143,7 @@ void main() {
 
     if ( color == 0.0 ) discard;
 
-    gl_FragColor = vec4( color );
+    frag_color = vec4( color );
     gl_FragDepth = pdist;        
 }
     
@@ -1,4 +1,5 @@
 const char * const line_vsh = R"(  // "
+#version 140
 /*
  * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
  *
@@ -23,20 +24,32 @@ const char * const line_vsh = R"(  // "
 
 uniform mat3 transform_matrix;
 
-attribute vec2 pos;
-attribute vec2 par;
-attribute vec2 limits;
-attribute float scale;
-attribute float line_width;
+// Segment rects, 5 texels per rect:
+// pos0.xy, pos1.xy | pos2.xy, pos3.xy | par0.xy, par1.xy | par2.xy, par3.xy | xstart, xend, scale, line_width
+uniform samplerBuffer line_data;
 
-varying vec2  vpar;
-varying vec2  vlimits;
-varying float dist_scale;
+out vec2  vpar;
+flat out vec2  vlimits;
+flat out float dist_scale;
+
+// Rect corners of the 2 triangles
+const int corners[6] = int[6]( 0, 1, 2, 0, 2, 3 );
 
 void main() {
-    vpar = par;
-    vlimits = limits;
-    dist_scale = scale / line_width;
+    int irect  = gl_VertexID / 6;
+    int corner = corners[ gl_VertexID - irect * 6 ];
+    int itex   = irect * 5 + corner / 2;
+
+    vec4 pos_texel = texelFetch( line_data, itex );
+    vec4 par_texel = texelFetch( line_data, itex + 2 );
+    vec4 seg_texel = texelFetch( line_data, irect * 5 + 4 );
+
+    bool odd = corner == 1 || corner == 3;
+    vec2 pos = odd ? pos_texel.zw : pos_texel.xy;
+
+    vpar = odd ? par_texel.zw : par_texel.xy;
+    vlimits = seg_texel.xy;
+    dist_scale = seg_texel.z / seg_texel.w;
     
     vec2 tpos = ( transform_matrix * vec3( pos, 1.0 ) ).xy;
     gl_Position = vec4( tpos, 0.0, 1.0 );
@@ -0,0 +1,145 @@
+const char * const quad_fsh = R"(  // "
+#version 140
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Glyph segments, 4 texels per segment:
+// p0.xy, p1.xy | p2.xy, scale, flags | xaxis.xy, yaxis.xy | vertex.xy, xstart, xend
+// Straight segments (flags == 1) have line endpoints in the last texel
+uniform samplerBuffer seg_data;
+uniform int   seg_offset;
+uniform float line_width;
+
+in vec2 vpos;
+flat in ivec2 vsegments;
+
+out vec4 frag_color;
+
+
+// Same root finding as in the line pass
+
+float solve_par_dist( vec2 pcoord, vec2 limits, int iter ) {
+    float sigx = pcoord.x > 0.0 ? 1.0 : -1.0;  
+    float px = abs( pcoord.x );
+    float py = pcoord.y;
+    float h = 0.5 * px;
+    float g = 0.5 - py;
+    float xr = sqrt( 0.5 * px );
+    float x0 = g < -h ? sqrt( abs( g ) ) :
+               g > xr ? h / abs( g ) :
+               xr;
+
+    for ( int i = 0; i < iter; ++i ) {
+        float rcx0 = 1.0 / x0;
+        float pb = h * rcx0 * rcx0;
+        float pc = -px * rcx0 + g;
+        x0 = 2.0 * pc / ( -pb - sqrt( abs( pb*pb - 4.0*pc ) ) );
+    }
+
+    x0 = sigx * x0;
+    float dx = sigx * sqrt( -0.75 * x0*x0 - g );
+    float x1 = -0.5 * x0 - dx;
+    
+    x0 = clamp( x0, limits.x, limits.y );        
+    x1 = clamp( x1, limits.x, limits.y );
+
+    float d0 = length( vec2( x0, x0*x0 ) - pcoord );
+    float d1 = length( vec2( x1, x1*x1 ) - pcoord );
+
+    return min( d0, d1 );
+}
+
+
+float line_dist( vec2 pos, vec2 lstart, vec2 lend ) {
+    vec2 ldir = lend - lstart;
+    vec2 dpos = pos - lstart;
+    float t = clamp( dot( dpos, ldir ) / dot( ldir, ldir ), 0.0, 1.0 );
+    return length( dpos - ldir * t );
+}
+
+
+// Winding number contribution of a quadratic Bezier for a ray from the origin to +x.
+// Control points are relative to the sample position.
+// Roots are selected by the equivalence class of the control points' signs,
+// as in "GPU-Centered Font Rendering Directly from Glyph Outlines" by Eric Lengyel, 2017,
+// so the segments sharing an endpoint are counted exactly once.
+
+int qbez_winding( vec2 p0, vec2 p1, vec2 p2 ) {
+    uint code = ( 0x2E74u >> ( ( p0.y > 0.0 ? 2u : 0u ) +
+                               ( p1.y > 0.0 ? 4u : 0u ) +
+                               ( p2.y > 0.0 ? 8u : 0u ) ) ) & 3u;
+    if ( code == 0u ) return 0;
+
+    vec2 a = p0 - 2.0 * p1 + p2;
+    vec2 b = p0 - p1;
+    float d = sqrt( max( b.y * b.y - a.y * p0.y, 0.0 ) );
+    float t1, t2;
+
+    // t1 = ( b - d ) / a, t2 = ( b + d ) / a, avoiding cancellation for nearly straight curves
+    if ( b.y >= 0.0 ) {
+        t1 = p0.y / ( b.y + d );
+        t2 = ( b.y + d ) / a.y;
+    } else {
+        t1 = ( b.y - d ) / a.y;
+        t2 = p0.y / ( b.y - d );
+    }
+
+    int w = 0;
+    if ( ( code & 1u ) != 0u && ( a.x * t1 - 2.0 * b.x ) * t1 + p0.x > 0.0 ) w += 1;
+    if ( code > 1u && ( a.x * t2 - 2.0 * b.x ) * t2 + p0.x > 0.0 ) w -= 1;
+    return w;
+}
+
+
+void main() {
+    float dist = 1e30;
+    int   winding = 0;
+
+    int seg_end = vsegments.x + vsegments.y;
+
+    for ( int iseg = vsegments.x; iseg < seg_end; ++iseg ) {
+        int itex = ( iseg - seg_offset ) * 4;
+        vec4 t0 = texelFetch( seg_data, itex );
+        vec4 t1 = texelFetch( seg_data, itex + 1 );
+        vec4 t2 = texelFetch( seg_data, itex + 2 );
+        vec4 t3 = texelFetch( seg_data, itex + 3 );
+
+        winding += qbez_winding( t0.xy - vpos, t0.zw - vpos, t1.xy - vpos );
+
+        if ( t1.w != 0.0 ) {
+            dist = min( dist, line_dist( vpos, t3.xy, t3.zw ) );
+        } else {
+            float scale = t1.z;
+            vec2  dpos = vpos - t3.xy;
+            vec2  pcoord = vec2( dot( dpos, t2.xy ), dot( dpos, t2.zw ) ) / scale;
+            dist = min( dist, solve_par_dist( pcoord, t3.zw, 3 ) * scale );
+        }
+    }
+
+    float pdist = min( dist / line_width, 1.0 );
+    float color = 0.5 - 0.5 * pdist;
+    if ( winding != 0 ) color = 1.0 - color;
+
+    frag_color = vec4( color );
+}
+
+)"; // "
@@ -0,0 +1,202 @@
+const char * const sdf_csh = R"(  // "
+#version 430
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// One workgroup per 16x16 tile. Segments binned to the tile are loaded
+// into shared memory in chunks and evaluated for every pixel of the tile.
+
+layout( local_size_x = 16, local_size_y = 16 ) in;
+
+layout( r8, binding = 0 ) uniform writeonly image2D atlas;
+
+// Glyph segments, 4 vec4 per segment, same layout as in the glyph quad pass:
+// p0.xy, p1.xy | p2.xy, scale, flags | xaxis.xy, yaxis.xy | vertex.xy, xstart, xend
+layout( std430, binding = 0 ) readonly buffer SegData {
+    vec4 seg_data[];
+};
+
+// Tile entries start and count
+layout( std430, binding = 1 ) readonly buffer TileData {
+    uvec2 tiles[];
+};
+
+// Tile entries: segment index << 2 | 1 - distance, 2 - winding; glyph index
+layout( std430, binding = 2 ) readonly buffer TileSegments {
+    uvec2 tile_segs[];
+};
+
+// Glyph rects min.xy, max.xy, pixels outside the rect ignore the glyph segments
+layout( std430, binding = 3 ) readonly buffer GlyphRects {
+    vec4 glyph_rects[];
+};
+
+uniform float line_width;
+uniform ivec2 tex_size;
+uniform int   tiles_x;
+
+const uint chunk_size = 256u;
+
+shared vec4 segs[ chunk_size * 4u ];
+shared uint seg_flags[ chunk_size ];
+shared vec4 seg_rects[ chunk_size ];
+
+
+// Same root finding as in the line pass
+
+float solve_par_dist( vec2 pcoord, vec2 limits, int iter ) {
+    float sigx = pcoord.x > 0.0 ? 1.0 : -1.0;  
+    float px = abs( pcoord.x );
+    float py = pcoord.y;
+    float h = 0.5 * px;
+    float g = 0.5 - py;
+    float xr = sqrt( 0.5 * px );
+    float x0 = g < -h ? sqrt( abs( g ) ) :
+               g > xr ? h / abs( g ) :
+               xr;
+
+    for ( int i = 0; i < iter; ++i ) {
+        float rcx0 = 1.0 / x0;
+        float pb = h * rcx0 * rcx0;
+        float pc = -px * rcx0 + g;
+        x0 = 2.0 * pc / ( -pb - sqrt( abs( pb*pb - 4.0*pc ) ) );
+    }
+
+    x0 = sigx * x0;
+    float dx = sigx * sqrt( -0.75 * x0*x0 - g );
+    float x1 = -0.5 * x0 - dx;
+    
+    x0 = clamp( x0, limits.x, limits.y );        
+    x1 = clamp( x1, limits.x, limits.y );
+
+    float d0 = length( vec2( x0, x0*x0 ) - pcoord );
+    float d1 = length( vec2( x1, x1*x1 ) - pcoord );
+
+    return min( d0, d1 );
+}
+
+
+float line_dist( vec2 pos, vec2 lstart, vec2 lend ) {
+    vec2 ldir = lend - lstart;
+    vec2 dpos = pos - lstart;
+    float t = clamp( dot( dpos, ldir ) / dot( ldir, ldir ), 0.0, 1.0 );
+    return length( dpos - ldir * t );
+}
+
+
+// Winding number contribution of a quadratic Bezier for a ray from the origin to +x.
+// Control points are relative to the sample position.
+// Roots are selected by the equivalence class of the control points' signs,
+// as in "GPU-Centered Font Rendering Directly from Glyph Outlines" by Eric Lengyel, 2017,
+// so the segments sharing an endpoint are counted exactly once.
+
+int qbez_winding( vec2 p0, vec2 p1, vec2 p2 ) {
+    uint code = ( 0x2E74u >> ( ( p0.y > 0.0 ? 2u : 0u ) +
+                               ( p1.y > 0.0 ? 4u : 0u ) +
+                               ( p2.y > 0.0 ? 8u : 0u ) ) ) & 3u;
+    if ( code == 0u ) return 0;
+
+    vec2 a = p0 - 2.0 * p1 + p2;
+    vec2 b = p0 - p1;
+    float d = sqrt( max( b.y * b.y - a.y * p0.y, 0.0 ) );
+    float t1, t2;
+
+    // t1 = ( b - d ) / a, t2 = ( b + d ) / a, avoiding cancellation for nearly straight curves
+    if ( b.y >= 0.0 ) {
+        t1 = p0.y / ( b.y + d );
+        t2 = ( b.y + d ) / a.y;
+    } else {
+        t1 = ( b.y - d ) / a.y;
+        t2 = p0.y / ( b.y - d );
+    }
+
+    int w = 0;
+    if ( ( code & 1u ) != 0u && ( a.x * t1 - 2.0 * b.x ) * t1 + p0.x > 0.0 ) w += 1;
+    if ( code > 1u && ( a.x * t2 - 2.0 * b.x ) * t2 + p0.x > 0.0 ) w -= 1;
+    return w;
+}
+
+
+void main() {
+    uint  local = gl_LocalInvocationIndex;
+    uvec2 tile = tiles[ gl_WorkGroupID.y * tiles_x + gl_WorkGroupID.x ];
+    ivec2 ipos = ivec2( gl_GlobalInvocationID.xy );
+    vec2  pos = vec2( ipos ) + 0.5;
+
+    float dist = 1e30;
+    int   winding = 0;
+
+    for ( uint chunk = 0u; chunk < tile.y; chunk += chunk_size ) {
+        uint count = min( tile.y - chunk, chunk_size );
+
+        if ( local < count ) {
+            uvec2 entry = tile_segs[ tile.x + chunk + local ];
+            uint  iseg = ( entry.x >> 2 ) * 4u;
+            segs[ local * 4u ]      = seg_data[ iseg ];
+            segs[ local * 4u + 1u ] = seg_data[ iseg + 1u ];
+            segs[ local * 4u + 2u ] = seg_data[ iseg + 2u ];
+            segs[ local * 4u + 3u ] = seg_data[ iseg + 3u ];
+            seg_flags[ local ] = entry.x & 3u;
+            seg_rects[ local ] = glyph_rects[ entry.y ];
+        }
+
+        barrier();
+
+        for ( uint i = 0u; i < count; ++i ) {
+            vec4 t0 = segs[ i * 4u ];
+            vec4 t1 = segs[ i * 4u + 1u ];
+            vec4 t2 = segs[ i * 4u + 2u ];
+            vec4 t3 = segs[ i * 4u + 3u ];
+            vec4 rect = seg_rects[ i ];
+            uint flags = seg_flags[ i ];
+
+            if ( any( lessThan( pos, rect.xy ) ) || any( greaterThanEqual( pos, rect.zw ) ) ) continue;
+
+            if ( ( flags & 2u ) != 0u ) {
+                winding += qbez_winding( t0.xy - pos, t0.zw - pos, t1.xy - pos );
+            }
+
+            if ( ( flags & 1u ) == 0u ) continue;
+
+            if ( t1.w != 0.0 ) {
+                dist = min( dist, line_dist( pos, t3.xy, t3.zw ) );
+            } else {
+                float scale = t1.z;
+                vec2  dpos = pos - t3.xy;
+                vec2  pcoord = vec2( dot( dpos, t2.xy ), dot( dpos, t2.zw ) ) / scale;
+                dist = min( dist, solve_par_dist( pcoord, t3.zw, 3 ) * scale );
+            }
+        }
+
+        barrier();
+    }
+
+    if ( ipos.x >= tex_size.x || ipos.y >= tex_size.y ) return;
+
+    float pdist = min( dist / line_width, 1.0 );
+    float color = 0.5 - 0.5 * pdist;
+    if ( winding != 0 ) color = 1.0 - color;
+
+    imageStore( atlas, ipos, vec4( color ) );
+}
+
+)"; // "
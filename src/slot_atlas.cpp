@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "slot_atlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool SlotAtlas::init( SdfGl &sdf_gl, const std::vector<const Font*> &fonts, int width, int height, float row_height, float sdf_size,
+                      int size_classes, SdfMode mode ) {
+    atlas.init( fonts, width, row_height, sdf_size, PackerType::Shelf );
+    atlas.page_count = 1;
+    atlas.max_height = height;
+
+    // Widest glyph of the fonts defines the largest slot
+
+    float max_width = 0.0f;
+    for ( const Font *font : fonts ) {
+        float scale = row_height / ( font->ascent - font->descent );
+        max_width = std::max( max_width, ( font->glyph_max.x - font->glyph_min.x ) * scale );
+    }
+
+    int slot_width = std::min( (int) ceil( max_width + sdf_size * 2.0f ), width );
+    slot_height = (int) ceil( row_height + sdf_size * 2.0f );
+
+    class_widths.clear();
+    for ( int k = 0; k < std::max( size_classes, 1 ); ++k ) {
+        class_widths.push_back( std::max( slot_width >> k, 1 ) );
+    }
+
+    slots.clear();
+    next_row = 0;
+    codepoint_slots.clear();
+    glyph_slots.clear();
+    use_clock = 0;
+    hits = misses = evictions = 0;
+
+    if ( slot_height > height ) return false;
+
+    return target.init( sdf_gl, width, height, mode );
+}
+
+int SlotAtlas::add_row( int size_class, int y ) {
+    int w = class_widths[ size_class ];
+    int first = -1;
+    size_t ifree = 0;
+
+    for ( int x = 0; x + w <= target.width; x += w ) {
+        Slot slot;
+        slot.x = x;
+        slot.y = y;
+        slot.w = w;
+        slot.h = slot_height;
+        slot.size_class = size_class;
+
+        // Reusing the entries of the re-sliced rows, so the slots don't grow with re-slicing
+
+        while ( ifree < slots.size() && slots[ ifree ].size_class != -1 ) ifree++;
+
+        GlyphRect gr;
+        gr.glyph_idx = -1;
+
+        int islot = ifree;
+        if ( ifree < slots.size() ) {
+            slots[ ifree ] = slot;
+            atlas.glyph_rects[ ifree ] = gr;
+        } else {
+            slots.push_back( slot );
+            atlas.glyph_rects.push_back( gr );
+        }
+
+        if ( first == -1 ) first = islot;
+    }
+
+    return first;
+}
+
+void SlotAtlas::evict_slot( int islot, std::vector<uint32_t> &evicted ) {
+    Slot &slot = slots[ islot ];
+    if ( slot.codepoints.empty() ) return;
+
+    const GlyphRect &gr = atlas.glyph_rects[ islot ];
+
+    for ( uint32_t cp : slot.codepoints ) {
+        codepoint_slots.erase( cp );
+        evicted.push_back( cp );
+    }
+
+    glyph_slots.erase( ( (uint64_t) gr.font_idx << 32 ) | (uint32_t) gr.glyph_idx );
+    slot.codepoints.clear();
+    evictions++;
+}
+
+int SlotAtlas::take_slot( int size_class, std::vector<uint32_t> &evicted, bool reslice ) {
+    int lru = -1;
+
+    for ( size_t islot = 0; islot < slots.size(); ++islot ) {
+        const Slot &slot = slots[ islot ];
+        if ( slot.size_class != size_class ) continue;
+        if ( slot.codepoints.empty() ) return islot;
+        if ( slot.last_use < use_clock && ( lru == -1 || slot.last_use < slots[ lru ].last_use ) ) lru = islot;
+    }
+
+    // New row of the class
+
+    if ( ( next_row + 1 ) * slot_height <= target.height ) {
+        return add_row( size_class, slot_height * next_row++ );
+    }
+
+    // Evicting the least recently used glyph
+
+    if ( lru != -1 ) {
+        evict_slot( lru, evicted );
+        return lru;
+    }
+
+    if ( !reslice ) return -1;
+
+    // No victim in the class: the least recently used row of another class, none of its glyphs
+    // used in this request, is evicted and re-sliced to the class width
+
+    std::vector<uint64_t> row_use( next_row, 0 );
+    std::vector<bool>     row_other( next_row, false );
+
+    for ( const Slot &slot : slots ) {
+        if ( slot.size_class == -1 ) continue;
+        int row = slot.y / slot_height;
+        row_use[ row ] = std::max( row_use[ row ], slot.last_use );
+        row_other[ row ] = slot.size_class != size_class;
+    }
+
+    int lru_row = -1;
+    for ( int row = 0; row < next_row; ++row ) {
+        if ( !row_other[ row ] || row_use[ row ] == use_clock ) continue;
+        if ( lru_row == -1 || row_use[ row ] < row_use[ lru_row ] ) lru_row = row;
+    }
+
+    if ( lru_row == -1 ) return -1;
+
+    for ( size_t islot = 0; islot < slots.size(); ++islot ) {
+        Slot &slot = slots[ islot ];
+        if ( slot.size_class == -1 || slot.y != lru_row * slot_height ) continue;
+        evict_slot( islot, evicted );
+        slot.size_class = -1;
+        atlas.glyph_rects[ islot ] = GlyphRect();
+        atlas.glyph_rects[ islot ].glyph_idx = -1;
+    }
+
+    return add_row( size_class, lru_row * slot_height );
+}
+
+bool SlotAtlas::request( const std::vector<uint32_t> &codepoints, std::vector<DirtyRect> &dirty, std::vector<uint32_t> &evicted ) {
+    use_clock++;
+
+    bool all_resident = true;
+    std::vector<int> rendered;
+
+    for ( uint32_t cp : codepoints ) {
+        auto cit = codepoint_slots.find( cp );
+        if ( cit != codepoint_slots.end() ) {
+            slots[ cit->second ].last_use = use_clock;
+            hits++;
+            continue;
+        }
+
+        GlyphRect gr;
+        if ( !atlas.glyph_rect( cp, gr ) ) continue;
+
+        misses++;
+
+        // Codepoint sharing a glyph with a resident one
+
+        uint64_t glyph_key = ( (uint64_t) gr.font_idx << 32 ) | (uint32_t) gr.glyph_idx;
+        auto git = glyph_slots.find( glyph_key );
+        if ( git != glyph_slots.end() ) {
+            slots[ git->second ].codepoints.push_back( cp );
+            slots[ git->second ].last_use = use_clock;
+            codepoint_slots[ cp ] = git->second;
+            continue;
+        }
+
+        // Narrowest fitting class first, wider classes if it has no slot,
+        // then re-slicing a row of another class for the narrowest one
+
+        float w = gr.x1 - gr.x0;
+        int islot = -1;
+        int fit_class = -1;
+        for ( int k = class_widths.size() - 1; k >= 0 && islot == -1; --k ) {
+            if ( class_widths[ k ] < ceil( w ) ) continue;
+            if ( fit_class == -1 ) fit_class = k;
+            islot = take_slot( k, evicted );
+        }
+
+        if ( islot == -1 && fit_class != -1 ) islot = take_slot( fit_class, evicted, true );
+
+        if ( islot == -1 ) {
+            all_resident = false;
+            continue;
+        }
+
+        Slot &slot = slots[ islot ];
+        slot.codepoints.push_back( cp );
+        slot.last_use = use_clock;
+
+        gr.x0 = slot.x;
+        gr.y0 = slot.y;
+        gr.x1 = slot.x + w;
+        gr.y1 = slot.y + std::min<float>( gr.y1, slot.h );
+        atlas.glyph_rects[ islot ] = gr;
+
+        codepoint_slots[ cp ] = islot;
+        glyph_slots[ glyph_key ] = islot;
+        rendered.push_back( islot );
+    }
+
+    atlas.glyph_count = codepoint_slots.size();
+    atlas.unique_count = glyph_slots.size();
+
+    // Re-rendering the taken slots, a slot evicted and taken again in the same request is rendered once
+
+    std::sort( rendered.begin(), rendered.end() );
+    rendered.erase( std::unique( rendered.begin(), rendered.end() ), rendered.end() );
+
+    std::vector<bool> skip( atlas.glyph_rects.size(), true );
+    size_t first_dirty = dirty.size();
+
+    for ( int islot : rendered ) {
+        const Slot &slot = slots[ islot ];
+        skip[ islot ] = false;
+        dirty.push_back( DirtyRect { slot.x, slot.y, slot.w, slot.h } );
+    }
+
+    target.render( atlas, skip, dirty.data() + first_dirty, dirty.size() - first_dirty );
+
+    return all_resident;
+}
+
+const GlyphRect* SlotAtlas::find( uint32_t codepoint ) const {
+    auto cit = codepoint_slots.find( codepoint );
+    return cit == codepoint_slots.end() ? nullptr : &atlas.glyph_rects[ cit->second ];
+}
+
+void SlotAtlas::destroy() {
+    target.destroy();
+    slots.clear();
+    atlas.glyph_rects.clear();
+}
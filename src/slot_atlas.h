@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "runtime_atlas.h"
+
+// Fixed capacity atlas for unbounded text, e.g. chat. The texture is divided into
+// rows of full row height slots, a row is given to a size class on first use.
+// Class k slots are max glyph width / 2^k wide, a glyph takes the narrowest
+// slot it fits. When a class has no free slot and no free row is left,
+// the least recently used glyph of the class is evicted and only its slot
+// is re-rendered. A class without a glyph to evict takes the least recently
+// used row of another class, evicting its glyphs and re-slicing it to the
+// class width. Codepoints sharing a glyph share the slot.
+//
+// atlas.glyph_rects are the slots, rects of the free slots have glyph_idx -1,
+// so the glyph rects are taken with find() rather than atlas.json().
+
+struct SlotAtlas {
+    struct Slot {
+        int      x = 0, y = 0, w = 0, h = 0;
+        int      size_class = 0;            // -1 for an unused entry of a re-sliced row
+        uint64_t last_use = 0;
+        std::vector<uint32_t> codepoints;   // Resident codepoints, empty for a free slot
+    };
+
+    SdfAtlas     atlas;
+    AtlasTarget  target;
+
+    std::vector<Slot> slots;
+    std::vector<int>  class_widths;
+    int          slot_height = 0;
+    int          next_row = 0;          // First row not given to a class
+
+    std::unordered_map<uint32_t, int> codepoint_slots;
+    std::unordered_map<uint64_t, int> glyph_slots;  // ( font index << 32 | glyph index ) -> slot
+
+    uint64_t     use_clock = 0;         // Incremented by every request()
+
+    size_t       hits = 0;
+    size_t       misses = 0;
+    size_t       evictions = 0;
+
+    // Creates width x height texture and framebuffer. Returns false for the Compute mode,
+    // an incomplete framebuffer or the texture lower than a slot.
+    bool init( SdfGl &sdf_gl, const std::vector<const Font*> &fonts, int width, int height, float row_height, float sdf_size,
+               int size_classes = 1, SdfMode mode = SdfMode::Stencil );
+
+    // Makes the codepoints resident and marks them used. Appends the re-rendered slots to 'dirty'
+    // and the codepoints evicted to make room to 'evicted'. Glyphs used in the same request are not evicted,
+    // returns false if some glyphs found no slot.
+    bool request( const std::vector<uint32_t> &codepoints, std::vector<DirtyRect> &dirty, std::vector<uint32_t> &evicted );
+
+    // Rect of a resident codepoint, nullptr if it's not resident
+    const GlyphRect* find( uint32_t codepoint ) const;
+
+    float hit_rate() const {
+        return hits + misses ? (float) hits / ( hits + misses ) : 0.0f;
+    }
+
+    void read_rect( const DirtyRect &rect, uint8_t *pixels ) {
+        target.read_rect( rect, pixels );
+    }
+
+    void destroy();
+
+    // Free slot of the class, a new row of the class or the least recently used slot of the class.
+    // With 'reslice' then the first slot of a re-sliced row, -1 if none.
+    int take_slot( int size_class, std::vector<uint32_t> &evicted, bool reslice = false );
+
+    // Slices the row at y into the class slots, returns the first one
+    int add_row( int size_class, int y );
+
+    // Makes the slot free, appending its codepoints to 'evicted'
+    void evict_slot( int islot, std::vector<uint32_t> &evicted );
+};
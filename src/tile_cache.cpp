@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tile_cache.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+// Changes whenever the rendering changes, so the stale tiles are never hit
+static const uint32_t tile_cache_version = 3;
+
+static const char *tile_ext = ".sdft";
+
+bool TileCache::init( const std::string &dir, size_t max_size ) {
+    this->dir = dir;
+    this->max_size = max_size;
+
+    if ( mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST ) return false;
+
+    struct stat st;
+    return stat( dir.c_str(), &st ) == 0 && S_ISDIR( st.st_mode );
+}
+
+uint64_t TileCache::tile_key( uint64_t font_hash, int glyph_idx, float row_height, float sdf_size,
+                              float rect_width, float rect_height, float bottom, SdfMode mode,
+                              int x, int y, int page_width, int page_height ) {
+    int imode = (int) mode;
+    uint64_t h = hash_seed;
+    h = hash_bytes( h, &tile_cache_version, sizeof( tile_cache_version ) );
+    h = hash_bytes( h, &font_hash, sizeof( font_hash ) );
+    h = hash_bytes( h, &glyph_idx, sizeof( glyph_idx ) );
+    h = hash_bytes( h, &row_height, sizeof( row_height ) );
+    h = hash_bytes( h, &sdf_size, sizeof( sdf_size ) );
+    h = hash_bytes( h, &rect_width, sizeof( rect_width ) );
+    h = hash_bytes( h, &rect_height, sizeof( rect_height ) );
+    h = hash_bytes( h, &bottom, sizeof( bottom ) );
+    h = hash_bytes( h, &imode, sizeof( imode ) );
+    h = hash_bytes( h, &x, sizeof( x ) );
+    h = hash_bytes( h, &y, sizeof( y ) );
+    h = hash_bytes( h, &page_width, sizeof( page_width ) );
+    h = hash_bytes( h, &page_height, sizeof( page_height ) );
+    return h;
+}
+
+std::string TileCache::tile_path( uint64_t key ) const {
+    char name[ 32 ];
+    snprintf( name, 32, "%016llx", (unsigned long long) key );
+    return dir + "/" + name + tile_ext;
+}
+
+bool TileCache::load( uint64_t key, int width, int height, std::vector<uint8_t> &tile ) {
+    std::string path = tile_path( key );
+    size_t size = (size_t) width * height;
+
+    FILE *f = fopen( path.c_str(), "rb" );
+    if ( !f ) {
+        misses++;
+        return false;
+    }
+
+    tile.resize( size );
+    size_t read = fread( tile.data(), 1, size, f );
+    bool complete = read == size && fgetc( f ) == EOF;
+    fclose( f );
+
+    if ( !complete ) {
+        misses++;
+        return false;
+    }
+
+    utime( path.c_str(), nullptr );
+    hits++;
+    return true;
+}
+
+void TileCache::store( uint64_t key, int width, int height, const uint8_t *tile ) {
+    std::string path = tile_path( key );
+    std::string tmp_path = path + "." + std::to_string( getpid() );
+    size_t size = (size_t) width * height;
+
+    FILE *f = fopen( tmp_path.c_str(), "wb" );
+    if ( !f ) return;
+    bool written = fwrite( tile, 1, size, f ) == size;
+    written = fclose( f ) == 0 && written;
+
+    if ( !written || rename( tmp_path.c_str(), path.c_str() ) != 0 ) {
+        remove( tmp_path.c_str() );
+        return;
+    }
+
+    stored++;
+}
+
+size_t TileCache::trim() {
+    struct TileFile {
+        std::string path;
+        size_t      size;
+        time_t      mtime;
+    };
+
+    std::vector<TileFile> files;
+    size_t total = 0;
+
+    DIR *d = opendir( dir.c_str() );
+    if ( !d ) return 0;
+
+    size_t ext_len = strlen( tile_ext );
+    while ( dirent *entry = readdir( d ) ) {
+        std::string name = entry->d_name;
+        if ( name.size() <= ext_len || name.compare( name.size() - ext_len, ext_len, tile_ext ) != 0 ) continue;
+
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if ( stat( path.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) ) continue;
+
+        files.push_back( TileFile { path, (size_t) st.st_size, st.st_mtime } );
+        total += st.st_size;
+    }
+    closedir( d );
+
+    if ( total <= max_size ) return 0;
+
+    std::sort( files.begin(), files.end(), []( const TileFile &a, const TileFile &b ) {
+        return a.mtime < b.mtime;
+    } );
+
+    size_t removed = 0;
+    for ( const TileFile &tf : files ) {
+        if ( total <= max_size ) break;
+        if ( remove( tf.path.c_str() ) == 0 ) {
+            total -= tf.size;
+            removed++;
+        }
+    }
+
+    return removed;
+}
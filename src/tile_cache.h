@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sdf_gl.h"
+
+// On-disk cache of rendered glyph SDF tiles, one file per tile named by the tile key.
+// A hit touches the tile file, so the modification time orders the tiles by use
+// and trim() removes the least recently used ones above the size cap.
+// Tiles are written to a temporary file and renamed, so the concurrent readers
+// never see a partial tile.
+
+struct TileCache {
+    std::string dir;
+    size_t      max_size = 256 << 20;   // Bytes
+
+    std::atomic<size_t> hits { 0 };
+    std::atomic<size_t> misses { 0 };
+    std::atomic<size_t> stored { 0 };
+
+    // Creates the cache directory if needed
+    bool init( const std::string &dir, size_t max_size );
+
+    // Key of a tile: the font file, glyph, scale, SDF size, tile geometry, rendering mode and the cache version.
+    // The rasterization rounds differently at other page positions, so the rect origin and the page size
+    // are in the key too, and a cached tile is the same as the one rendered in its place.
+    static uint64_t tile_key( uint64_t font_hash, int glyph_idx, float row_height, float sdf_size,
+                              float rect_width, float rect_height, float bottom, SdfMode mode,
+                              int x, int y, int page_width, int page_height );
+
+    // Reads a width x height tile, false if it's missing or has a different size
+    bool load( uint64_t key, int width, int height, std::vector<uint8_t> &tile );
+
+    void store( uint64_t key, int width, int height, const uint8_t *tile );
+
+    // Removes the least recently used tiles until the cache fits into max_size, returns the removed tile count
+    size_t trim();
+
+    std::string tile_path( uint64_t key ) const;
+};
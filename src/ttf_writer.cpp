@@ -0,0 +1,983 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ttf_writer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <set>
+
+// Big-endian output buffer
+
+struct TtfBuffer {
+    std::vector<uint8_t> data;
+
+    void u8( uint8_t v ) { data.push_back( v ); }
+    void u16( uint16_t v ) { u8( v >> 8 ); u8( v & 0xff ); }
+    void i16( int16_t v ) { u16( (uint16_t) v ); }
+    void u32( uint32_t v ) { u16( v >> 16 ); u16( v & 0xffff ); }
+    void tag( const char *t ) { data.insert( data.end(), t, t + 4 ); }
+    void zeros( size_t count ) { data.resize( data.size() + count, 0 ); }
+    void append( const TtfBuffer &b ) { data.insert( data.end(), b.data.begin(), b.data.end() ); }
+
+    void pad( size_t alignment ) {
+        while ( data.size() % alignment ) u8( 0 );
+    }
+
+    void set_u32( size_t pos, uint32_t v ) {
+        data[ pos ]     = v >> 24;
+        data[ pos + 1 ] = ( v >> 16 ) & 0xff;
+        data[ pos + 2 ] = ( v >> 8 ) & 0xff;
+        data[ pos + 3 ] = v & 0xff;
+    }
+};
+
+struct TtfTable {
+    const char *tag;
+    TtfBuffer   buf;
+};
+
+static uint32_t table_checksum( const std::vector<uint8_t> &data, size_t start, size_t size ) {
+    uint32_t sum = 0;
+    for ( size_t i = 0; i < size; i += 4 ) {
+        uint32_t v = 0;
+        for ( size_t ib = 0; ib < 4; ++ib ) {
+            v = ( v << 8 ) | ( i + ib < size ? data[ start + i + ib ] : 0 );
+        }
+        sum += v;
+    }
+    return sum;
+}
+
+// F2Dot14 transform values, the box is computed with the values the reader gets
+
+static int16_t f2dot14( float v ) {
+    return (int16_t) std::max( -32768L, std::min( 32767L, lrintf( v * 16384.0f ) ) );
+}
+
+static float f2dot14_value( float v ) {
+    return f2dot14( v ) / 16384.0f;
+}
+
+struct GlyphBox {
+    int16_t xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+};
+
+// Composite glyph outline flattened to the simple glyph points
+
+struct GlyphStats {
+    bool     empty = true;
+    float    xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+    uint32_t points = 0;
+    uint32_t contours = 0;
+    int      depth = 0;     // Component nesting levels, 0 for a simple glyph
+
+    void add( float x, float y ) {
+        xmin = empty ? x : std::min( xmin, x );
+        ymin = empty ? y : std::min( ymin, y );
+        xmax = empty ? x : std::max( xmax, x );
+        ymax = empty ? y : std::max( ymax, y );
+        empty = false;
+    }
+
+    GlyphBox box() const {
+        GlyphBox b;
+        if ( empty ) return b;
+        b.xmin = (int16_t) floorf( xmin );
+        b.ymin = (int16_t) floorf( ymin );
+        b.xmax = (int16_t) ceilf( xmax );
+        b.ymax = (int16_t) ceilf( ymax );
+        return b;
+    }
+};
+
+// Transform is x' = m[0] * x + m[2] * y + m[4], y' = m[1] * x + m[3] * y + m[5]
+
+static void glyph_stats( const TtfFont &font, int glyph_idx, const float *m, GlyphStats &stats, int depth ) {
+    const TtfGlyph &g = font.glyphs[ glyph_idx ];
+    stats.depth = std::max( stats.depth, depth );
+
+    for ( const std::vector<TtfPoint> &contour : g.contours ) {
+        for ( const TtfPoint &p : contour ) {
+            stats.add( m[0] * p.x + m[2] * p.y + m[4], m[1] * p.x + m[3] * p.y + m[5] );
+        }
+        stats.points += contour.size();
+        stats.contours++;
+    }
+
+    for ( const TtfComponent &c : g.components ) {
+        float cm[6] = { 1.0f, 0.0f, 0.0f, 1.0f, (float) c.dx, (float) c.dy };
+        switch ( c.transform ) {
+        case TtfComponent::Offset:
+            break;
+        case TtfComponent::Scale:
+            cm[0] = cm[3] = f2dot14_value( c.m[0] );
+            break;
+        case TtfComponent::XYScale:
+            cm[0] = f2dot14_value( c.m[0] );
+            cm[3] = f2dot14_value( c.m[3] );
+            break;
+        case TtfComponent::TwoByTwo:
+            for ( int i = 0; i < 4; ++i ) cm[i] = f2dot14_value( c.m[i] );
+            break;
+        }
+
+        float r[6] = {
+            m[0] * cm[0] + m[2] * cm[1],
+            m[1] * cm[0] + m[3] * cm[1],
+            m[0] * cm[2] + m[2] * cm[3],
+            m[1] * cm[2] + m[3] * cm[3],
+            m[0] * cm[4] + m[2] * cm[5] + m[4],
+            m[1] * cm[4] + m[3] * cm[5] + m[5]
+        };
+        glyph_stats( font, c.glyph_idx, r, stats, depth + 1 );
+    }
+}
+
+// Simple glyph with the coordinates packed as in the real fonts: byte deltas with the sign
+// in the flags, repeated coordinates omitted and repeated flags run length encoded
+
+static void write_glyph( const TtfGlyph &g, const GlyphBox &box, TtfBuffer &out ) {
+    out.i16( (int16_t) g.contours.size() );
+    out.i16( box.xmin );
+    out.i16( box.ymin );
+    out.i16( box.xmax );
+    out.i16( box.ymax );
+
+    uint16_t end_pt = 0;
+    for ( const std::vector<TtfPoint> &contour : g.contours ) {
+        end_pt += contour.size();
+        out.u16( end_pt - 1 );
+    }
+    out.u16( 0 );   // Instructions
+
+    std::vector<uint8_t> flags;
+    TtfBuffer xs, ys;
+    int px = 0, py = 0;
+
+    for ( const std::vector<TtfPoint> &contour : g.contours ) {
+        for ( const TtfPoint &p : contour ) {
+            int dx = p.x - px;
+            int dy = p.y - py;
+            uint8_t flag = p.on_curve ? 0x01 : 0;
+
+            if ( dx == 0 ) {
+                flag |= 0x10;
+            } else if ( dx > -256 && dx < 256 ) {
+                flag |= 0x02 | ( dx > 0 ? 0x10 : 0 );
+                xs.u8( abs( dx ) );
+            } else {
+                xs.i16( dx );
+            }
+
+            if ( dy == 0 ) {
+                flag |= 0x20;
+            } else if ( dy > -256 && dy < 256 ) {
+                flag |= 0x04 | ( dy > 0 ? 0x20 : 0 );
+                ys.u8( abs( dy ) );
+            } else {
+                ys.i16( dy );
+            }
+
+            flags.push_back( flag );
+            px = p.x;
+            py = p.y;
+        }
+    }
+
+    for ( size_t i = 0; i < flags.size(); ) {
+        size_t run = 1;
+        while ( i + run < flags.size() && flags[ i + run ] == flags[ i ] && run < 256 ) run++;
+
+        if ( run > 1 ) {
+            out.u8( flags[ i ] | 0x08 );
+            out.u8( run - 1 );
+        } else {
+            out.u8( flags[ i ] );
+        }
+        i += run;
+    }
+
+    out.append( xs );
+    out.append( ys );
+}
+
+// Composite glyph, offsets as bytes when they fit, otherwise as words
+
+static void write_composite( const TtfGlyph &g, const GlyphBox &box, TtfBuffer &out ) {
+    out.i16( -1 );
+    out.i16( box.xmin );
+    out.i16( box.ymin );
+    out.i16( box.xmax );
+    out.i16( box.ymax );
+
+    for ( size_t ic = 0; ic < g.components.size(); ++ic ) {
+        const TtfComponent &c = g.components[ ic ];
+        bool words = c.dx < -128 || c.dx > 127 || c.dy < -128 || c.dy > 127;
+
+        uint16_t flags = 0x0002;                                // Arguments are xy values
+        if ( words ) flags |= 0x0001;
+        if ( ic + 1 < g.components.size() ) flags |= 0x0020;    // More components
+        if ( c.transform == TtfComponent::Scale )    flags |= 0x0008;
+        if ( c.transform == TtfComponent::XYScale )  flags |= 0x0040;
+        if ( c.transform == TtfComponent::TwoByTwo ) flags |= 0x0080;
+
+        out.u16( flags );
+        out.u16( c.glyph_idx );
+
+        if ( words ) {
+            out.i16( c.dx );
+            out.i16( c.dy );
+        } else {
+            out.u8( (uint8_t) (int8_t) c.dx );
+            out.u8( (uint8_t) (int8_t) c.dy );
+        }
+
+        switch ( c.transform ) {
+        case TtfComponent::Offset:
+            break;
+        case TtfComponent::Scale:
+            out.i16( f2dot14( c.m[0] ) );
+            break;
+        case TtfComponent::XYScale:
+            out.i16( f2dot14( c.m[0] ) );
+            out.i16( f2dot14( c.m[3] ) );
+            break;
+        case TtfComponent::TwoByTwo:
+            for ( int i = 0; i < 4; ++i ) out.i16( f2dot14( c.m[i] ) );
+            break;
+        }
+    }
+}
+
+// cmap subtables. Glyph runs of consecutive codepoints:
+// format 0  - byte glyph indices of the first 256 codepoints
+// format 4  - segments with an index delta, or a glyph id array if the indices aren't consecutive
+// format 6  - BMP codepoint range with 16 bit indices
+// format 10 - same for the full codepoint range
+// format 12 - groups of consecutive codepoints and indices
+// format 13 - groups of codepoints mapped to the same glyph
+
+typedef std::vector<std::pair<uint32_t, uint16_t>> CmapEntries;
+
+static bool write_cmap_0( const CmapEntries &cmap, TtfBuffer &out, std::string &error ) {
+    uint8_t idx[ 256 ] = { 0 };
+    for ( const std::pair<uint32_t, uint16_t> &cg : cmap ) {
+        if ( cg.first > 0xff || cg.second > 0xff ) {
+            error = "cmap format 0 holds codepoints and glyph indices below 256";
+            return false;
+        }
+        idx[ cg.first ] = cg.second;
+    }
+
+    out.u16( 0 );
+    out.u16( 6 + 256 );
+    out.u16( 0 );           // Language
+    for ( uint8_t i : idx ) out.u8( i );
+    return true;
+}
+
+static bool write_cmap_4( const CmapEntries &cmap, TtfBuffer &out, std::string &error ) {
+    struct Segment {
+        uint16_t start, end;
+        int16_t  delta;
+        bool     use_array;
+        size_t   first_entry;
+    };
+
+    std::vector<Segment> segs;
+    for ( size_t ie = 0; ie < cmap.size(); ++ie ) {
+        const std::pair<uint32_t, uint16_t> &cg = cmap[ ie ];
+        if ( cg.first >= 0xffff ) {
+            error = "cmap format 4 holds codepoints below U+FFFF";
+            return false;
+        }
+
+        uint16_t cp = cg.first;
+        int16_t  delta = (int16_t) ( cg.second - cp );
+
+        if ( !segs.empty() && segs.back().end + 1 == cp ) {
+            segs.back().end = cp;
+            segs.back().use_array |= segs.back().delta != delta;
+        } else {
+            segs.push_back( Segment { cp, cp, delta, false, ie } );
+        }
+    }
+    segs.push_back( Segment { 0xffff, 0xffff, 1, false, 0 } );
+
+    uint16_t seg_count = segs.size();
+    uint16_t search_range = 2;
+    uint16_t entry_selector = 0;
+    while ( search_range * 2 <= seg_count * 2 ) {
+        search_range *= 2;
+        entry_selector++;
+    }
+
+    size_t array_size = 0;
+    for ( const Segment &s : segs ) {
+        if ( s.use_array ) array_size += s.end - s.start + 1;
+    }
+
+    size_t length = 16 + seg_count * 8 + array_size * 2;
+    if ( length > 0xffff ) {
+        error = "cmap format 4 subtable exceeds 64K, use format 12";
+        return false;
+    }
+
+    out.u16( 4 );
+    out.u16( length );
+    out.u16( 0 );           // Language
+    out.u16( seg_count * 2 );
+    out.u16( search_range );
+    out.u16( entry_selector );
+    out.u16( seg_count * 2 - search_range );
+    for ( const Segment &s : segs ) out.u16( s.end );
+    out.u16( 0 );
+    for ( const Segment &s : segs ) out.u16( s.start );
+    for ( const Segment &s : segs ) out.i16( s.use_array ? 0 : s.delta );
+
+    // Range offsets count from their own position to the glyph id array item
+    size_t array_pos = 0;
+    for ( size_t is = 0; is < segs.size(); ++is ) {
+        if ( !segs[ is ].use_array ) {
+            out.u16( 0 );
+            continue;
+        }
+        out.u16( ( seg_count - is + array_pos ) * 2 );
+        array_pos += segs[ is ].end - segs[ is ].start + 1;
+    }
+
+    for ( const Segment &s : segs ) {
+        if ( !s.use_array ) continue;
+        for ( size_t ie = s.first_entry; ie <= s.first_entry + ( s.end - s.start ); ++ie ) out.u16( cmap[ ie ].second );
+    }
+    return true;
+}
+
+static bool write_cmap_6_10( const CmapEntries &cmap, int format, TtfBuffer &out, std::string &error ) {
+    uint32_t first = cmap.empty() ? 0 : cmap.front().first;
+    uint32_t count = cmap.empty() ? 0 : cmap.back().first - first + 1;
+
+    if ( format == 6 && ( first + count > 0x10000 || 10 + count * 2 > 0xffff ) ) {
+        error = "cmap format 6 holds a BMP range below 32K codepoints";
+        return false;
+    }
+
+    std::vector<uint16_t> idx( count, 0 );
+    for ( const std::pair<uint32_t, uint16_t> &cg : cmap ) idx[ cg.first - first ] = cg.second;
+
+    if ( format == 6 ) {
+        out.u16( 6 );
+        out.u16( 10 + count * 2 );
+        out.u16( 0 );       // Language
+        out.u16( first );
+        out.u16( count );
+    } else {
+        out.u16( 10 );
+        out.u16( 0 );
+        out.u32( 20 + count * 2 );
+        out.u32( 0 );       // Language
+        out.u32( first );
+        out.u32( count );
+    }
+    for ( uint16_t i : idx ) out.u16( i );
+    return true;
+}
+
+static bool write_cmap_12_13( const CmapEntries &cmap, int format, TtfBuffer &out ) {
+    struct Group {
+        uint32_t start, end, glyph_idx;
+    };
+
+    // Format 12 glyph indices follow the codepoints, format 13 glyph index is the same
+    uint32_t step = format == 12 ? 1 : 0;
+
+    std::vector<Group> groups;
+    for ( const std::pair<uint32_t, uint16_t> &cg : cmap ) {
+        if ( !groups.empty() ) {
+            Group &last = groups.back();
+            if ( last.end + 1 == cg.first && last.glyph_idx + ( cg.first - last.start ) * step == cg.second ) {
+                last.end = cg.first;
+                continue;
+            }
+        }
+        groups.push_back( Group { cg.first, cg.first, cg.second } );
+    }
+
+    out.u16( format );
+    out.u16( 0 );
+    out.u32( 16 + groups.size() * 12 );
+    out.u32( 0 );           // Language
+    out.u32( groups.size() );
+    for ( const Group &g : groups ) {
+        out.u32( g.start );
+        out.u32( g.end );
+        out.u32( g.glyph_idx );
+    }
+    return true;
+}
+
+static bool write_cmap( const TtfFont &font, TtfBuffer &out, std::string &error ) {
+    TtfBuffer sub;
+    uint16_t platform = 0, encoding = 3;
+    bool ok = false;
+
+    switch ( font.cmap_format ) {
+    case 0:
+        ok = write_cmap_0( font.cmap, sub, error );
+        break;
+    case 4:
+        platform = 3;
+        encoding = 1;
+        ok = write_cmap_4( font.cmap, sub, error );
+        break;
+    case 6:
+        ok = write_cmap_6_10( font.cmap, 6, sub, error );
+        break;
+    case 10:
+        encoding = 4;
+        ok = write_cmap_6_10( font.cmap, 10, sub, error );
+        break;
+    case 12:
+        platform = 3;
+        encoding = 10;
+        ok = write_cmap_12_13( font.cmap, 12, sub );
+        break;
+    case 13:
+        encoding = 6;
+        ok = write_cmap_12_13( font.cmap, 13, sub );
+        break;
+    default:
+        error = "unsupported cmap format " + std::to_string( font.cmap_format );
+        return false;
+    }
+    if ( !ok ) return false;
+
+    out.u16( 0 );           // Version
+    out.u16( 1 );           // Encoding tables
+    out.u16( platform );
+    out.u16( encoding );
+    out.u32( 12 );          // Subtable offset
+    out.append( sub );
+    return true;
+}
+
+// Format 0 subtable of sorted pairs. The 16 bit subtable length and search range overflow
+// above 10920 pairs, they are written truncated as in the real fonts, readers go by the pair count.
+
+static void write_kern( const std::vector<TtfKernPair> &pairs, TtfBuffer &out ) {
+    std::vector<TtfKernPair> sorted = pairs;
+    std::sort( sorted.begin(), sorted.end(), []( const TtfKernPair &a, const TtfKernPair &b ) {
+        return ( (uint32_t) a.left << 16 | a.right ) < ( (uint32_t) b.left << 16 | b.right );
+    } );
+
+    uint32_t num_pairs = sorted.size();
+    uint32_t search_range = 6;
+    uint32_t entry_selector = 0;
+    while ( search_range * 2 <= num_pairs * 6 ) {
+        search_range *= 2;
+        entry_selector++;
+    }
+
+    out.u16( 0 );           // Version
+    out.u16( 1 );           // Subtables
+    out.u16( 0 );           // Subtable version
+    out.u16( ( 14 + num_pairs * 6 ) & 0xffff );
+    out.u16( 1 );           // Coverage: horizontal, format 0
+    out.u16( num_pairs );
+    out.u16( search_range );
+    out.u16( entry_selector );
+    out.u16( num_pairs * 6 - search_range );
+    for ( const TtfKernPair &p : sorted ) {
+        out.u16( p.left );
+        out.u16( p.right );
+        out.i16( p.value );
+    }
+}
+
+// Windows platform names, UTF-16BE of ASCII strings
+
+static void write_name( const std::string &family, TtfBuffer &out ) {
+    std::string ps_name = family;
+    ps_name.erase( std::remove( ps_name.begin(), ps_name.end(), ' ' ), ps_name.end() );
+
+    std::vector<std::pair<uint16_t, std::string>> names = {
+        { 1, family }, { 2, "Regular" }, { 3, family + " Regular" }, { 4, family + " Regular" }, { 6, ps_name + "-Regular" }
+    };
+
+    out.u16( 0 );           // Format
+    out.u16( names.size() );
+    out.u16( 6 + names.size() * 12 );
+
+    TtfBuffer strings;
+    for ( const std::pair<uint16_t, std::string> &n : names ) {
+        out.u16( 3 );       // MS
+        out.u16( 1 );       // Unicode BMP
+        out.u16( 0x0409 );  // English
+        out.u16( n.first );
+        out.u16( n.second.size() * 2 );
+        out.u16( strings.data.size() );
+        for ( char c : n.second ) strings.u16( (uint8_t) c );
+    }
+    out.append( strings );
+}
+
+bool TtfFont::write( std::vector<uint8_t> &ttf, std::string &error ) const {
+    if ( glyphs.empty() || glyphs.size() > 0xffff ) {
+        error = "glyph count is out of 1..65535";
+        return false;
+    }
+    if ( hmetrics > glyphs.size() ) {
+        error = "more horizontal metrics than glyphs";
+        return false;
+    }
+    if ( kern_pairs.size() > 0xffff ) {
+        error = "kern table holds up to 65535 pairs";
+        return false;
+    }
+
+    // Readers build the composites in glyph order from the already built components
+    for ( size_t ig = 0; ig < glyphs.size(); ++ig ) {
+        for ( const TtfComponent &c : glyphs[ ig ].components ) {
+            if ( c.glyph_idx >= ig ) {
+                error = "glyph " + std::to_string( ig ) + " component " + std::to_string( c.glyph_idx ) + " doesn't precede it";
+                return false;
+            }
+        }
+        size_t points = 0;
+        for ( const std::vector<TtfPoint> &contour : glyphs[ ig ].contours ) points += contour.size();
+        if ( points > 0xffff || glyphs[ ig ].contours.size() > 0x7fff ) {
+            error = "glyph " + std::to_string( ig ) + " has too many points";
+            return false;
+        }
+    }
+
+    std::vector<TtfTable> tables;
+    auto add_table = [&]( const char *tag ) -> TtfBuffer& {
+        tables.push_back( TtfTable { tag, TtfBuffer() } );
+        return tables.back().buf;
+    };
+
+    TtfBuffer cmap_t, glyf_t, loca_t, hmtx_t, head_t, hhea_t, maxp_t, os2_t, post_t, name_t;
+    if ( !write_cmap( *this, cmap_t, error ) ) return false;
+
+    // Glyphs, 2 byte aligned for the short loca offsets
+
+    std::vector<uint32_t> offsets;
+    GlyphBox font_box;
+    bool     first_box = true;
+    uint32_t max_points = 0, max_contours = 0;
+    uint32_t max_comp_points = 0, max_comp_contours = 0;
+    size_t   max_components = 0;
+    int      max_depth = 0;
+    uint16_t max_advance = 0;
+    int16_t  min_lsb = 0x7fff, min_rsb = 0x7fff, max_extent = -0x7fff;
+    uint32_t advance_sum = 0, advance_count = 0;
+    std::vector<int16_t> lsb( glyphs.size(), 0 );
+
+    for ( size_t ig = 0; ig < glyphs.size(); ++ig ) {
+        const TtfGlyph &g = glyphs[ ig ];
+        offsets.push_back( glyf_t.data.size() );
+
+        const float identity[6] = { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+        GlyphStats stats;
+        glyph_stats( *this, ig, identity, stats, 0 );
+        GlyphBox box = stats.box();
+
+        if ( g.advance ) {
+            advance_sum += g.advance;
+            advance_count++;
+        }
+        max_advance = std::max( max_advance, g.advance );
+
+        if ( !g.components.empty() ) {
+            write_composite( g, box, glyf_t );
+            max_comp_points = std::max( max_comp_points, stats.points );
+            max_comp_contours = std::max( max_comp_contours, stats.contours );
+            max_components = std::max( max_components, g.components.size() );
+            max_depth = std::max( max_depth, stats.depth );
+        } else if ( !g.contours.empty() ) {
+            write_glyph( g, box, glyf_t );
+            max_points = std::max( max_points, stats.points );
+            max_contours = std::max( max_contours, stats.contours );
+        }
+        glyf_t.pad( 2 );
+
+        if ( stats.empty ) continue;
+
+        lsb[ ig ] = box.xmin;
+        min_lsb = std::min( min_lsb, box.xmin );
+        min_rsb = std::min<int16_t>( min_rsb, g.advance - box.xmax );
+        max_extent = std::max( max_extent, box.xmax );
+
+        if ( first_box ) font_box = box;
+        font_box.xmin = std::min( font_box.xmin, box.xmin );
+        font_box.ymin = std::min( font_box.ymin, box.ymin );
+        font_box.xmax = std::max( font_box.xmax, box.xmax );
+        font_box.ymax = std::max( font_box.ymax, box.ymax );
+        first_box = false;
+    }
+    offsets.push_back( glyf_t.data.size() );
+
+    bool short_loca = !long_loca && offsets.back() < 0x20000;
+    for ( uint32_t off : offsets ) {
+        if ( short_loca ) loca_t.u16( off / 2 );
+        else              loca_t.u32( off );
+    }
+
+    // Glyphs past the metrics count take the advance of the last one
+    uint16_t num_hmetrics = hmetrics ? hmetrics : glyphs.size();
+    for ( size_t ig = 0; ig < glyphs.size(); ++ig ) {
+        if ( ig < num_hmetrics ) hmtx_t.u16( glyphs[ ig ].advance );
+        hmtx_t.i16( lsb[ ig ] );
+    }
+
+    head_t.u32( 0x00010000 );       // Version
+    head_t.u32( 0x00010000 );       // Font revision
+    head_t.u32( 0 );                // Checksum adjustment, set below
+    head_t.u32( 0x5F0F3CF5 );       // Magic
+    head_t.u16( 0x000B );           // Baseline at 0, left sidebearing at 0, integer ppem
+    head_t.u16( units_per_em );
+    head_t.zeros( 16 );             // Created, modified
+    head_t.i16( font_box.xmin );
+    head_t.i16( font_box.ymin );
+    head_t.i16( font_box.xmax );
+    head_t.i16( font_box.ymax );
+    head_t.u16( 0 );                // Mac style
+    head_t.u16( 8 );                // Lowest readable size
+    head_t.i16( 2 );                // Direction hint
+    head_t.i16( short_loca ? 0 : 1 ); // Loca format
+    head_t.i16( 0 );                // Glyph data format
+
+    hhea_t.u32( 0x00010000 );
+    hhea_t.i16( ascent );
+    hhea_t.i16( descent );
+    hhea_t.i16( line_gap );
+    hhea_t.u16( max_advance );
+    hhea_t.i16( min_lsb );
+    hhea_t.i16( min_rsb );
+    hhea_t.i16( max_extent );
+    hhea_t.i16( 1 );                // Caret slope rise
+    hhea_t.i16( 0 );                // Caret slope run
+    hhea_t.i16( 0 );                // Caret offset
+    hhea_t.zeros( 8 );
+    hhea_t.i16( 0 );                // Metric data format
+    hhea_t.u16( num_hmetrics );
+
+    maxp_t.u32( 0x00010000 );
+    maxp_t.u16( glyphs.size() );
+    maxp_t.u16( std::min<uint32_t>( max_points, 0xffff ) );
+    maxp_t.u16( std::min<uint32_t>( max_contours, 0xffff ) );
+    maxp_t.u16( std::min<uint32_t>( max_comp_points, 0xffff ) );
+    maxp_t.u16( std::min<uint32_t>( max_comp_contours, 0xffff ) );
+    maxp_t.u16( 2 );                // Zones
+    maxp_t.zeros( 12 );             // Twilight points .. instruction size
+    maxp_t.u16( max_components );
+    maxp_t.u16( max_depth );
+
+    uint32_t first_cp = cmap.empty() ? 0 : cmap.front().first;
+    uint32_t last_cp = cmap.empty() ? 0 : cmap.back().first;
+
+    os2_t.u16( 4 );                 // Version
+    os2_t.i16( advance_count ? advance_sum / advance_count : 0 );
+    os2_t.u16( 400 );               // Regular weight
+    os2_t.u16( 5 );                 // Medium width
+    os2_t.u16( 0 );                 // Installable embedding
+    os2_t.i16( units_per_em / 2 );  // Subscript x, y size, x, y offset
+    os2_t.i16( units_per_em / 2 );
+    os2_t.i16( 0 );
+    os2_t.i16( units_per_em / 8 );
+    os2_t.i16( units_per_em / 2 );  // Superscript
+    os2_t.i16( units_per_em / 2 );
+    os2_t.i16( 0 );
+    os2_t.i16( units_per_em / 3 );
+    os2_t.i16( units_per_em / 20 ); // Strikeout size, position
+    os2_t.i16( units_per_em / 4 );
+    os2_t.i16( 0 );                 // Family class
+    os2_t.zeros( 10 );              // Panose
+    os2_t.zeros( 16 );              // Unicode ranges
+    os2_t.tag( "NONE" );
+    os2_t.u16( 0x0040 );            // Regular
+    os2_t.u16( std::min<uint32_t>( first_cp, 0xffff ) );
+    os2_t.u16( std::min<uint32_t>( last_cp, 0xffff ) );
+    os2_t.i16( ascent );
+    os2_t.i16( descent );
+    os2_t.i16( line_gap );
+    os2_t.u16( std::max<int>( ascent, font_box.ymax ) );
+    os2_t.u16( std::max<int>( -descent, -font_box.ymin ) );
+    os2_t.zeros( 8 );               // Code pages
+    os2_t.i16( ascent / 2 );        // x height
+    os2_t.i16( ascent * 3 / 4 );    // Cap height
+    os2_t.u16( 0 );                 // Default char
+    os2_t.u16( 0x20 );              // Break char
+    os2_t.u16( 2 );                 // Max context, kerning pairs
+
+    post_t.u32( 0x00030000 );       // No glyph names
+    post_t.u32( 0 );                // Italic angle
+    post_t.i16( -units_per_em / 10 ); // Underline position, thickness
+    post_t.i16( units_per_em / 20 );
+    post_t.zeros( 20 );             // Fixed pitch, memory usage
+
+    write_name( name, name_t );
+
+    // Table directory, tables are sorted by tag and 4 byte aligned
+
+    add_table( "OS/2" ).data.swap( os2_t.data );
+    add_table( "cmap" ).data.swap( cmap_t.data );
+    add_table( "glyf" ).data.swap( glyf_t.data );
+    add_table( "head" ).data.swap( head_t.data );
+    add_table( "hhea" ).data.swap( hhea_t.data );
+    add_table( "hmtx" ).data.swap( hmtx_t.data );
+    if ( !kern_pairs.empty() ) write_kern( kern_pairs, add_table( "kern" ) );
+    add_table( "loca" ).data.swap( loca_t.data );
+    add_table( "maxp" ).data.swap( maxp_t.data );
+    add_table( "name" ).data.swap( name_t.data );
+    add_table( "post" ).data.swap( post_t.data );
+
+    uint16_t num_tables = tables.size();
+    uint16_t search_range = 16;
+    uint16_t entry_selector = 0;
+    while ( search_range * 2 <= num_tables * 16 ) {
+        search_range *= 2;
+        entry_selector++;
+    }
+
+    TtfBuffer out;
+    out.u32( 0x00010000 );
+    out.u16( num_tables );
+    out.u16( search_range );
+    out.u16( entry_selector );
+    out.u16( num_tables * 16 - search_range );
+
+    size_t offset = 12 + num_tables * 16;
+    for ( TtfTable &t : tables ) {
+        size_t size = t.buf.data.size();
+        out.tag( t.tag );
+        out.u32( table_checksum( t.buf.data, 0, size ) );
+        out.u32( offset );
+        out.u32( size );
+        offset += ( size + 3 ) & ~3;
+    }
+
+    size_t head_offset = 0;
+    for ( TtfTable &t : tables ) {
+        if ( !strncmp( t.tag, "head", 4 ) ) head_offset = out.data.size();
+        out.append( t.buf );
+        out.pad( 4 );
+    }
+
+    out.set_u32( head_offset + 8, 0xB1B0AFBA - table_checksum( out.data, 0, out.data.size() ) );
+
+    ttf.swap( out.data );
+    return true;
+}
+
+// Deterministic, the same on every platform
+
+struct SynthRandom {
+    uint32_t state;
+
+    uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    // Uniform in [ a, b )
+    float range( float a, float b ) {
+        return a + ( b - a ) * ( next() & 0xffff ) / 65536.0f;
+    }
+
+    // Uniform in [ 0, n )
+    uint32_t below( uint32_t n ) {
+        return (uint32_t) ( ( (uint64_t) next() * n ) >> 24 );
+    }
+};
+
+// Contours are jittered ellipses in the cells of a grid, alternately clockwise and
+// counterclockwise. Off curve points are pulled outward to make curves, some points
+// repeat the previous x to get the omitted coordinates.
+
+static void synth_simple( const SynthFontOptions &options, SynthRandom &rnd, TtfGlyph &g ) {
+    int contours = options.contours;
+    int points = options.points;
+    int grid = (int) ceilf( sqrtf( (float) contours ) );
+    float cell = 800.0f / grid;
+
+    g.advance = 900;
+
+    for ( int ic = 0; ic < contours; ++ic ) {
+        float cx = 50.0f + cell * ( ic % grid + 0.5f );
+        float cy = -100.0f + cell * ( ic / grid + 0.5f );
+        float rx = cell * rnd.range( 0.2f, 0.45f );
+        float ry = cell * rnd.range( 0.2f, 0.45f );
+        float dir = ic % 2 ? 1.0f : -1.0f;
+
+        std::vector<TtfPoint> contour;
+        for ( int ip = 0; ip < points; ++ip ) {
+            bool  on_curve = rnd.below( 2 );
+            float a = dir * 6.2831853f * ( ip + rnd.range( -0.3f, 0.3f ) ) / points;
+            float r = ( on_curve ? 1.0f : 1.15f ) * rnd.range( 0.8f, 1.0f );
+            TtfPoint p { (int16_t) lrintf( cx + rx * r * cosf( a ) ), (int16_t) lrintf( cy + ry * r * sinf( a ) ), on_curve };
+            if ( ip > 0 && rnd.below( 8 ) == 0 ) p.x = contour.back().x;
+            contour.push_back( p );
+        }
+        g.contours.push_back( std::move( contour ) );
+    }
+}
+
+// Components of the previous depth level glyphs [ first, last ), each composite
+// takes the next transform kind. Offset components overlap with small byte offsets,
+// scaled ones are placed side by side with word offsets.
+
+static void synth_composite( const SynthFontOptions &options, SynthRandom &rnd, int index, int first, int last, TtfGlyph &g ) {
+    int count = options.components;
+    TtfComponent::Transform transform = (TtfComponent::Transform) ( index % 4 );
+    float s = 1.0f / count;
+
+    g.advance = 900;
+
+    for ( int ic = 0; ic < count; ++ic ) {
+        TtfComponent c;
+        c.glyph_idx = first + rnd.below( last - first );
+        c.transform = transform;
+
+        float angle = rnd.range( -0.5f, 0.5f );
+
+        switch ( transform ) {
+        case TtfComponent::Offset:
+            c.dx = (int16_t) rnd.range( -60.0f, 60.0f );
+            c.dy = (int16_t) rnd.range( -60.0f, 60.0f );
+            break;
+        case TtfComponent::Scale:
+            c.m[0] = c.m[3] = s;
+            break;
+        case TtfComponent::XYScale:
+            c.m[0] = s;
+            c.m[3] = rnd.range( 0.5f, 1.0f );
+            break;
+        case TtfComponent::TwoByTwo:
+            c.m[0] = s * cosf( angle );
+            c.m[1] = s * sinf( angle );
+            c.m[2] = -s * sinf( angle );
+            c.m[3] = s * cosf( angle );
+            break;
+        }
+
+        if ( transform != TtfComponent::Offset ) {
+            c.dx = (int16_t) ( 900.0f * s * ic + 50.0f * ( 1.0f - s ) );
+            c.dy = (int16_t) ( 300.0f * ( 1.0f - c.m[3] ) );
+        }
+        g.components.push_back( c );
+    }
+}
+
+bool synth_font( const SynthFontOptions &options, TtfFont &font, std::string &error ) {
+    if ( options.glyph_count < 1 || options.contours < 1 || options.points < 3 ) {
+        error = "at least 1 glyph, 1 contour and 3 points per contour";
+        return false;
+    }
+    if ( (int64_t) options.contours * options.points > 0xffff ) {
+        error = "more than 65535 points per glyph";
+        return false;
+    }
+    if ( options.composite_count < 0 || options.composite_depth < 1 || options.components < 1 ) {
+        error = "composite depth and components per composite are at least 1";
+        return false;
+    }
+    if ( options.composite_count > 0 && options.composite_count < options.composite_depth ) {
+        error = "fewer composites than depth levels";
+        return false;
+    }
+
+    int64_t total = 1 + (int64_t) options.glyph_count + options.composite_count;
+    if ( total > 0xffff ) {
+        error = "more than 65535 glyphs";
+        return false;
+    }
+    if ( options.hmetrics < 0 || options.hmetrics > total || options.kern_pairs < 0 || options.kern_pairs > 0xffff ) {
+        error = "horizontal metrics above the glyph count or kerning pairs out of 0..65535";
+        return false;
+    }
+
+    SynthRandom rnd { options.seed * 2654435761u + 1 };
+
+    font = TtfFont();
+    font.glyphs.resize( total );
+    font.glyphs[0].advance = 512;
+    font.cmap_format = options.cmap_format;
+    font.hmetrics = options.hmetrics;
+    font.long_loca = options.long_loca;
+
+    for ( int ig = 1; ig <= options.glyph_count; ++ig ) synth_simple( options, rnd, font.glyphs[ ig ] );
+
+    // Depth levels of composites, the first one takes the remainder
+
+    int level_first = 1;
+    int level_last = options.glyph_count + 1;
+    int next = level_last;
+
+    for ( int level = 0; options.composite_count > 0 && level < options.composite_depth; ++level ) {
+        int count = options.composite_count / options.composite_depth;
+        if ( level == 0 ) count += options.composite_count % options.composite_depth;
+
+        for ( int ic = 0; ic < count; ++ic, ++next ) {
+            synth_composite( options, rnd, next, level_first, level_last, font.glyphs[ next ] );
+        }
+        level_first = level_last;
+        level_last = next;
+    }
+
+    // Codepoints in order, glyph indices shuffled for non-consecutive cmap runs
+
+    std::vector<uint16_t> order( total - 1 );
+    for ( size_t i = 0; i < order.size(); ++i ) order[ i ] = i + 1;
+    if ( options.shuffle_cmap ) {
+        for ( size_t i = order.size(); i > 1; --i ) std::swap( order[ i - 1 ], order[ rnd.below( i ) ] );
+    }
+
+    for ( size_t i = 0; i < order.size(); ++i ) {
+        uint64_t cp = options.first_codepoint + (uint64_t) i;
+        if ( cp > 0x10ffff ) {
+            error = "codepoints past U+10FFFF";
+            return false;
+        }
+        font.cmap.push_back( { (uint32_t) cp, order[ i ] } );
+    }
+
+    // Distinct random pairs
+
+    uint64_t max_pairs = (uint64_t) ( total - 1 ) * ( total - 1 );
+    size_t   pair_count = std::min<uint64_t>( options.kern_pairs, max_pairs );
+    std::set<uint32_t> pairs;
+
+    while ( pairs.size() < pair_count ) {
+        uint32_t left = 1 + rnd.below( total - 1 );
+        uint32_t right = 1 + rnd.below( total - 1 );
+        if ( !pairs.insert( left << 16 | right ).second ) continue;
+
+        int16_t value = (int16_t) rnd.range( -80.0f, 40.0f );
+        font.kern_pairs.push_back( TtfKernPair { (uint16_t) left, (uint16_t) right, value ? value : (int16_t) -1 } );
+    }
+
+    return true;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2019 Anton Stiopin astiopin@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// TrueType writer for the generated test and benchmark fonts: OS/2, cmap, glyf, head, hhea,
+// hmtx, kern, loca, maxp, name and post tables. Fonts are generated locally, so the benchmarks
+// don't depend on the installed or downloaded fonts.
+
+struct TtfPoint {
+    int16_t x, y;
+    bool    on_curve;
+};
+
+// Composite glyph component, the transform kinds map to the component flags
+
+struct TtfComponent {
+    enum Transform {
+        Offset, Scale, XYScale, TwoByTwo
+    };
+
+    uint16_t  glyph_idx = 0;
+    int16_t   dx = 0, dy = 0;       // Byte arguments if they fit
+    Transform transform = Offset;
+    float     m[4] = { 1.0f, 0.0f, 0.0f, 1.0f };  // xx, xy, yx, yy in [ -2, 2 )
+};
+
+struct TtfGlyph {
+    std::vector<std::vector<TtfPoint>> contours;
+    std::vector<TtfComponent> components;       // Composite glyph if not empty
+    uint16_t advance = 0;
+};
+
+struct TtfKernPair {
+    uint16_t left, right;
+    int16_t  value;
+};
+
+struct TtfFont {
+    std::string name = "Synthetic";
+    uint16_t units_per_em = 1024;
+    int16_t  ascent = 900;
+    int16_t  descent = -200;
+    int16_t  line_gap = 0;
+
+    std::vector<TtfGlyph> glyphs;                       // Glyph 0 is .notdef, components precede composites
+    std::vector<std::pair<uint32_t, uint16_t>> cmap;    // Codepoint -> glyph index, ascending codepoints
+    int      cmap_format = 4;                           // 0, 4, 6, 10, 12 or 13
+    std::vector<TtfKernPair> kern_pairs;                // Format 0 'kern' table if not empty
+    uint16_t hmetrics = 0;                              // Glyphs with an advance in 'hmtx', the rest
+                                                        // share the last one, 0 - all glyphs
+    bool     long_loca = false;                         // Forces 32 bit 'loca' offsets
+
+    // Serializes the font, returns false and sets 'error' if it can't be represented
+    bool write( std::vector<uint8_t> &ttf, std::string &error ) const;
+};
+
+// Generated font. Simple glyphs are random closed contours with random on and off curve
+// points, so contours start and end on and off the curve, with straight and smooth joints.
+// Composites of every depth level reference the glyphs of the previous level, each
+// transform kind in turn. Glyphs are mapped to consecutive codepoints from first_codepoint.
+// The same seed gives the same font.
+
+struct SynthFontOptions {
+    int      glyph_count = 1000;        // Simple glyphs
+    int      contours = 3;              // Contours per glyph
+    int      points = 16;               // Points per contour
+    int      composite_count = 0;       // Composite glyphs, spread over the depth levels
+    int      composite_depth = 1;       // Composite nesting depth
+    int      components = 2;            // Components per composite
+    int      cmap_format = 4;
+    uint32_t first_codepoint = 0x4E00;
+    bool     shuffle_cmap = false;      // Non-consecutive glyph indices, format 4 glyph id arrays
+    int      kern_pairs = 0;
+    int      hmetrics = 0;
+    bool     long_loca = false;
+    uint32_t seed = 1;
+};
+
+// Returns false and sets 'error' for the options out of the TrueType limits
+bool synth_font( const SynthFontOptions &options, TtfFont &font, std::string &error );
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Client of the sdf_atlas server ( sdf_atlas -s socket ).
+#
+# Usage: atlas_client.py socket output_name key=value ...
+#   keys are the request keys, e.g. font=Roboto-Regular.ttf row_height=48 ranges=31:126
+#   saves output_name.png ( or output_name_N.png ) and output_name.js
+
+import json
+import socket
+import struct
+import sys
+
+
+def send_frame(sock, payload):
+    sock.sendall(struct.pack('<I', len(payload)) + payload)
+
+
+def recv_exact(sock, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError('connection closed')
+        data += chunk
+    return bytes(data)
+
+
+def recv_frame(sock):
+    size, = struct.unpack('<I', recv_exact(sock, 4))
+    return recv_exact(sock, size)
+
+
+class AtlasClient:
+    def __init__(self, socket_path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(socket_path)
+
+    def request(self, req):
+        """Returns ( header, atlas_json, pages ), raises RuntimeError with the server error"""
+        send_frame(self.sock, json.dumps(req).encode('utf-8'))
+        header = json.loads(recv_frame(self.sock))
+        if not header['ok']:
+            raise RuntimeError(header['error'])
+        atlas = recv_frame(self.sock).decode('utf-8')
+        pages = [recv_frame(self.sock) for _ in range(header['pages'])]
+        return header, atlas, pages
+
+    def close(self):
+        self.sock.close()
+
+
+def parse_value(value):
+    try:
+        return int(value, 0)
+    except ValueError:
+        return value
+
+
+def main():
+    if len(sys.argv) < 4:
+        print('Usage: atlas_client.py socket output_name key=value ...')
+        sys.exit(1)
+
+    req = {}
+    for arg in sys.argv[3:]:
+        key, _, value = arg.partition('=')
+        if key == 'font' and 'font' in req:
+            req['font'] = (req['font'] if isinstance(req['font'], list) else [req['font']]) + [value]
+        else:
+            req[key] = parse_value(value) if key not in ('font', 'ranges', 'text', 'fit') else value
+
+    client = AtlasClient(sys.argv[1])
+    try:
+        header, atlas, pages = client.request(req)
+    except RuntimeError as e:
+        print('Error: %s' % e)
+        sys.exit(1)
+    finally:
+        client.close()
+
+    name = sys.argv[2]
+    ext = '.png' if header['format'] == 'png' else '.raw'
+    for i, page in enumerate(pages):
+        with open(name + (ext if len(pages) == 1 else '_%d%s' % (i, ext)), 'wb') as f:
+            f.write(page)
+    with open(name + '.js', 'w') as f:
+        f.write(atlas)
+
+    print('%d glyphs, %d pages %dx%d' % (header['glyphs'], header['pages'], header['width'], header['height']))
+
+
+if __name__ == '__main__':
+    main()
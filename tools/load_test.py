@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Load test of the sdf_atlas server: concurrent clients sending the same request.
+#
+# Usage: load_test.py socket font.ttf [clients] [requests_per_client] [key=value ...]
+#   reports the requests per second and the latency percentiles
+
+import os
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from atlas_client import AtlasClient, parse_value
+
+
+def main():
+    if len(sys.argv) < 3:
+        print('Usage: load_test.py socket font.ttf [clients] [requests_per_client] [key=value ...]')
+        sys.exit(1)
+
+    socket_path = sys.argv[1]
+    clients = int(sys.argv[3]) if len(sys.argv) > 3 else 4
+    count = int(sys.argv[4]) if len(sys.argv) > 4 else 50
+
+    req = {'font': sys.argv[2], 'row_height': 32, 'border_size': 4, 'width': 512}
+    for arg in sys.argv[5:]:
+        key, _, value = arg.partition('=')
+        req[key] = parse_value(value) if key not in ('font', 'ranges', 'text', 'fit') else value
+
+    latencies = []
+    errors = []
+    lock = threading.Lock()
+
+    def client_loop():
+        client = AtlasClient(socket_path)
+        times = []
+        try:
+            for _ in range(count):
+                t0 = time.perf_counter()
+                client.request(req)
+                times.append(time.perf_counter() - t0)
+        except Exception as e:
+            with lock:
+                errors.append(str(e))
+        finally:
+            client.close()
+        with lock:
+            latencies.extend(times)
+
+    threads = [threading.Thread(target=client_loop) for _ in range(clients)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    done = len(latencies)
+    if errors:
+        print('%d errors, first: %s' % (len(errors), errors[0]))
+    if not done:
+        sys.exit(1)
+
+    def pct(p):
+        return latencies[min(done - 1, int(p * done))] * 1000.0
+
+    print('%d clients, %d requests in %.2f s, %.1f requests/s' % (clients, done, elapsed, done / elapsed))
+    print('latency ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f' % (pct(0.5), pct(0.9), pct(0.99), latencies[-1] * 1000.0))
+
+
+if __name__ == '__main__':
+    main()